@@ -21,11 +21,21 @@
 /* Contact ckubisch@nvidia.com (Christoph Kubisch) for feedback */
 
 #include "cadscene.hpp"
+#include "csfgltf.hpp"
+#include "csfgzip.hpp"
+#include "matrixbatch.hpp"
+#include "meshoptimizer.hpp"
 #include <fileformats/cadscenefile.h>
 
+#include <nvh/nvprint.hpp>
+#include <nvh/parallel_work.hpp>
+
 #include <algorithm>
 #include <assert.h>
+#include <chrono>
 #include <cstddef>
+#include <string>
+#include <unordered_map>
 #include "glm/gtc/type_ptr.hpp"
 
 #define USE_CACHECOMBINE 1
@@ -42,180 +52,844 @@ glm::vec4 randomVector(float from, float to)
   return vec;
 }
 
-static void recursiveHierarchy(NodeTree& tree, CSFile* csf, int idx, int cloneoffset)
+struct GeometryStaging
+{
+  std::vector<CadScene::Vertex>        vertices;
+  std::vector<CadScene::VertexCompact> compactVertices;
+  std::vector<GLuint>                  indices;
+  std::vector<GLushort>                shortIndices;
+};
+
+static double getTimeMs()
+{
+  return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now().time_since_epoch()).count();
+}
+
+// thread-safe, must not issue any GL calls
+// baseVertex, vboOffset, iboOffset and indexType must already be set
+static void setupGeometry(CadScene::Geometry& geom, const CSFGeometry* csfgeom, bool compact)
 {
-  for(uint32_t i = 0; i < csf->nodes[idx].numChildren; i++)
+  size_t indexSize = geom.getIndexSize();
+
+  geom.cloneIdx = -1;
+
+  geom.numVertices   = csfgeom->numVertices;
+  geom.numIndexSolid = csfgeom->numIndexSolid;
+  geom.numIndexWire  = csfgeom->numIndexWire;
+
+  geom.vboSize = (compact ? sizeof(CadScene::VertexCompact) : sizeof(CadScene::Vertex)) * csfgeom->numVertices;
+  geom.iboSize = indexSize * (csfgeom->numIndexSolid + csfgeom->numIndexWire);
+
+  geom.parts.resize(csfgeom->numParts);
+
+  size_t offsetSolid = geom.iboOffset;
+  size_t offsetWire  = geom.iboOffset + csfgeom->numIndexSolid * indexSize;
+  for(uint32_t i = 0; i < csfgeom->numParts; i++)
   {
-    tree.setNodeParent((NodeTree::nodeID)csf->nodes[idx].children[i] + cloneoffset, (NodeTree::nodeID)idx + cloneoffset);
+    geom.parts[i].indexWire.count  = csfgeom->parts[i].numIndexWire;
+    geom.parts[i].indexSolid.count = csfgeom->parts[i].numIndexSolid;
+
+    geom.parts[i].indexWire.offset  = offsetWire;
+    geom.parts[i].indexSolid.offset = offsetSolid;
+
+    offsetWire += csfgeom->parts[i].numIndexWire * indexSize;
+    offsetSolid += csfgeom->parts[i].numIndexSolid * indexSize;
   }
+}
 
-  for(uint32_t i = 0; i < csf->nodes[idx].numChildren; i++)
+// thread-safe, must not issue any GL calls
+static void convertVertices(CadScene::Vertex* vertices, CadScene::BBox& bbox, const CSFGeometry* csfgeom)
+{
+  for(uint32_t i = 0; i < csfgeom->numVertices; i++)
   {
-    recursiveHierarchy(tree, csf, csf->nodes[idx].children[i], cloneoffset);
+    vertices[i].position[0] = csfgeom->vertex[3 * i + 0];
+    vertices[i].position[1] = csfgeom->vertex[3 * i + 1];
+    vertices[i].position[2] = csfgeom->vertex[3 * i + 2];
+    vertices[i].position[3] = 1.0f;
+    if(csfgeom->normal)
+    {
+      vertices[i].normal[0] = csfgeom->normal[3 * i + 0];
+      vertices[i].normal[1] = csfgeom->normal[3 * i + 1];
+      vertices[i].normal[2] = csfgeom->normal[3 * i + 2];
+      vertices[i].normal[3] = 0.0f;
+    }
+    else
+    {
+      vertices[i].normal = glm::vec4(normalize(glm::vec3(vertices[i].position)), 0.0f);
+    }
+
+
+    bbox.merge(vertices[i].position);
   }
 }
 
-bool CadScene::loadCSF(const char* filename, int clones, int cloneaxis)
+// thread-safe, must not issue any GL calls
+// same bbox as convertVertices, without converting the vertices
+static void computeBBox(CadScene::BBox& bbox, const CSFGeometry* csfgeom)
 {
-  CSFile*         csf;
-  CSFileMemoryPTR mem = CSFileMemory_new();
-  if(CSFile_loadExt(&csf, filename, mem) != CADSCENEFILE_NOERROR || !(csf->fileFlags & CADSCENEFILE_FLAG_UNIQUENODES))
+  for(uint32_t i = 0; i < csfgeom->numVertices; i++)
   {
-    CSFileMemory_delete(mem);
-    return false;
+    bbox.merge(glm::vec4(csfgeom->vertex[3 * i + 0], csfgeom->vertex[3 * i + 1], csfgeom->vertex[3 * i + 2], 1.0f));
   }
+}
 
-  int copies = clones + 1;
+static inline int16_t encodeSnorm16(float v)
+{
+  return int16_t(glm::round(glm::clamp(v, -1.0f, 1.0f) * 32767.0f));
+}
 
-  CSFile_transform(csf);
+// thread-safe, must not issue any GL calls
+// positions are stored as unorm16 relative to the geometry bbox,
+// normals as octahedron encoded snorm16 (see octDecode in scene.vert.glsl)
+static void quantizeVertices(CadScene::VertexCompact* compact, const CadScene::Vertex* vertices, size_t numVertices, const CadScene::BBox& bbox)
+{
+  glm::vec3 bboxMin = glm::vec3(bbox.min);
+  glm::vec3 extent  = glm::vec3(bbox.max) - bboxMin;
+  glm::vec3 scale   = glm::vec3(extent.x > 0 ? 1.0f / extent.x : 0.0f, extent.y > 0 ? 1.0f / extent.y : 0.0f,
+                              extent.z > 0 ? 1.0f / extent.z : 0.0f);
 
-  srand(234525);
+  for(size_t i = 0; i < numVertices; i++)
+  {
+    glm::vec3 pos = glm::clamp((glm::vec3(vertices[i].position) - bboxMin) * scale, 0.0f, 1.0f);
+    compact[i].position[0] = uint16_t(glm::round(pos.x * 65535.0f));
+    compact[i].position[1] = uint16_t(glm::round(pos.y * 65535.0f));
+    compact[i].position[2] = uint16_t(glm::round(pos.z * 65535.0f));
+    compact[i].position[3] = 0;
+
+    glm::vec3 normal = glm::vec3(vertices[i].normal);
+    float     sum    = glm::abs(normal.x) + glm::abs(normal.y) + glm::abs(normal.z);
+    normal           = sum > 0 ? normal / sum : glm::vec3(0, 0, 1);
+    glm::vec2 oct    = glm::vec2(normal.x, normal.y);
+    if(normal.z < 0)
+    {
+      oct = (1.0f - glm::abs(glm::vec2(oct.y, oct.x)))
+            * glm::vec2(oct.x >= 0 ? 1.0f : -1.0f, oct.y >= 0 ? 1.0f : -1.0f);
+    }
+    compact[i].normal[0] = encodeSnorm16(oct.x);
+    compact[i].normal[1] = encodeSnorm16(oct.y);
+  }
+}
 
-  // materials
-  m_materials.resize(csf->numMaterials);
-  for(int n = 0; n < csf->numMaterials; n++)
+// thread-safe, must not issue any GL calls
+// solid indices followed by wire indices, narrowed to 16 bit
+static void convertShortIndices(GLushort* indices, const CSFGeometry* csfgeom)
+{
+  for(uint32_t i = 0; i < csfgeom->numIndexSolid; i++)
   {
-    CSFMaterial* csfmaterial = &csf->materials[n];
-    Material&    material    = m_materials[n];
+    indices[i] = GLushort(csfgeom->indexSolid[i]);
+  }
+  indices += csfgeom->numIndexSolid;
+  for(uint32_t i = 0; i < csfgeom->numIndexWire; i++)
+  {
+    // the staging buffer is reused across batches, missing wire indices
+    // become zero like in the regular load
+    indices[i] = csfgeom->indexWire ? GLushort(csfgeom->indexWire[i]) : 0;
+  }
+}
 
-    for(int i = 0; i < 2; i++)
+struct GeometryOptimizeStats
+{
+  MeshOptimizer::CacheStats before;
+  MeshOptimizer::CacheStats after;
+};
+
+// thread-safe, must not issue any GL calls
+// triangles are reordered within each part only, so the part ranges set up
+// by setupGeometry stay valid. Wire indices keep their order and are only
+// remapped by the vertex fetch reordering.
+static void optimizeGeometry(std::vector<CadScene::Vertex>& vertices, std::vector<GLuint>& indices, const CSFGeometry* csfgeom, bool overdraw, GeometryOptimizeStats& stats)
+{
+  MeshOptimizer optimizer;
+
+  stats.before = MeshOptimizer::computeCacheStats(&indices[0], csfgeom->numIndexSolid, vertices.size());
+
+  size_t begin = 0;
+  for(uint32_t i = 0; i < csfgeom->numParts; i++)
+  {
+    size_t count = csfgeom->parts[i].numIndexSolid;
+    optimizer.optimizeVertexCache(&indices[begin], count, vertices.size());
+    if(overdraw)
     {
-      material.sides[i].ambient  = randomVector(0.0f, 0.1f);
-      material.sides[i].diffuse  = glm::make_vec4(csf->materials[n].color) + randomVector(0.0f, 0.07f);
-      material.sides[i].specular = randomVector(0.25f, 0.55f);
-      material.sides[i].emissive = randomVector(0.0f, 0.05f);
+      optimizer.optimizeOverdraw(&indices[begin], count, &vertices[0], vertices.size(), 1.05f);
     }
+    begin += count;
   }
 
-  glCreateBuffers(1, &m_materialsGL);
-  glNamedBufferStorage(m_materialsGL, sizeof(Material) * m_materials.size(), &m_materials[0], 0);
-  //glMapNamedBufferRange(m_materialsGL, 0, sizeof(Material) * m_materials.size(), GL_MAP_PERSISTENT_BIT | GL_MAP_WRITE_BIT);
+  MeshOptimizer::optimizeVertexFetch(&vertices[0], vertices.size(), &indices[0], indices.size());
 
-  // geometry
-  int numGeoms = csf->numGeometries;
-  m_geometry.resize(csf->numGeometries * copies);
-  m_geometryBboxes.resize(csf->numGeometries * copies);
-  for(int n = 0; n < csf->numGeometries; n++)
+  stats.after = MeshOptimizer::computeCacheStats(&indices[0], csfgeom->numIndexSolid, vertices.size());
+}
+
+// thread-safe, must not issue any GL calls
+static void convertGeometry(CadScene::Geometry&           geom,
+                            CadScene::BBox&               bbox,
+                            GeometryStaging&              staging,
+                            const CSFGeometry*            csfgeom,
+                            const CadScene::LoadConfig&   config,
+                            GeometryOptimizeStats&        stats)
+{
+  setupGeometry(geom, csfgeom, config.compactVertices);
+
+  std::vector<CadScene::Vertex>& vertices = staging.vertices;
+  vertices.resize(csfgeom->numVertices);
+  convertVertices(&vertices[0], bbox, csfgeom);
+
+  std::vector<GLuint>& indices = staging.indices;
+  indices.resize(csfgeom->numIndexSolid + csfgeom->numIndexWire);
+  memcpy(&indices[0], csfgeom->indexSolid, sizeof(GLuint) * csfgeom->numIndexSolid);
+  if(csfgeom->indexWire)
+  {
+    memcpy(&indices[csfgeom->numIndexSolid], csfgeom->indexWire, sizeof(GLuint) * csfgeom->numIndexWire);
+  }
+
+  if(config.optimizeMeshes)
+  {
+    optimizeGeometry(vertices, indices, csfgeom, config.optimizeOverdraw, stats);
+  }
+
+  if(config.compactVertices)
+  {
+    staging.compactVertices.resize(csfgeom->numVertices);
+    quantizeVertices(&staging.compactVertices[0], &vertices[0], vertices.size(), bbox);
+    vertices = std::vector<CadScene::Vertex>();
+  }
+
+  if(geom.indexType == GL_UNSIGNED_SHORT)
+  {
+    staging.shortIndices.assign(indices.begin(), indices.end());
+    indices = std::vector<GLuint>();
+  }
+}
+
+void CadScene::makeGeometryResident(Geometry& geom)
+{
+  if(has_GL_NV_vertex_buffer_unified_memory)
+  {
+    glGetNamedBufferParameterui64vNV(geom.vboGL, GL_BUFFER_GPU_ADDRESS_NV, &geom.vboADDR);
+    glMakeNamedBufferResidentNV(geom.vboGL, GL_READ_ONLY);
+
+    glGetNamedBufferParameterui64vNV(geom.iboGL, GL_BUFFER_GPU_ADDRESS_NV, &geom.iboADDR);
+    glMakeNamedBufferResidentNV(geom.iboGL, GL_READ_ONLY);
+  }
+}
+
+static void uploadGeometry(CadScene::Geometry& geom, const GeometryStaging& staging, bool arena)
+{
+  const void* vertexData = staging.compactVertices.empty() ? (const void*)&staging.vertices[0] :
+                                                             (const void*)&staging.compactVertices[0];
+  const void* indexData  = staging.shortIndices.empty() ? (const void*)&staging.indices[0] :
+                                                          (const void*)&staging.shortIndices[0];
+  if(arena)
+  {
+    glNamedBufferSubData(geom.vboGL, geom.vboOffset, geom.vboSize, vertexData);
+    glNamedBufferSubData(geom.iboGL, geom.iboOffset, geom.iboSize, indexData);
+    return;
+  }
+
+  glCreateBuffers(1, &geom.vboGL);
+  glNamedBufferStorage(geom.vboGL, geom.vboSize, vertexData, 0);
+
+  glCreateBuffers(1, &geom.iboGL);
+  glNamedBufferStorage(geom.iboGL, geom.iboSize, indexData, 0);
+
+  CadScene::makeGeometryResident(geom);
+}
+
+// vertices come from the shared staging buffer, 32-bit indices are
+// read straight from the file mapping without an intermediate copy,
+// 16-bit indices were narrowed into the shared staging buffer as well
+static void uploadGeometryMapped(CadScene::Geometry& geom, const void* vertices, const GLushort* shortIndices, const CSFGeometry* csfgeom, bool arena)
+{
+  if(shortIndices)
+  {
+    if(arena)
+    {
+      glNamedBufferSubData(geom.vboGL, geom.vboOffset, geom.vboSize, vertices);
+      glNamedBufferSubData(geom.iboGL, geom.iboOffset, geom.iboSize, shortIndices);
+      return;
+    }
+
+    glCreateBuffers(1, &geom.vboGL);
+    glNamedBufferStorage(geom.vboGL, geom.vboSize, vertices, 0);
+
+    glCreateBuffers(1, &geom.iboGL);
+    glNamedBufferStorage(geom.iboGL, geom.iboSize, shortIndices, 0);
+
+    CadScene::makeGeometryResident(geom);
+    return;
+  }
+
+  size_t sizeSolid = sizeof(GLuint) * csfgeom->numIndexSolid;
+  size_t sizeWire  = sizeof(GLuint) * csfgeom->numIndexWire;
+  // wire counts without wire indices are zero-filled like in the regular load
+  bool   zeroWire  = sizeWire && !csfgeom->indexWire;
+
+  if(arena)
+  {
+    glNamedBufferSubData(geom.vboGL, geom.vboOffset, geom.vboSize, vertices);
+    glNamedBufferSubData(geom.iboGL, geom.iboOffset, sizeSolid, csfgeom->indexSolid);
+    if(zeroWire)
+    {
+      glClearNamedBufferSubData(geom.iboGL, GL_R32UI, geom.iboOffset + sizeSolid, sizeWire, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+    }
+    else if(sizeWire)
+    {
+      glNamedBufferSubData(geom.iboGL, geom.iboOffset + sizeSolid, sizeWire, csfgeom->indexWire);
+    }
+    return;
+  }
+
+  glCreateBuffers(1, &geom.vboGL);
+  glNamedBufferStorage(geom.vboGL, geom.vboSize, vertices, 0);
+
+  glCreateBuffers(1, &geom.iboGL);
+  if(!sizeWire || (const uint8_t*)csfgeom->indexWire == (const uint8_t*)csfgeom->indexSolid + sizeSolid)
+  {
+    // solid and wire indices are adjacent in the file, single copy
+    glNamedBufferStorage(geom.iboGL, geom.iboSize, csfgeom->indexSolid, 0);
+  }
+  else
+  {
+    glNamedBufferStorage(geom.iboGL, geom.iboSize, nullptr, GL_DYNAMIC_STORAGE_BIT);
+    glNamedBufferSubData(geom.iboGL, 0, sizeSolid, csfgeom->indexSolid);
+    if(zeroWire)
+    {
+      glClearNamedBufferSubData(geom.iboGL, GL_R32UI, sizeSolid, sizeWire, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+    }
+    else
+    {
+      glNamedBufferSubData(geom.iboGL, sizeSolid, sizeWire, csfgeom->indexWire);
+    }
+  }
+
+  CadScene::makeGeometryResident(geom);
+}
+
+// the file stays loaded until the last object is ready, geometries are
+// converted in the order objects first use them
+struct CadScene::ProgressiveLoad
+{
+  CSFile*                         csf;
+  CSFileMemoryPTR                 mem;
+  std::vector<const CSFGeometry*> geometries;
+  LoadConfig                      config;
+  int                             sceneCopies;
+  std::vector<uint8_t>            geometryReady;
+  int                             numUploaded;
+  double                          timeBegin;
+};
+
+// FNV-1a style over 64-bit words, the tail is zero padded
+static uint64_t hashData(uint64_t hash, const void* data, size_t size)
+{
+  const uint64_t prime = 0x100000001b3ULL;
+  const uint8_t* bytes = (const uint8_t*)data;
+  for(size_t i = 0; i < size; i += sizeof(uint64_t))
+  {
+    uint64_t word = 0;
+    memcpy(&word, bytes + i, std::min(sizeof(uint64_t), size - i));
+    hash ^= word;
+    hash *= prime;
+  }
+  return hash;
+}
+
+// covers what the renderer uses: positions, normals, indices, part ranges
+static uint64_t hashGeometry(const CSFGeometry* geo)
+{
+  uint64_t counts[4] = {uint64_t(geo->numVertices), uint64_t(geo->numIndexSolid), uint64_t(geo->numIndexWire),
+                        uint64_t(geo->numParts) | (geo->normal ? 1ULL << 32 : 0)};
+  uint64_t hash      = hashData(0xcbf29ce484222325ULL, counts, sizeof(counts));
+  hash               = hashData(hash, geo->vertex, sizeof(float) * 3 * geo->numVertices);
+  if(geo->normal)
+  {
+    hash = hashData(hash, geo->normal, sizeof(float) * 3 * geo->numVertices);
+  }
+  hash = hashData(hash, geo->indexSolid, sizeof(GLuint) * geo->numIndexSolid);
+  if(geo->indexWire)
+  {
+    hash = hashData(hash, geo->indexWire, sizeof(GLuint) * geo->numIndexWire);
+  }
+  for(int p = 0; p < geo->numParts; p++)
+  {
+    uint64_t part = uint64_t(geo->parts[p].numIndexSolid) | (uint64_t(geo->parts[p].numIndexWire) << 32);
+    hash          = hashData(hash, &part, sizeof(part));
+  }
+  return hash;
+}
+
+static bool equalGeometry(const CSFGeometry* a, const CSFGeometry* b)
+{
+  if(a->numVertices != b->numVertices || a->numIndexSolid != b->numIndexSolid || a->numIndexWire != b->numIndexWire
+     || a->numParts != b->numParts || !a->normal != !b->normal || !a->indexWire != !b->indexWire)
+    return false;
+
+  for(int p = 0; p < a->numParts; p++)
+  {
+    if(a->parts[p].numIndexSolid != b->parts[p].numIndexSolid || a->parts[p].numIndexWire != b->parts[p].numIndexWire)
+      return false;
+  }
+
+  return memcmp(a->vertex, b->vertex, sizeof(float) * 3 * a->numVertices) == 0
+         && (!a->normal || memcmp(a->normal, b->normal, sizeof(float) * 3 * a->numVertices) == 0)
+         && memcmp(a->indexSolid, b->indexSolid, sizeof(GLuint) * a->numIndexSolid) == 0
+         && (!a->indexWire || memcmp(a->indexWire, b->indexWire, sizeof(GLuint) * a->numIndexWire) == 0);
+}
+
+// the name is ignored, only color, type and the payload matter
+static uint64_t hashMaterial(const CSFMaterial* mtl)
+{
+  uint64_t hash = hashData(0xcbf29ce484222325ULL, mtl->color, sizeof(mtl->color));
+  uint64_t info = uint64_t(uint32_t(mtl->type)) | (uint64_t(uint32_t(mtl->numBytes)) << 32);
+  hash          = hashData(hash, &info, sizeof(info));
+  if(mtl->bytes)
   {
-    CSFGeometry* csfgeom = &csf->geometries[n];
-    Geometry&    geom    = m_geometry[n];
+    hash = hashData(hash, mtl->bytes, mtl->numBytes);
+  }
+  return hash;
+}
 
-    geom.cloneIdx = -1;
+static bool equalMaterial(const CSFMaterial* a, const CSFMaterial* b)
+{
+  return memcmp(a->color, b->color, sizeof(a->color)) == 0 && a->type == b->type && a->numBytes == b->numBytes
+         && !a->bytes == !b->bytes && (!a->bytes || memcmp(a->bytes, b->bytes, a->numBytes) == 0);
+}
+
+// maps every item to the first one with identical content, unique lists
+// the survivors in order of first occurrence. Hashing runs on the worker
+// threads, collisions are resolved by a full compare.
+template <class T, class FnHash, class FnEqual>
+static void deduplicate(const T* items, int count, bool enabled, int threads, FnHash fnHash, FnEqual fnEqual,
+                        std::vector<const T*>& unique, std::vector<int>& remap)
+{
+  unique.clear();
+  remap.resize(count);
+
+  if(!enabled)
+  {
+    for(int n = 0; n < count; n++)
+    {
+      remap[n] = n;
+      unique.push_back(&items[n]);
+    }
+    return;
+  }
 
-    geom.numVertices   = csfgeom->numVertices;
-    geom.numIndexSolid = csfgeom->numIndexSolid;
-    geom.numIndexWire  = csfgeom->numIndexWire;
+  std::vector<uint64_t> hashes(count);
+  auto                  fnHashItem = [&](uint64_t n) { hashes[n] = fnHash(&items[n]); };
+  if(threads > 1)
+  {
+    nvh::parallel_batches<16>(count, fnHashItem, uint32_t(threads));
+  }
+  else
+  {
+    for(int n = 0; n < count; n++)
+    {
+      fnHashItem(n);
+    }
+  }
 
-    std::vector<Vertex> vertices(csfgeom->numVertices);
-    for(uint32_t i = 0; i < csfgeom->numVertices; i++)
+  std::unordered_multimap<uint64_t, int> lookup;
+  lookup.reserve(count);
+  for(int n = 0; n < count; n++)
+  {
+    int  found = -1;
+    auto range = lookup.equal_range(hashes[n]);
+    for(auto it = range.first; it != range.second && found < 0; ++it)
     {
-      vertices[i].position[0] = csfgeom->vertex[3 * i + 0];
-      vertices[i].position[1] = csfgeom->vertex[3 * i + 1];
-      vertices[i].position[2] = csfgeom->vertex[3 * i + 2];
-      vertices[i].position[3] = 1.0f;
-      if(csfgeom->normal)
+      if(fnEqual(unique[it->second], &items[n]))
       {
-        vertices[i].normal[0] = csfgeom->normal[3 * i + 0];
-        vertices[i].normal[1] = csfgeom->normal[3 * i + 1];
-        vertices[i].normal[2] = csfgeom->normal[3 * i + 2];
-        vertices[i].normal[3] = 0.0f;
+        found = it->second;
       }
-      else
+    }
+
+    if(found < 0)
+    {
+      found = int(unique.size());
+      unique.push_back(&items[n]);
+      lookup.emplace(hashes[n], found);
+    }
+    remap[n] = found;
+  }
+}
+
+static bool isMappableCSF(const char* filename)
+{
+  // only raw .csf files can be mapped, compressed or gltf files need decoding
+  size_t len = strlen(filename);
+  return len > 4 && strcmp(filename + len - 4, ".csf") == 0;
+}
+
+static bool isGzipCSF(const char* filename)
+{
+  size_t len = strlen(filename);
+  return len > 3 && strcmp(filename + len - 3, ".gz") == 0;
+}
+
+bool CadScene::loadCSF(const char* filename, int clones, int cloneaxis, const LoadConfig& loadConfig)
+{
+  LoadConfig config = loadConfig;
+  if(config.cpuOnly)
+  {
+    // both need GL, the cache uploads straight from its mapping
+    config.sceneCache  = false;
+    config.progressive = false;
+  }
+
+  m_cpuOnly          = config.cpuOnly;
+  m_arenaBuffers     = config.arenaBuffers;
+  m_compactVertices  = config.compactVertices;
+  m_compactMaterials = config.compactMaterials;
+  m_compactMatrices  = config.compactMatrices;
+  m_doubleMatrices   = config.doubleMatrices;
+  m_instancedClones  = config.instancedClones;
+  m_arenaVboGL      = 0;
+  m_arenaIboGL      = 0;
+
+  std::string cacheFilename;
+  uint64_t    cacheKey         = 0;
+  uint64_t    cacheContentHash = 0;
+  if(config.sceneCache)
+  {
+    double timeBegin = getTimeMs();
+
+    cacheFilename = std::string(filename) + ".scenecache";
+    cacheKey      = computeCacheKey(filename, clones, cloneaxis, config);
+    if(cacheKey && config.sceneCacheVerify)
+    {
+      cacheContentHash = computeCacheContentHash(filename);
+    }
+    if(cacheKey && loadCache(cacheFilename.c_str(), cacheKey, cacheContentHash))
+    {
+      LOGI("scene cache: loaded %s in %8.2f ms\n", cacheFilename.c_str(), getTimeMs() - timeBegin);
+      size_t sceneCopies  = config.instancedClones ? 1 : size_t(clones + 1);
+      m_numBaseNodes      = m_matrices.size() / sceneCopies;
+      m_numBaseObjects    = m_objects.size() / sceneCopies;
+      m_numBaseGeometries = m_geometry.size() / sceneCopies;
+      m_copyObjects       = m_numBaseObjects;
+      m_readyObjects      = m_numBaseObjects;
+      if(config.flatObjects)
       {
-        vertices[i].normal = glm::vec4(normalize(glm::vec3(vertices[i].position)), 0.0f);
+        buildFlatObjects(true);
       }
+      return true;
+    }
+  }
 
+  CSFile*         csf;
+  CSFileMemoryPTR mem = CSFileMemory_new();
 
-      m_geometryBboxes[n].merge(vertices[i].position);
+  // the read-only load keeps the bulk vertex and index data inside the
+  // file mapping, only the small arrays that need pointer fixups get copied
+  bool useMapping = config.fileMapping && isMappableCSF(filename);
+  int  result     = CADSCENEFILE_NOERROR;
+  if(useMapping)
+  {
+    result = CSFile_loadReadOnly(&csf, filename, mem);
+    if(result != CADSCENEFILE_NOERROR)
+    {
+      // e.g. compressed payloads, older versions or unaligned arrays can't
+      // be used in place, the regular load still handles those
+      LOGW("loadmapped: read-only load failed (%d), using regular load\n", result);
+      CSFileMemory_delete(mem);
+      mem        = CSFileMemory_new();
+      useMapping = false;
     }
+  }
+  if(!useMapping)
+  {
+    if(config.gltfDirect && csfIsGltf(filename))
+    {
+      double timeBegin = getTimeMs();
+      result           = csfLoadGltf(&csf, filename, mem, uint32_t(config.threads));
+      LOGI("gltf: direct load in %8.2f ms\n", getTimeMs() - timeBegin);
+    }
+    else if(!(config.threads > 1 && isGzipCSF(filename) && csfLoadChunkedGz(&csf, filename, mem, uint32_t(config.threads), result)))
+    {
+      // ordinary single-stream .gz, raw .csf or gltf
+      result = CSFile_loadExt(&csf, filename, mem);
+    }
+  }
+  if(result != CADSCENEFILE_NOERROR || !(csf->fileFlags & CADSCENEFILE_FLAG_UNIQUENODES))
+  {
+    CSFileMemory_delete(mem);
+    return false;
+  }
 
-    geom.vboSize = sizeof(Vertex) * vertices.size();
+  int copies = clones + 1;
+  // copies that are physically stored in the scene arrays
+  int sceneCopies = config.instancedClones ? 1 : copies;
 
-    glCreateBuffers(1, &geom.vboGL);
-    glNamedBufferStorage(geom.vboGL, geom.vboSize, &vertices[0], 0);
+  CSFile_transform(csf);
 
-    std::vector<GLuint> indices(csfgeom->numIndexSolid + csfgeom->numIndexWire);
-    memcpy(&indices[0], csfgeom->indexSolid, sizeof(GLuint) * csfgeom->numIndexSolid);
-    if(csfgeom->indexWire)
+  // identical geometries and materials collapse onto their first occurrence,
+  // everything below works on the unique lists and remaps the csf indices
+  std::vector<const CSFGeometry*> csfGeometries;
+  std::vector<const CSFMaterial*> csfMaterials;
+  std::vector<int>                geometryRemap;
+  std::vector<int>                materialRemap;
+  {
+    double timeBegin = getTimeMs();
+    deduplicate(csf->geometries, csf->numGeometries, config.deduplicate, config.threads, hashGeometry, equalGeometry,
+                csfGeometries, geometryRemap);
+    deduplicate(csf->materials, csf->numMaterials, config.deduplicate, config.threads, hashMaterial, equalMaterial,
+                csfMaterials, materialRemap);
+    if(config.deduplicate)
     {
-      memcpy(&indices[csfgeom->numIndexSolid], csfgeom->indexWire, sizeof(GLuint) * csfgeom->numIndexWire);
+      LOGI("deduplication: %d of %d geometries, %d of %d materials collapsed in %8.2f ms\n",
+           csf->numGeometries - int(csfGeometries.size()), csf->numGeometries, csf->numMaterials - int(csfMaterials.size()),
+           csf->numMaterials, getTimeMs() - timeBegin);
     }
+  }
 
-    geom.iboSize = sizeof(GLuint) * indices.size();
+  srand(234525);
 
-    glCreateBuffers(1, &geom.iboGL);
-    glNamedBufferStorage(geom.iboGL, geom.iboSize, &indices[0], 0);
+  // materials
+  m_materials.resize(csfMaterials.size());
+  for(size_t n = 0; n < csfMaterials.size(); n++)
+  {
+    const CSFMaterial* csfmaterial = csfMaterials[n];
+    Material&          material    = m_materials[n];
 
-    if(has_GL_NV_vertex_buffer_unified_memory)
+    for(int i = 0; i < 2; i++)
     {
-      glGetNamedBufferParameterui64vNV(geom.vboGL, GL_BUFFER_GPU_ADDRESS_NV, &geom.vboADDR);
-      glMakeNamedBufferResidentNV(geom.vboGL, GL_READ_ONLY);
-
-      glGetNamedBufferParameterui64vNV(geom.iboGL, GL_BUFFER_GPU_ADDRESS_NV, &geom.iboADDR);
-      glMakeNamedBufferResidentNV(geom.iboGL, GL_READ_ONLY);
+      material.sides[i].ambient  = randomVector(0.0f, 0.1f);
+      material.sides[i].diffuse  = glm::make_vec4(csfmaterial->color) + randomVector(0.0f, 0.07f);
+      material.sides[i].specular = randomVector(0.25f, 0.55f);
+      material.sides[i].emissive = randomVector(0.0f, 0.05f);
     }
+  }
 
-    geom.parts.resize(csfgeom->numParts);
+  // geometry
+  int numGeoms = int(csfGeometries.size());
+  m_geometry.resize(numGeoms * sceneCopies);
+  m_geometryBboxes.resize(numGeoms * sceneCopies);
 
-    size_t offsetSolid = 0;
-    size_t offsetWire  = csfgeom->numIndexSolid * sizeof(GLuint);
-    for(uint32_t i = 0; i < csfgeom->numParts; i++)
+  // placement within the arena is known upfront from the csf counts,
+  // so conversion and upload can stay per geometry
+  {
+    size_t vboSize = 0;
+    size_t iboSize = 0;
+    for(int n = 0; n < numGeoms; n++)
     {
-      geom.parts[i].indexWire.count  = csfgeom->parts[i].numIndexWire;
-      geom.parts[i].indexSolid.count = csfgeom->parts[i].numIndexSolid;
+      Geometry& geom  = m_geometry[n];
+      geom.indexType  = config.shortIndices && csfGeometries[n]->numVertices <= 0x10000 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+      geom.baseVertex = config.arenaBuffers ? GLint(vboSize / getVertexSize()) : 0;
+      geom.vboOffset  = config.arenaBuffers ? vboSize : 0;
+      geom.iboOffset  = config.arenaBuffers ? iboSize : 0;
+
+      vboSize += getVertexSize() * csfGeometries[n]->numVertices;
+      iboSize += geom.getIndexSize() * (csfGeometries[n]->numIndexSolid + csfGeometries[n]->numIndexWire);
+      // firstIndex is derived from the byte offset, keep 32-bit ranges aligned
+      iboSize = (iboSize + sizeof(GLuint) - 1) & ~(sizeof(GLuint) - 1);
+    }
 
-      geom.parts[i].indexWire.offset  = offsetWire;
-      geom.parts[i].indexSolid.offset = offsetSolid;
+    if(config.arenaBuffers)
+    {
+      createArenaBuffers(vboSize, iboSize);
+      for(int n = 0; n < numGeoms; n++)
+      {
+        m_geometry[n].vboGL   = m_arenaVboGL;
+        m_geometry[n].iboGL   = m_arenaIboGL;
+        m_geometry[n].vboADDR = m_arenaVboADDR;
+        m_geometry[n].iboADDR = m_arenaIboADDR;
+      }
+    }
+  }
+  // conversion does not touch GL and is independent per geometry,
+  // so it can be spread across worker threads. The upload to GL
+  // happens afterwards serially on the main thread.
+  double timeBegin     = getTimeMs();
+  double timeConverted = 0;
+  double timeUploaded  = 0;
 
-      offsetWire += csfgeom->parts[i].numIndexWire * sizeof(GLuint);
-      offsetSolid += csfgeom->parts[i].numIndexSolid * sizeof(GLuint);
+  // the optimizer rewrites indices, so it always goes through the
+  // per-geometry staging path, which reads the mapping just as well
+  bool streamMapped = useMapping && !config.optimizeMeshes;
+
+  std::vector<GeometryOptimizeStats> optimizeStats(config.optimizeMeshes ? numGeoms : 0);
+
+  if(config.progressive)
+  {
+    // only what objects and draw ranges need upfront,
+    // vertex and index data follow in loadProgressive
+    auto fnSetup = [&](uint64_t n) {
+      setupGeometry(m_geometry[n], csfGeometries[n], m_compactVertices);
+      computeBBox(m_geometryBboxes[n], csfGeometries[n]);
+    };
+
+    if(config.threads > 1)
+    {
+      nvh::parallel_batches<16>(numGeoms, fnSetup, uint32_t(config.threads));
     }
+    else
+    {
+      for(int n = 0; n < numGeoms; n++)
+      {
+        fnSetup(n);
+      }
+    }
+
+    timeConverted = getTimeMs() - timeBegin;
   }
-  for(int c = 1; c <= clones; c++)
+  else if(streamMapped)
   {
-    for(int n = 0; n < numGeoms; n++)
+    // geometries are processed in batches that share a single vertex staging
+    // buffer, which only grows to the largest batch and is reused afterwards.
+    int                   batchSize = config.threads > 1 ? config.threads * 16 : 1;
+    std::vector<Vertex>        vertices;
+    std::vector<VertexCompact> compactVertices;
+    std::vector<GLushort>      shortIndices;
+    std::vector<size_t>        batchOffsets(batchSize);
+    std::vector<size_t>        batchIndexOffsets(batchSize);
+
+    for(int begin = 0; begin < numGeoms; begin += batchSize)
     {
-      m_geometryBboxes[n + numGeoms * c] = m_geometryBboxes[n];
+      int    batchCount  = std::min(batchSize, numGeoms - begin);
+      size_t numVertices     = 0;
+      size_t numShortIndices = 0;
+      for(int i = 0; i < batchCount; i++)
+      {
+        batchOffsets[i]      = numVertices;
+        batchIndexOffsets[i] = numShortIndices;
+        numVertices += csfGeometries[begin + i]->numVertices;
+        if(m_geometry[begin + i].indexType == GL_UNSIGNED_SHORT)
+        {
+          numShortIndices += csfGeometries[begin + i]->numIndexSolid + csfGeometries[begin + i]->numIndexWire;
+        }
+      }
+      vertices.resize(numVertices);
+      shortIndices.resize(numShortIndices);
+      if(m_compactVertices)
+      {
+        compactVertices.resize(numVertices);
+      }
 
-      const Geometry& geomorig = m_geometry[n];
-      Geometry&       geom     = m_geometry[n + numGeoms * c];
+      auto fnConvertMapped = [&](uint64_t i) {
+        int n = begin + int(i);
+        setupGeometry(m_geometry[n], csfGeometries[n], m_compactVertices);
+        convertVertices(vertices.data() + batchOffsets[i], m_geometryBboxes[n], csfGeometries[n]);
+        if(m_compactVertices)
+        {
+          quantizeVertices(compactVertices.data() + batchOffsets[i], vertices.data() + batchOffsets[i],
+                           csfGeometries[n]->numVertices, m_geometryBboxes[n]);
+        }
+        if(m_geometry[n].indexType == GL_UNSIGNED_SHORT)
+        {
+          convertShortIndices(shortIndices.data() + batchIndexOffsets[i], csfGeometries[n]);
+        }
+      };
+
+      double timeBatch = getTimeMs();
+      if(batchCount > 1)
+      {
+        nvh::parallel_batches<16>(batchCount, fnConvertMapped, uint32_t(config.threads));
+      }
+      else
+      {
+        fnConvertMapped(0);
+      }
+      double timeBatchConverted = getTimeMs();
 
-      geom = geomorig;
+      for(int i = 0; i < batchCount; i++)
+      {
+        const void* vertexData = m_compactVertices ? (const void*)(compactVertices.data() + batchOffsets[i]) :
+                                                     (const void*)(vertices.data() + batchOffsets[i]);
+        const GLushort* indexData = m_geometry[begin + i].indexType == GL_UNSIGNED_SHORT ?
+                                        shortIndices.data() + batchIndexOffsets[i] :
+                                        nullptr;
+        if(!m_cpuOnly)
+        {
+          uploadGeometryMapped(m_geometry[begin + i], vertexData, indexData, csfGeometries[begin + i], config.arenaBuffers);
+        }
+      }
 
-#if 1
-      geom.cloneIdx = n;
-#else
-      geom.cloneIdx = -1;
-      glCreateBuffers(1, &geom.vboGL);
-      glNamedBufferStorage(geom.vboGL, geom.vboSize, 0, 0);
+      timeConverted += timeBatchConverted - timeBatch;
+      timeUploaded += getTimeMs() - timeBatchConverted;
+    }
+  }
+  else
+  {
+    std::vector<GeometryStaging> staging(numGeoms);
 
-      glCreateBuffers(1, &geom.iboGL);
-      glNamedBufferStorage(geom.iboGL, geom.iboSize, 0, 0);
+    auto fnConvert = [&](uint64_t n) {
+      GeometryOptimizeStats unused;
+      convertGeometry(m_geometry[n], m_geometryBboxes[n], staging[n], csfGeometries[n], config,
+                      config.optimizeMeshes ? optimizeStats[n] : unused);
+    };
 
-      if(has_GL_NV_vertex_buffer_unified_memory)
+    if(config.threads > 1)
+    {
+      nvh::parallel_batches<16>(numGeoms, fnConvert, uint32_t(config.threads));
+    }
+    else
+    {
+      for(int n = 0; n < numGeoms; n++)
       {
-        glGetNamedBufferParameterui64vNV(geom.vboGL, GL_BUFFER_GPU_ADDRESS_NV, &geom.vboADDR);
-        glMakeNamedBufferResidentNV(geom.vboGL, GL_READ_ONLY);
+        fnConvert(n);
+      }
+    }
 
-        glGetNamedBufferParameterui64vNV(geom.iboGL, GL_BUFFER_GPU_ADDRESS_NV, &geom.iboADDR);
-        glMakeNamedBufferResidentNV(geom.iboGL, GL_READ_ONLY);
+    double timeMid = getTimeMs();
+
+    for(int n = 0; n < numGeoms; n++)
+    {
+      if(!m_cpuOnly)
+      {
+        uploadGeometry(m_geometry[n], staging[n], config.arenaBuffers);
       }
 
-      glCopyNamedBufferSubData(geomorig.vboGL, geom.vboGL, 0, 0, geom.vboSize);
-      glCopyNamedBufferSubData(geomorig.iboGL, geom.iboGL, 0, 0, geom.iboSize);
-#endif
+      // release staging memory early to keep peak usage down
+      staging[n] = GeometryStaging();
     }
+
+    timeConverted = timeMid - timeBegin;
+    timeUploaded  = getTimeMs() - timeMid;
   }
 
+  if(config.progressive)
+  {
+    LOGI("geometry setup:      %8.2f ms (%d threads, progressive)\n", timeConverted, config.threads > 1 ? config.threads : 1);
+  }
+  else
+  {
+    LOGI("geometry conversion: %8.2f ms (%d threads%s)\n", timeConverted, config.threads > 1 ? config.threads : 1,
+         streamMapped ? ", mapped" : "");
+    LOGI("geometry upload:     %8.2f ms\n", timeUploaded);
+  }
 
-  glCreateBuffers(1, &m_geometryBboxesGL);
-  glNamedBufferStorage(m_geometryBboxesGL, sizeof(BBox) * m_geometryBboxes.size(), &m_geometryBboxes[0], 0);
-  glCreateTextures(GL_TEXTURE_BUFFER, 1, &m_geometryBboxesTexGL);
-  glTextureBuffer(m_geometryBboxesTexGL, GL_RGBA32F, m_geometryBboxesGL);
+  if(config.optimizeMeshes && !config.progressive)
+  {
+    // ACMR: transformed vertices per triangle, ATVR: per referenced vertex,
+    // both for the solid triangles with a FIFO of STATS_CACHE_SIZE
+    LOGI("mesh optimization (FIFO %d%s):\n", MeshOptimizer::STATS_CACHE_SIZE, config.optimizeOverdraw ? ", overdraw" : "");
+    LOGI("  geometry  triangles   ACMR before/after   ATVR before/after\n");
+
+    double totalBefore = 0;
+    double totalAfter  = 0;
+    size_t totalTris   = 0;
+    for(int n = 0; n < numGeoms; n++)
+    {
+      const GeometryOptimizeStats& stats = optimizeStats[n];
+      if(!stats.before.triangles)
+        continue;
+
+      LOGI("  %8d %10d     %5.3f / %5.3f       %5.3f / %5.3f\n", n, (uint32_t)stats.before.triangles, stats.before.acmr,
+           stats.after.acmr, stats.before.atvr, stats.after.atvr);
+
+      totalBefore += stats.before.acmr * double(stats.before.triangles);
+      totalAfter += stats.after.acmr * double(stats.after.triangles);
+      totalTris += stats.before.triangles;
+    }
+    if(totalTris)
+    {
+      LOGI("  total    %10d     %5.3f / %5.3f\n", (uint32_t)totalTris, totalBefore / double(totalTris), totalAfter / double(totalTris));
+    }
+  }
 
   // nodes
   int numObjects = 0;
-  m_matrices.resize(csf->numNodes * copies);
+  m_matrices.resize(csf->numNodes * sceneCopies);
 
   for(int n = 0; n < csf->numNodes; n++)
   {
@@ -224,9 +898,6 @@ bool CadScene::loadCSF(const char* filename, int clones, int cloneaxis)
     memcpy(glm::value_ptr(m_matrices[n].objectMatrix), csfnode->objectTM, sizeof(float) * 16);
     memcpy(glm::value_ptr(m_matrices[n].worldMatrix), csfnode->worldTM, sizeof(float) * 16);
 
-    m_matrices[n].objectMatrixIT = glm::transpose(glm::inverse(m_matrices[n].objectMatrix));
-    m_matrices[n].worldMatrixIT  = glm::transpose(glm::inverse(m_matrices[n].worldMatrix));
-
     if(csfnode->geometryIDX < 0)
       continue;
 
@@ -235,8 +906,8 @@ bool CadScene::loadCSF(const char* filename, int clones, int cloneaxis)
 
 
   // objects
-  m_objects.resize(numObjects * copies);
-  m_objectAssigns.resize(numObjects * copies);
+  m_objects.resize(numObjects * sceneCopies);
+  m_objectAssigns.resize(numObjects * sceneCopies);
   numObjects = 0;
   for(int n = 0; n < csf->numNodes; n++)
   {
@@ -248,7 +919,7 @@ bool CadScene::loadCSF(const char* filename, int clones, int cloneaxis)
     Object& object = m_objects[numObjects];
 
     object.matrixIndex   = n;
-    object.geometryIndex = csfnode->geometryIDX;
+    object.geometryIndex = geometryRemap[csfnode->geometryIDX];
 
     m_objectAssigns[numObjects] = glm::ivec2(object.matrixIndex, object.geometryIndex);
 
@@ -257,7 +928,7 @@ bool CadScene::loadCSF(const char* filename, int clones, int cloneaxis)
     {
       object.parts[i].active        = 1;
       object.parts[i].matrixIndex   = csfnode->parts[i].nodeIDX < 0 ? object.matrixIndex : csfnode->parts[i].nodeIDX;
-      object.parts[i].materialIndex = csfnode->parts[i].materialIDX;
+      object.parts[i].materialIndex = materialRemap[csfnode->parts[i].materialIDX];
     }
 
     BBox bbox = m_geometryBboxes[object.geometryIndex].transformed(m_matrices[n].worldMatrix);
@@ -268,6 +939,135 @@ bool CadScene::loadCSF(const char* filename, int clones, int cloneaxis)
     numObjects++;
   }
 
+  m_numBaseNodes      = csf->numNodes;
+  m_numBaseObjects    = numObjects;
+  m_numBaseGeometries = numGeoms;
+
+  std::vector<NodeTree::nodeID> baseParents(csf->numNodes, NodeTree::INVALID);
+  baseParents[csf->rootIDX] = NodeTree::ROOT;
+  for(int n = 0; n < csf->numNodes; n++)
+  {
+    for(uint32_t i = 0; i < csf->nodes[n].numChildren; i++)
+    {
+      baseParents[csf->nodes[n].children[i]] = (NodeTree::nodeID)n;
+    }
+  }
+
+  createClones(baseParents, clones, cloneaxis, config.threads);
+
+  if(m_doubleMatrices)
+  {
+    initMatricesDouble();
+  }
+
+  if(!m_cpuOnly)
+  {
+    createSceneBuffers();
+  }
+
+  m_copyObjects  = numObjects;
+  m_readyObjects = config.progressive ? 0 : numObjects;
+
+  // the scene cache still needs the per-object vectors
+  bool flatAfterCache = config.flatObjects && config.sceneCache && cacheKey && !config.progressive;
+  if(config.flatObjects && !flatAfterCache)
+  {
+    buildFlatObjects(true);
+  }
+
+  if(config.progressive)
+  {
+    m_progressive                = new ProgressiveLoad;
+    m_progressive->csf           = csf;
+    m_progressive->mem           = mem;
+    m_progressive->geometries    = csfGeometries;
+    m_progressive->config        = config;
+    m_progressive->sceneCopies   = sceneCopies;
+    m_progressive->numUploaded   = 0;
+    m_progressive->timeBegin     = getTimeMs();
+    m_progressive->geometryReady.resize(numGeoms, 0);
+
+    if(config.sceneCache && cacheKey)
+    {
+      LOGI("scene cache: not written for progressive loads\n");
+    }
+    return true;
+  }
+
+  CSFileMemory_delete(mem);
+
+  if(config.sceneCache && cacheKey)
+  {
+    if(saveCache(cacheFilename.c_str(), cacheKey, cacheContentHash))
+    {
+      LOGI("scene cache: saved %s\n", cacheFilename.c_str());
+    }
+    else
+    {
+      LOGW("scene cache: could not write %s\n", cacheFilename.c_str());
+    }
+  }
+
+  if(flatAfterCache)
+  {
+    buildFlatObjects(true);
+  }
+
+  return true;
+}
+
+void CadScene::createClones(const std::vector<NodeTree::nodeID>& baseParents, int clones, int cloneaxis, int threads)
+{
+  int copies = clones + 1;
+  // copies that are physically stored in the scene arrays
+  int sceneCopies = m_instancedClones ? 1 : copies;
+
+  int numNodes   = int(m_numBaseNodes);
+  int numObjects = int(m_numBaseObjects);
+  int numGeoms   = int(m_numBaseGeometries);
+
+  m_geometry.resize(numGeoms * sceneCopies);
+  m_geometryBboxes.resize(numGeoms * sceneCopies);
+  m_matrices.resize(numNodes * sceneCopies);
+  m_objects.resize(numObjects * sceneCopies);
+  m_objectAssigns.resize(numObjects * sceneCopies);
+
+  for(int c = 1; c < sceneCopies; c++)
+  {
+    for(int n = 0; n < numGeoms; n++)
+    {
+      m_geometryBboxes[n + numGeoms * c] = m_geometryBboxes[n];
+
+      const Geometry& geomorig = m_geometry[n];
+      Geometry&       geom     = m_geometry[n + numGeoms * c];
+
+      geom = geomorig;
+
+#if 1
+      geom.cloneIdx = n;
+#else
+      geom.cloneIdx = -1;
+      glCreateBuffers(1, &geom.vboGL);
+      glNamedBufferStorage(geom.vboGL, geom.vboSize, 0, 0);
+
+      glCreateBuffers(1, &geom.iboGL);
+      glNamedBufferStorage(geom.iboGL, geom.iboSize, 0, 0);
+
+      if(has_GL_NV_vertex_buffer_unified_memory)
+      {
+        glGetNamedBufferParameterui64vNV(geom.vboGL, GL_BUFFER_GPU_ADDRESS_NV, &geom.vboADDR);
+        glMakeNamedBufferResidentNV(geom.vboGL, GL_READ_ONLY);
+
+        glGetNamedBufferParameterui64vNV(geom.iboGL, GL_BUFFER_GPU_ADDRESS_NV, &geom.iboADDR);
+        glMakeNamedBufferResidentNV(geom.iboGL, GL_READ_ONLY);
+      }
+
+      glCopyNamedBufferSubData(geomorig.vboGL, geom.vboGL, 0, 0, geom.vboSize);
+      glCopyNamedBufferSubData(geomorig.iboGL, geom.iboGL, 0, 0, geom.iboSize);
+#endif
+    }
+  }
+
   // compute clone move delta based on m_bbox;
 
   glm::vec4 dim = m_bbox.max - m_bbox.min;
@@ -301,10 +1101,10 @@ bool CadScene::loadCSF(const char* filename, int clones, int cloneaxis)
   }
 
 
+  m_instanceMatrices.assign(m_instancedClones ? copies : 1, glm::mat4(1));
+
   for(int c = 1; c <= clones; c++)
   {
-    int numNodes = csf->numNodes;
-
     glm::vec4 shift = dim * 1.05f;
 
     float u = 0;
@@ -362,58 +1162,272 @@ bool CadScene::loadCSF(const char* filename, int clones, int cloneaxis)
       shift.z = 0;
     }
 
-    shift.w = 0;
+    shift.w = 0;
+
+    if(m_instancedClones)
+    {
+      // clones only differ by this world-space translation
+      m_instanceMatrices[c]    = glm::mat4(1);
+      m_instanceMatrices[c][3] = m_instanceMatrices[c][3] + shift;
+      continue;
+    }
+
+    // move all world matrices
+    for(int n = 0; n < numNodes; n++)
+    {
+      MatrixNode& node     = m_matrices[n + numNodes * c];
+      MatrixNode& nodeOrig = m_matrices[n];
+      node                 = nodeOrig;
+      node.worldMatrix[3]  = node.worldMatrix[3] + shift;
+    }
+
+    // patch object matrix of the roots
+    for(int n = 0; n < numNodes; n++)
+    {
+      if(baseParents[n] != NodeTree::ROOT)
+        continue;
+
+      MatrixNode& node     = m_matrices[n + numNodes * c];
+      node.objectMatrix[3] = node.objectMatrix[3] + shift;
+    }
+
+    // clone objects
+    for(int n = 0; n < numObjects; n++)
+    {
+      const Object& objectorig = m_objects[n];
+      Object&       object     = m_objects[n + numObjects * c];
+
+      object = objectorig;
+      object.geometryIndex += c * numGeoms;
+      object.matrixIndex += c * numNodes;
+      for(size_t i = 0; i < object.parts.size(); i++)
+      {
+        object.parts[i].matrixIndex += c * numNodes;
+      }
+      for(size_t i = 0; i < object.cacheSolid.state.size(); i++)
+      {
+        object.cacheSolid.state[i].matrixIndex += c * numNodes;
+      }
+      for(size_t i = 0; i < object.cacheWire.state.size(); i++)
+      {
+        object.cacheWire.state[i].matrixIndex += c * numNodes;
+      }
+
+      m_objectAssigns[n + numObjects * c] = glm::ivec2(object.matrixIndex, object.geometryIndex);
+    }
+  }
+
+  // inverse transposes of all nodes and clones in one pass
+  matrixBatchInverseTranspose(m_matrices.data(), m_matrices.size(), uint32_t(threads));
+
+  m_nodeTree.clear();
+  m_nodeTree.create(sceneCopies * numNodes);
+  for(int c = 0; c < sceneCopies; c++)
+  {
+    int cloneoffset = numNodes * c;
+    for(int n = 0; n < numNodes; n++)
+    {
+      if(baseParents[n] != NodeTree::ROOT && baseParents[n] != NodeTree::INVALID)
+      {
+        m_nodeTree.setNodeParent((NodeTree::nodeID)(n + cloneoffset), baseParents[n] + cloneoffset);
+      }
+    }
+    for(int n = 0; n < numNodes; n++)
+    {
+      if(baseParents[n] == NodeTree::ROOT)
+      {
+        m_nodeTree.setNodeParent((NodeTree::nodeID)(n + cloneoffset), m_nodeTree.getTreeRoot());
+        m_nodeTree.addToTree((NodeTree::nodeID)(n + cloneoffset));
+      }
+    }
+  }
+}
+
+size_t CadScene::loadProgressive(size_t budget)
+{
+  if(!m_progressive)
+    return m_readyObjects;
+
+  ProgressiveLoad&   load     = *m_progressive;
+  const LoadConfig&  config   = load.config;
+  int                numGeoms = int(load.geometries.size());
+
+  // geometries of the next objects, objects whose geometry is already
+  // uploaded become ready for free
+  std::vector<int> batch;
+  size_t           batchBytes = 0;
+  size_t           ready      = m_readyObjects;
+  for(; ready < m_copyObjects; ready++)
+  {
+    int             n    = m_objects[ready].geometryIndex;
+    const Geometry& geom = m_geometry[n];
+    if(load.geometryReady[n])
+      continue;
+
+    if(!batch.empty() && batchBytes + geom.vboSize + geom.iboSize > budget)
+      break;
+
+    load.geometryReady[n] = 1;
+    batch.push_back(n);
+    batchBytes += geom.vboSize + geom.iboSize;
+  }
+
+  std::vector<GeometryStaging> staging(batch.size());
+
+  auto fnConvert = [&](uint64_t i) {
+    int                   n = batch[i];
+    GeometryOptimizeStats unused;
+    convertGeometry(m_geometry[n], m_geometryBboxes[n], staging[i], load.geometries[n], config, unused);
+  };
+
+  if(config.threads > 1 && batch.size() > 1)
+  {
+    nvh::parallel_batches<1>(batch.size(), fnConvert, uint32_t(config.threads));
+  }
+  else
+  {
+    for(size_t i = 0; i < batch.size(); i++)
+    {
+      fnConvert(i);
+    }
+  }
+
+  for(size_t i = 0; i < batch.size(); i++)
+  {
+    int n = batch[i];
+    uploadGeometry(m_geometry[n], staging[i], config.arenaBuffers);
+    staging[i] = GeometryStaging();
 
-    // move all world matrices
-    for(int n = 0; n < numNodes; n++)
+    // clones were copied before the upload
+    for(int c = 1; c < load.sceneCopies; c++)
     {
-      MatrixNode& node     = m_matrices[n + numNodes * c];
-      MatrixNode& nodeOrig = m_matrices[n];
-      node                 = nodeOrig;
-      node.worldMatrix[3]  = node.worldMatrix[3] + shift;
-      node.worldMatrixIT   = glm::transpose(glm::inverse(node.worldMatrix));
+      Geometry& clone = m_geometry[n + numGeoms * c];
+      clone.vboGL     = m_geometry[n].vboGL;
+      clone.iboGL     = m_geometry[n].iboGL;
+      clone.vboADDR   = m_geometry[n].vboADDR;
+      clone.iboADDR   = m_geometry[n].iboADDR;
     }
+  }
+
+  load.numUploaded += int(batch.size());
+  m_readyObjects = ready;
+
+  if(m_readyObjects == m_copyObjects)
+  {
+    LOGI("progressive load: %d geometries in %8.2f ms\n", load.numUploaded, getTimeMs() - load.timeBegin);
+    finishProgressive();
+  }
+
+  return m_readyObjects;
+}
+
+void CadScene::finishProgressive()
+{
+  if(!m_progressive)
+    return;
+
+  CSFileMemory_delete(m_progressive->mem);
+  delete m_progressive;
+  m_progressive = nullptr;
+}
+
+void CadScene::createArenaBuffers(size_t vboSize, size_t iboSize)
+{
+  m_arenaVboSize = vboSize;
+  m_arenaIboSize = iboSize;
+
+  if(m_cpuOnly)
+    return;
+
+  glCreateBuffers(1, &m_arenaVboGL);
+  glNamedBufferStorage(m_arenaVboGL, vboSize, nullptr, GL_DYNAMIC_STORAGE_BIT);
+
+  glCreateBuffers(1, &m_arenaIboGL);
+  glNamedBufferStorage(m_arenaIboGL, iboSize, nullptr, GL_DYNAMIC_STORAGE_BIT);
+
+  if(has_GL_NV_vertex_buffer_unified_memory)
+  {
+    glGetNamedBufferParameterui64vNV(m_arenaVboGL, GL_BUFFER_GPU_ADDRESS_NV, &m_arenaVboADDR);
+    glMakeNamedBufferResidentNV(m_arenaVboGL, GL_READ_ONLY);
+
+    glGetNamedBufferParameterui64vNV(m_arenaIboGL, GL_BUFFER_GPU_ADDRESS_NV, &m_arenaIboADDR);
+    glMakeNamedBufferResidentNV(m_arenaIboGL, GL_READ_ONLY);
+  }
+}
 
+static void packMatricesCompact(std::vector<CadScene::MatrixCompact>& compact, const CadScene::MatrixNode* matrices, size_t count)
+{
+  compact.resize(count);
+  for(size_t i = 0; i < count; i++)
+  {
+    // glm is column-major, rows of the upper 3x4 are strided
+    const glm::mat4& world = matrices[i].worldMatrix;
+    for(int r = 0; r < 3; r++)
     {
-      // patch object matrix of root
-      MatrixNode& node     = m_matrices[csf->rootIDX + numNodes * c];
-      node.objectMatrix[3] = node.objectMatrix[3] + shift;
-      node.objectMatrixIT  = glm::transpose(glm::inverse(node.objectMatrix));
+      compact[i].rows[r] = glm::vec4(world[0][r], world[1][r], world[2][r], world[3][r]);
     }
+  }
+}
 
-    // clone objects
-    for(int n = 0; n < numObjects; n++)
-    {
-      const Object& objectorig = m_objects[n];
-      Object&       object     = m_objects[n + numObjects * c];
+void CadScene::createSceneBuffers()
+{
+  glCreateBuffers(1, &m_materialsGL);
+  glNamedBufferStorage(m_materialsGL, sizeof(Material) * m_materials.size(), &m_materials[0], 0);
 
-      object = objectorig;
-      object.geometryIndex += c * numGeoms;
-      object.matrixIndex += c * numNodes;
-      for(size_t i = 0; i < object.parts.size(); i++)
-      {
-        object.parts[i].matrixIndex += c * numNodes;
-      }
-      for(size_t i = 0; i < object.cacheSolid.state.size(); i++)
-      {
-        object.cacheSolid.state[i].matrixIndex += c * numNodes;
-      }
-      for(size_t i = 0; i < object.cacheWire.state.size(); i++)
+  m_materialsCompactGL = 0;
+  if(m_compactMaterials)
+  {
+    auto fnPack = [](const glm::vec4& a, const glm::vec4& b) {
+      return glm::uvec4(glm::packHalf2x16(glm::vec2(a.x, a.y)), glm::packHalf2x16(glm::vec2(a.z, a.w)),
+                        glm::packHalf2x16(glm::vec2(b.x, b.y)), glm::packHalf2x16(glm::vec2(b.z, b.w)));
+    };
+
+    std::vector<MaterialCompact> compact(m_materials.size());
+    for(size_t i = 0; i < m_materials.size(); i++)
+    {
+      for(int s = 0; s < 2; s++)
       {
-        object.cacheWire.state[i].matrixIndex += c * numNodes;
+        const MaterialSide& side = m_materials[i].sides[s];
+        compact[i].sides[s][0]   = fnPack(side.ambient, side.diffuse);
+        compact[i].sides[s][1]   = fnPack(side.specular, side.emissive);
       }
-
-      m_objectAssigns[n + numObjects * c] = glm::ivec2(object.matrixIndex, object.geometryIndex);
     }
+
+    glCreateBuffers(1, &m_materialsCompactGL);
+    glNamedBufferStorage(m_materialsCompactGL, sizeof(MaterialCompact) * compact.size(), compact.data(), 0);
   }
+  //glMapNamedBufferRange(m_materialsGL, 0, sizeof(Material) * m_materials.size(), GL_MAP_PERSISTENT_BIT | GL_MAP_WRITE_BIT);
+
+  glCreateBuffers(1, &m_geometryBboxesGL);
+  glNamedBufferStorage(m_geometryBboxesGL, sizeof(BBox) * m_geometryBboxes.size(), &m_geometryBboxes[0], 0);
+  glCreateTextures(GL_TEXTURE_BUFFER, 1, &m_geometryBboxesTexGL);
+  glTextureBuffer(m_geometryBboxesTexGL, GL_RGBA32F, m_geometryBboxesGL);
+
+  // relative matrices are re-uploaded whenever the render origin moves
+  GLbitfield matricesFlags = m_doubleMatrices ? GL_DYNAMIC_STORAGE_BIT : 0;
 
   glCreateBuffers(1, &m_matricesGL);
-  glNamedBufferStorage(m_matricesGL, sizeof(MatrixNode) * m_matrices.size(), &m_matrices[0], 0);
+  glNamedBufferStorage(m_matricesGL, sizeof(MatrixNode) * m_matrices.size(), &m_matrices[0], matricesFlags);
   //glMapNamedBufferRange(m_matricesGL, 0, sizeof(MatrixNode) * m_matrices.size(), GL_MAP_PERSISTENT_BIT | GL_MAP_WRITE_BIT);
 
   glCreateTextures(GL_TEXTURE_BUFFER, 1, &m_matricesTexGL);
   glTextureBuffer(m_matricesTexGL, GL_RGBA32F, m_matricesGL);
 
+  m_matricesCompactGL        = 0;
+  m_matricesCompactTexGL     = 0;
+  m_matricesCompactTexGLADDR = 0;
+  if(m_compactMatrices)
+  {
+    std::vector<MatrixCompact> compact;
+    packMatricesCompact(compact, m_matrices.data(), m_matrices.size());
+
+    // dynamic so resetMatrices can restore it without a second original copy
+    glCreateBuffers(1, &m_matricesCompactGL);
+    glNamedBufferStorage(m_matricesCompactGL, sizeof(MatrixCompact) * compact.size(), compact.data(), GL_DYNAMIC_STORAGE_BIT);
+    glCreateTextures(GL_TEXTURE_BUFFER, 1, &m_matricesCompactTexGL);
+    glTextureBuffer(m_matricesCompactTexGL, GL_RGBA32F, m_matricesCompactGL);
+  }
+
   glCreateBuffers(1, &m_objectAssignsGL);
   glNamedBufferStorage(m_objectAssignsGL, sizeof(glm::ivec2) * m_objectAssigns.size(), &m_objectAssigns[0], 0);
 
@@ -425,35 +1439,40 @@ bool CadScene::loadCSF(const char* filename, int clones, int cloneaxis)
     glGetNamedBufferParameterui64vNV(m_matricesGL, GL_BUFFER_GPU_ADDRESS_NV, &m_matricesADDR);
     glMakeNamedBufferResidentNV(m_matricesGL, GL_READ_ONLY);
 
+    glGetNamedBufferParameterui64vNV(m_geometryBboxesGL, GL_BUFFER_GPU_ADDRESS_NV, &m_geometryBboxesADDR);
+    glMakeNamedBufferResidentNV(m_geometryBboxesGL, GL_READ_ONLY);
+
     if(has_GL_ARB_bindless_texture)
     {
       m_matricesTexGLADDR = glGetTextureHandleARB(m_matricesTexGL);
       glMakeTextureHandleResidentARB(m_matricesTexGLADDR);
+      if(m_matricesCompactTexGL)
+      {
+        m_matricesCompactTexGLADDR = glGetTextureHandleARB(m_matricesCompactTexGL);
+        glMakeTextureHandleResidentARB(m_matricesCompactTexGLADDR);
+      }
     }
   }
 
-  m_nodeTree.create(copies * csf->numNodes);
-  for(int i = 0; i < copies; i++)
-  {
-    int cloneoffset = (csf->numNodes) * i;
-    int root        = csf->rootIDX + cloneoffset;
-    recursiveHierarchy(m_nodeTree, csf, csf->rootIDX, cloneoffset);
-
-    m_nodeTree.setNodeParent((NodeTree::nodeID)root, m_nodeTree.getTreeRoot());
-    m_nodeTree.addToTree((NodeTree::nodeID)root);
-  }
-
   glCreateBuffers(1, &m_parentIDsGL);
   glNamedBufferStorage(m_parentIDsGL, m_nodeTree.getTreeCompactNodes().size() * sizeof(GLuint),
                        &m_nodeTree.getTreeCompactNodes()[0], 0);
 
   glCreateBuffers(1, &m_matricesOrigGL);
-  glNamedBufferStorage(m_matricesOrigGL, sizeof(MatrixNode) * m_matrices.size(), &m_matrices[0], 0);
+  glNamedBufferStorage(m_matricesOrigGL, sizeof(MatrixNode) * m_matrices.size(), &m_matrices[0], matricesFlags);
   glCreateTextures(GL_TEXTURE_BUFFER, 1, &m_matricesOrigTexGL);
   glTextureBuffer(m_matricesOrigTexGL, GL_RGBA32F, m_matricesOrigGL);
 
-  CSFileMemory_delete(mem);
-  return true;
+  glCreateBuffers(1, &m_instancesGL);
+  glNamedBufferStorage(m_instancesGL, sizeof(glm::mat4) * m_instanceMatrices.size(), &m_instanceMatrices[0], 0);
+  glCreateTextures(GL_TEXTURE_BUFFER, 1, &m_instancesTexGL);
+  glTextureBuffer(m_instancesTexGL, GL_RGBA32F, m_instancesGL);
+
+  if(has_GL_NV_vertex_buffer_unified_memory && has_GL_ARB_bindless_texture)
+  {
+    m_instancesTexGLADDR = glGetTextureHandleARB(m_instancesTexGL);
+    glMakeTextureHandleResidentARB(m_instancesTexGLADDR);
+  }
 }
 
 
@@ -473,7 +1492,7 @@ static bool ListItem_compare(const ListItem& a, const ListItem& b)
   return diff < 0;
 }
 
-static void fillCache(CadScene::DrawRangeCache& cache, const std::vector<ListItem>& list)
+static void fillCache(CadScene::DrawRangeCache& cache, const std::vector<ListItem>& list, size_t indexSize)
 {
   cache = CadScene::DrawRangeCache();
 
@@ -515,7 +1534,7 @@ static void fillCache(CadScene::DrawRangeCache& cache, const std::vector<ListIte
     }
 
     const CadScene::DrawRange& currange = list[i].range;
-    if(newrange || (USE_CACHECOMBINE && currange.offset == (range.offset + sizeof(GLuint) * range.count)))
+    if(newrange || (USE_CACHECOMBINE && currange.offset == (range.offset + indexSize * range.count)))
     {
       // merge
       range.count += currange.count;
@@ -532,10 +1551,12 @@ static void fillCache(CadScene::DrawRangeCache& cache, const std::vector<ListIte
   }
 }
 
-void CadScene::updateObjectDrawCache(Object& object)
+// thread-safe, parts must match geom.parts
+static void buildDrawCaches(CadScene::DrawRangeCache&       cacheSolid,
+                            CadScene::DrawRangeCache&       cacheWire,
+                            const CadScene::ObjectPart*     parts,
+                            const CadScene::Geometry&       geom)
 {
-  Geometry& geom = m_geometry[object.geometryIndex];
-
   std::vector<ListItem> listSolid;
   std::vector<ListItem> listWire;
 
@@ -544,79 +1565,290 @@ void CadScene::updateObjectDrawCache(Object& object)
 
   for(size_t i = 0; i < geom.parts.size(); i++)
   {
-    if(!object.parts[i].active)
+    if(!parts[i].active)
       continue;
 
     ListItem item;
-    item.state.materialIndex = object.parts[i].materialIndex;
+    item.state.materialIndex = parts[i].materialIndex;
 
     item.range             = geom.parts[i].indexSolid;
-    item.state.matrixIndex = object.parts[i].matrixIndex;
+    item.state.matrixIndex = parts[i].matrixIndex;
     listSolid.push_back(item);
 
     item.range             = geom.parts[i].indexWire;
-    item.state.matrixIndex = object.parts[i].matrixIndex;
+    item.state.matrixIndex = parts[i].matrixIndex;
     listWire.push_back(item);
   }
 
   std::sort(listSolid.begin(), listSolid.end(), ListItem_compare);
   std::sort(listWire.begin(), listWire.end(), ListItem_compare);
 
-  fillCache(object.cacheSolid, listSolid);
-  fillCache(object.cacheWire, listWire);
+  fillCache(cacheSolid, listSolid, geom.getIndexSize());
+  fillCache(cacheWire, listWire, geom.getIndexSize());
+}
+
+void CadScene::updateObjectDrawCache(Object& object)
+{
+  buildDrawCaches(object.cacheSolid, object.cacheWire, object.parts.data(), m_geometry[object.geometryIndex]);
+}
+
+size_t CadScene::getNumParts(size_t objectIndex) const
+{
+  return m_flatObjects.empty() ? m_objects[objectIndex].parts.size() : m_flatObjects.objects[objectIndex].numParts;
+}
+
+bool CadScene::isPartActive(size_t objectIndex, size_t partIndex) const
+{
+  if(!m_flatObjects.empty())
+  {
+    return !!m_flatObjects.parts[m_flatObjects.objects[objectIndex].partsBegin + partIndex].active;
+  }
+  return !!m_objects[objectIndex].parts[partIndex].active;
+}
+
+void CadScene::setPartActive(size_t objectIndex, size_t partIndex, bool active)
+{
+  ObjectPart& part = m_flatObjects.empty() ? m_objects[objectIndex].parts[partIndex] :
+                                             m_flatObjects.parts[m_flatObjects.objects[objectIndex].partsBegin + partIndex];
+  if(!!part.active == active)
+    return;
+
+  part.active = active ? 1 : 0;
+
+  if(m_objectDirty.size() != m_objects.size())
+  {
+    m_objectDirty.resize(m_objects.size(), 0);
+  }
+  if(!m_objectDirty[objectIndex])
+  {
+    m_objectDirty[objectIndex] = 1;
+    m_dirtyObjects.push_back(uint32_t(objectIndex));
+  }
+}
+
+void CadScene::updateDirtyObjects(std::vector<uint32_t>& dirty, int threads)
+{
+  dirty.swap(m_dirtyObjects);
+  m_dirtyObjects.clear();
+  std::sort(dirty.begin(), dirty.end());
+
+  // every object only touches its own caches or its own flat ranges
+  auto fnUpdate = [&](uint64_t i) {
+    uint32_t idx = dirty[i];
+    m_objectDirty[idx] = 0;
+
+    if(m_flatObjects.empty())
+    {
+      updateObjectDrawCache(m_objects[idx]);
+      return;
+    }
+
+    FlatObject&    fobj = m_flatObjects.objects[idx];
+    DrawRangeCache cacheSolid;
+    DrawRangeCache cacheWire;
+    buildDrawCaches(cacheSolid, cacheWire, m_flatObjects.parts.data() + fobj.partsBegin, m_geometry[fobj.geometryIndex]);
+    writeFlatDrawRanges(fobj.solid, cacheSolid);
+    writeFlatDrawRanges(fobj.wire, cacheWire);
+  };
+
+  if(threads > 1 && dirty.size() > 64)
+  {
+    nvh::parallel_batches<64>(dirty.size(), fnUpdate, uint32_t(threads));
+  }
+  else
+  {
+    for(size_t i = 0; i < dirty.size(); i++)
+    {
+      fnUpdate(i);
+    }
+  }
+}
+
+void CadScene::writeFlatDrawRanges(FlatDrawRanges& ranges, const DrawRangeCache& cache)
+{
+  // the regions were sized for all parts, a cache never holds more
+  assert(cache.state.size() <= ranges.capacity && cache.offsets.size() <= ranges.capacity);
+
+  ranges.numStates = uint32_t(cache.state.size());
+  ranges.numRanges = uint32_t(cache.offsets.size());
+  std::copy(cache.state.begin(), cache.state.end(), m_flatObjects.states.begin() + ranges.stateBegin);
+  std::copy(cache.stateCount.begin(), cache.stateCount.end(), m_flatObjects.stateCounts.begin() + ranges.stateBegin);
+  std::copy(cache.offsets.begin(), cache.offsets.end(), m_flatObjects.offsets.begin() + ranges.rangeBegin);
+  std::copy(cache.counts.begin(), cache.counts.end(), m_flatObjects.counts.begin() + ranges.rangeBegin);
+}
+
+void CadScene::buildFlatObjects(bool releaseObjects)
+{
+  m_flatObjects.clear();
+
+  // every cache region is sized for all parts of its object, so
+  // visibility changes can rebuild it in place
+  size_t numParts = 0;
+  for(const Object& object : m_objects)
+  {
+    numParts += object.parts.size();
+  }
+  size_t numStates = numParts * 2;
+  size_t numRanges = numParts * 2;
+
+  FlatObjects& flat = m_flatObjects;
+  flat.objects.resize(m_objects.size());
+  flat.parts.reserve(numParts);
+  flat.states.reserve(numStates);
+  flat.stateCounts.reserve(numStates);
+  flat.offsets.reserve(numRanges);
+  flat.counts.reserve(numRanges);
+
+  auto fnAppend = [&](const DrawRangeCache& cache, size_t capacity) {
+    FlatDrawRanges ranges;
+    ranges.stateBegin = uint32_t(flat.states.size());
+    ranges.numStates  = uint32_t(cache.state.size());
+    ranges.rangeBegin = uint32_t(flat.offsets.size());
+    ranges.numRanges  = uint32_t(cache.offsets.size());
+    ranges.capacity   = uint32_t(std::max(capacity, std::max(cache.state.size(), cache.offsets.size())));
+
+    flat.states.insert(flat.states.end(), cache.state.begin(), cache.state.end());
+    flat.stateCounts.insert(flat.stateCounts.end(), cache.stateCount.begin(), cache.stateCount.end());
+    flat.offsets.insert(flat.offsets.end(), cache.offsets.begin(), cache.offsets.end());
+    flat.counts.insert(flat.counts.end(), cache.counts.begin(), cache.counts.end());
+
+    flat.states.resize(ranges.stateBegin + ranges.capacity);
+    flat.stateCounts.resize(ranges.stateBegin + ranges.capacity, 0);
+    flat.offsets.resize(ranges.rangeBegin + ranges.capacity, 0);
+    flat.counts.resize(ranges.rangeBegin + ranges.capacity, 0);
+    return ranges;
+  };
+
+  for(size_t i = 0; i < m_objects.size(); i++)
+  {
+    Object&     object     = m_objects[i];
+    FlatObject& flatObject = flat.objects[i];
+
+    flatObject.matrixIndex   = object.matrixIndex;
+    flatObject.geometryIndex = object.geometryIndex;
+    flatObject.partsBegin    = uint32_t(flat.parts.size());
+    flatObject.numParts      = uint32_t(object.parts.size());
+    flat.parts.insert(flat.parts.end(), object.parts.begin(), object.parts.end());
+
+    flatObject.solid = fnAppend(object.cacheSolid, object.parts.size());
+    flatObject.wire  = fnAppend(object.cacheWire, object.parts.size());
+
+    if(releaseObjects)
+    {
+      object.parts      = std::vector<ObjectPart>();
+      object.cacheSolid = DrawRangeCache();
+      object.cacheWire  = DrawRangeCache();
+    }
+  }
 }
 
-void CadScene::enableVertexFormat(int attrPos, int attrNormal)
+void CadScene::enableVertexFormat(int attrPos, int attrNormal, int attrBboxMin, int attrBboxMax) const
 {
-  glVertexAttribFormat(attrPos, 3, GL_FLOAT, GL_FALSE, 0);
-  glVertexAttribFormat(attrNormal, 3, GL_FLOAT, GL_FALSE, offsetof(CadScene::Vertex, normal));
+  if(m_compactVertices)
+  {
+    glVertexAttribFormat(attrPos, 3, GL_UNSIGNED_SHORT, GL_TRUE, 0);
+    glVertexAttribFormat(attrNormal, 2, GL_SHORT, GL_TRUE, offsetof(CadScene::VertexCompact, normal));
+
+    // the geometry bbox is sourced per draw with stride 0
+    glVertexAttribFormat(attrBboxMin, 3, GL_FLOAT, GL_FALSE, offsetof(CadScene::BBox, min));
+    glVertexAttribFormat(attrBboxMax, 3, GL_FLOAT, GL_FALSE, offsetof(CadScene::BBox, max));
+    glVertexAttribBinding(attrBboxMin, VERTEX_BBOX_BINDING);
+    glVertexAttribBinding(attrBboxMax, VERTEX_BBOX_BINDING);
+    glEnableVertexAttribArray(attrBboxMin);
+    glEnableVertexAttribArray(attrBboxMax);
+    glBindVertexBuffer(VERTEX_BBOX_BINDING, 0, 0, 0);
+  }
+  else
+  {
+    glVertexAttribFormat(attrPos, 3, GL_FLOAT, GL_FALSE, 0);
+    glVertexAttribFormat(attrNormal, 3, GL_FLOAT, GL_FALSE, offsetof(CadScene::Vertex, normal));
+  }
   glVertexAttribBinding(attrPos, 0);
   glVertexAttribBinding(attrNormal, 0);
   glEnableVertexAttribArray(attrPos);
   glEnableVertexAttribArray(attrNormal);
-  glBindVertexBuffer(0, 0, 0, sizeof(CadScene::Vertex));
+  glBindVertexBuffer(0, 0, 0, GLsizei(getVertexSize()));
 }
 
-void CadScene::disableVertexFormat(int attrPos, int attrNormal)
+void CadScene::disableVertexFormat(int attrPos, int attrNormal, int attrBboxMin, int attrBboxMax) const
 {
   glDisableVertexAttribArray(attrPos);
   glDisableVertexAttribArray(attrNormal);
-  glBindVertexBuffer(0, 0, 0, sizeof(CadScene::Vertex));
+  glBindVertexBuffer(0, 0, 0, GLsizei(getVertexSize()));
+  if(m_compactVertices)
+  {
+    glDisableVertexAttribArray(attrBboxMin);
+    glDisableVertexAttribArray(attrBboxMax);
+    glBindVertexBuffer(VERTEX_BBOX_BINDING, 0, 0, 0);
+  }
 }
 
-void CadScene::unload()
+void CadScene::destroySceneBuffers()
 {
-  if(m_geometry.empty())
-    return;
-
-  glFinish();
-
   if(has_GL_NV_vertex_buffer_unified_memory)
   {
     if(has_GL_ARB_bindless_texture)
     {
       glMakeTextureHandleNonResidentARB(m_matricesTexGLADDR);
+      glMakeTextureHandleNonResidentARB(m_instancesTexGLADDR);
+      if(m_matricesCompactTexGLADDR)
+      {
+        glMakeTextureHandleNonResidentARB(m_matricesCompactTexGLADDR);
+      }
     }
 
     glMakeNamedBufferNonResidentNV(m_matricesGL);
     glMakeNamedBufferNonResidentNV(m_materialsGL);
+    glMakeNamedBufferNonResidentNV(m_geometryBboxesGL);
   }
 
   glDeleteTextures(1, &m_matricesOrigTexGL);
   glDeleteTextures(1, &m_matricesTexGL);
+  glDeleteTextures(1, &m_matricesCompactTexGL);
   glDeleteTextures(1, &m_geometryBboxesTexGL);
+  glDeleteTextures(1, &m_instancesTexGL);
 
   glDeleteBuffers(1, &m_matricesOrigGL);
   glDeleteBuffers(1, &m_matricesGL);
+  glDeleteBuffers(1, &m_matricesCompactGL);
   glDeleteBuffers(1, &m_materialsGL);
+  glDeleteBuffers(1, &m_materialsCompactGL);
   glDeleteBuffers(1, &m_objectAssignsGL);
   glDeleteBuffers(1, &m_geometryBboxesGL);
   glDeleteBuffers(1, &m_parentIDsGL);
+  glDeleteBuffers(1, &m_instancesGL);
+}
+
+void CadScene::unload()
+{
+  finishProgressive();
+  m_readyObjects = 0;
+  m_copyObjects  = 0;
+
+  if(m_geometry.empty())
+    return;
+
+  if(!m_cpuOnly)
+  {
+    glFinish();
+    destroySceneBuffers();
+  }
 
+  if(m_arenaVboGL)
+  {
+    if(has_GL_NV_vertex_buffer_unified_memory)
+    {
+      glMakeNamedBufferNonResidentNV(m_arenaIboGL);
+      glMakeNamedBufferNonResidentNV(m_arenaVboGL);
+    }
+    glDeleteBuffers(1, &m_arenaIboGL);
+    glDeleteBuffers(1, &m_arenaVboGL);
+  }
 
-  for(size_t i = 0; i < m_geometry.size(); i++)
+  for(size_t i = 0; i < m_geometry.size() && !m_arenaVboGL && !m_cpuOnly; i++)
   {
-    if(m_geometry[i].cloneIdx >= 0)
+    // geometries of an unfinished progressive load have no buffers yet
+    if(m_geometry[i].cloneIdx >= 0 || !m_geometry[i].vboGL)
       continue;
 
     if(has_GL_NV_vertex_buffer_unified_memory)
@@ -628,18 +1860,226 @@ void CadScene::unload()
     glDeleteBuffers(1, &m_geometry[i].vboGL);
   }
 
+  m_arenaIboGL = 0;
+  m_arenaVboGL = 0;
+
   m_matrices.clear();
   m_geometryBboxes.clear();
   m_geometry.clear();
   m_objectAssigns.clear();
   m_objects.clear();
+  m_flatObjects.clear();
+  m_objectDirty.clear();
+  m_dirtyObjects.clear();
+  m_matricesDouble.clear();
+  m_matrixDirty.clear();
+  m_dirtyMatrices.clear();
   m_geometryBboxes.clear();
+  m_instanceMatrices.clear();
   m_nodeTree.clear();
 
+  if(!m_cpuOnly)
+  {
+    glFinish();
+  }
+  m_cpuOnly = false;
+}
+
+bool CadScene::reclone(int clones, int cloneaxis, int threads)
+{
+  // flat objects released the per-object vectors the clones are copied from
+  if(m_geometry.empty() || isLoading() || !m_flatObjects.empty())
+    return false;
+
+  double timeBegin = getTimeMs();
+
+  // apply pending part toggles first, so the clones are copied from the
+  // updated draw caches. The renderers are re-initialized after a reclone
+  // and do not need the list.
+  std::vector<uint32_t> dirty;
+  updateDirtyObjects(dirty, threads);
+
+  int numNodes = int(m_numBaseNodes);
+
+  if(m_doubleMatrices)
+  {
+    // the float world matrices are relative to the current render origin
+    for(int n = 0; n < numNodes; n++)
+    {
+      m_matrices[n].worldMatrix = glm::mat4(m_matricesDouble[n]);
+    }
+  }
+
+  std::vector<NodeTree::nodeID> baseParents(numNodes);
+  for(int n = 0; n < numNodes; n++)
+  {
+    baseParents[n] = m_nodeTree.getParentNode((NodeTree::nodeID)n);
+  }
+
   glFinish();
+
+  destroySceneBuffers();
+
+  // the original copy stays, clones get regenerated from it
+  m_geometry.resize(m_numBaseGeometries);
+  m_geometryBboxes.resize(m_numBaseGeometries);
+  m_matrices.resize(m_numBaseNodes);
+  m_objects.resize(m_numBaseObjects);
+  m_objectAssigns.resize(m_numBaseObjects);
+  m_objectDirty.clear();
+  m_dirtyObjects.clear();
+
+  createClones(baseParents, clones, cloneaxis, threads);
+
+  if(m_doubleMatrices)
+  {
+    initMatricesDouble();
+  }
+
+  createSceneBuffers();
+
+  m_copyObjects  = m_numBaseObjects;
+  m_readyObjects = m_numBaseObjects;
+
+  LOGI("reclone: %d clones, %d nodes, %d objects in %8.2f ms\n", clones, (uint32_t)m_matrices.size(),
+       (uint32_t)m_objects.size(), getTimeMs() - timeBegin);
+
+  return true;
 }
 
 void CadScene::resetMatrices()
 {
   glCopyNamedBufferSubData(m_matricesOrigGL, m_matricesGL, 0, 0, sizeof(CadScene::MatrixNode) * m_matrices.size());
+
+  if(m_matricesCompactGL)
+  {
+    std::vector<MatrixCompact> compact;
+    packMatricesCompact(compact, m_matrices.data(), m_matrices.size());
+    glNamedBufferSubData(m_matricesCompactGL, 0, sizeof(MatrixCompact) * compact.size(), compact.data());
+  }
+}
+
+void CadScene::initMatricesDouble()
+{
+  m_matricesDouble.resize(m_matrices.size());
+  m_matrixDirty.assign(m_matrices.size(), 0);
+  m_dirtyMatrices.clear();
+  m_renderOrigin      = glm::dvec3(0);
+  m_renderOriginValid = false;
+
+  for(size_t i = 0; i < m_matrices.size(); i++)
+  {
+    m_matricesDouble[i] = glm::dmat4(m_matrices[i].worldMatrix);
+  }
+
+  // recompose the hierarchy top-down from the object matrices,
+  // deep chains do not accumulate the float error of the stored world matrices
+  for(int l = 1; l < m_nodeTree.getNumUsedLevel(); l++)
+  {
+    const NodeTree::Level* level = m_nodeTree.getUsedLevel(l);
+    for(size_t i = 0; i < level->nodes.size(); i++)
+    {
+      NodeTree::nodeID node   = level->nodes[i];
+      NodeTree::nodeID parent = m_nodeTree.getParentNode(node);
+      m_matricesDouble[node]  = m_matricesDouble[parent] * glm::dmat4(m_matrices[node].objectMatrix);
+    }
+  }
+}
+
+void CadScene::setWorldMatrixDouble(size_t nodeIndex, const glm::dmat4& world)
+{
+  m_matricesDouble[nodeIndex] = world;
+  if(!m_matrixDirty[nodeIndex])
+  {
+    m_matrixDirty[nodeIndex] = 1;
+    m_dirtyMatrices.push_back(uint32_t(nodeIndex));
+  }
+}
+
+size_t CadScene::updateRelativeMatrices(const glm::dvec3& eye, double rebaseDistance, int threads)
+{
+  if(!m_doubleMatrices)
+    return 0;
+
+  glm::dvec3 delta  = eye - m_renderOrigin;
+  bool       rebase = !m_renderOriginValid || glm::dot(delta, delta) > rebaseDistance * rebaseDistance;
+  if(!rebase && m_dirtyMatrices.empty())
+    return 0;
+
+  if(rebase)
+  {
+    m_renderOrigin      = eye;
+    m_renderOriginValid = true;
+
+    m_dirtyMatrices.resize(m_matrices.size());
+    for(size_t i = 0; i < m_matrices.size(); i++)
+    {
+      m_dirtyMatrices[i] = uint32_t(i);
+    }
+  }
+  else
+  {
+    std::sort(m_dirtyMatrices.begin(), m_dirtyMatrices.end());
+  }
+
+  // translation is removed in double, what remains fits float precision,
+  // so the inverse transpose is done on the relative float matrices
+  auto fnUpdate = [&](uint64_t i) {
+    uint32_t   idx   = m_dirtyMatrices[i];
+    glm::dmat4 world = m_matricesDouble[idx];
+    world[3]         = world[3] - glm::dvec4(m_renderOrigin, 0.0);
+
+    m_matrixDirty[idx]          = 0;
+    m_matrices[idx].worldMatrix = glm::mat4(world);
+  };
+
+  size_t count = m_dirtyMatrices.size();
+  if(threads > 1 && count > 1024)
+  {
+    nvh::parallel_batches<256>(count, fnUpdate, uint32_t(threads));
+  }
+  else
+  {
+    for(size_t i = 0; i < count; i++)
+    {
+      fnUpdate(i);
+    }
+  }
+  matrixBatchWorldInverseTranspose(m_matrices.data(), m_dirtyMatrices.data(), count, uint32_t(threads));
+
+  uploadMatrices(m_dirtyMatrices);
+  m_dirtyMatrices.clear();
+
+  return count;
+}
+
+void CadScene::uploadMatrices(const std::vector<uint32_t>& sortedNodes)
+{
+  std::vector<MatrixCompact> compact;
+
+  // one upload per run of consecutive nodes, a rebase is a single run.
+  // The original copy is the source of xplode and resetMatrices.
+  for(size_t i = 0; i < sortedNodes.size();)
+  {
+    size_t begin = i++;
+    while(i < sortedNodes.size() && sortedNodes[i] == sortedNodes[i - 1] + 1)
+    {
+      i++;
+    }
+
+    size_t     first  = sortedNodes[begin];
+    size_t     count  = i - begin;
+    GLintptr   offset = GLintptr(sizeof(MatrixNode) * first);
+    GLsizeiptr size   = GLsizeiptr(sizeof(MatrixNode) * count);
+
+    glNamedBufferSubData(m_matricesGL, offset, size, &m_matrices[first]);
+    glNamedBufferSubData(m_matricesOrigGL, offset, size, &m_matrices[first]);
+
+    if(m_matricesCompactGL)
+    {
+      packMatricesCompact(compact, &m_matrices[first], count);
+      glNamedBufferSubData(m_matricesCompactGL, GLintptr(sizeof(MatrixCompact) * first),
+                           GLsizeiptr(sizeof(MatrixCompact) * count), compact.data());
+    }
+  }
 }
@@ -104,6 +104,12 @@ public:
     }
   };
 
+  // 64 byte alternative for the indexed shaders (USE_COMPACTMATERIAL),
+  // per side ambient, diffuse | specular, emissive as packHalf2x16 pairs
+  struct MaterialCompact {
+    glm::uvec4    sides[2][2];
+  };
+
   // need to keep this 256 byte aligned (UBO range)
   struct MatrixNode {
     glm::mat4  worldMatrix;
@@ -112,11 +118,29 @@ public:
     glm::mat4  objectMatrixIT;
   };
 
+  // 48 byte alternative for the indexed shaders (USE_COMPACTMATRIX),
+  // the rows of the affine world matrix, the normal matrix is derived
+  // from the upper 3x3 in the vertex shader
+  struct MatrixCompact {
+    glm::vec4  rows[3];
+  };
+
   struct Vertex {
     glm::vec4 position;
     glm::vec4 normal;
   };
 
+  // optional compact layout, position is unorm16 relative
+  // to the geometry bbox, normal is octahedron encoded snorm16
+  struct VertexCompact {
+    uint16_t  position[4];
+    int16_t   normal[2];
+  };
+
+  // vertex buffer binding that sources the geometry bbox
+  // for the compact vertex format (stride 0)
+  static const GLuint VERTEX_BBOX_BINDING = 2;
+
   struct DrawRange {
     size_t        offset;
     int           count;
@@ -158,6 +182,16 @@ public:
     size_t    vboSize;
     size_t    iboSize;
 
+    // placement within vboGL/iboGL, only non-zero when all
+    // geometries are sub-allocated from the arena buffers
+    GLint     baseVertex;
+    size_t    vboOffset;
+    size_t    iboOffset;
+
+    // GL_UNSIGNED_SHORT if all vertices are addressable with 16 bit
+    // and LoadConfig::shortIndices was set, GL_UNSIGNED_INT otherwise
+    GLenum    indexType;
+
     std::vector<GeometryPart> parts;
 
     int       numVertices;
@@ -165,6 +199,10 @@ public:
     int       numIndexWire;
     
     int       cloneIdx;
+
+    size_t getIndexSize() const { return indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint); }
+    // first index of this geometry within iboGL, in elements
+    size_t getBaseIndex() const { return iboOffset / getIndexSize(); }
   };
 
   struct ObjectPart {
@@ -183,23 +221,75 @@ public:
     DrawRangeCache  cacheWire;
   };
 
+  // flat alternative to Object::parts and the two DrawRangeCaches, every
+  // object references ranges within a few arrays shared by the scene
+  struct FlatDrawRanges {
+    uint32_t  stateBegin;   // into FlatObjects::states / stateCounts
+    uint32_t  numStates;
+    uint32_t  rangeBegin;   // into FlatObjects::offsets / counts
+    uint32_t  numRanges;
+    uint32_t  capacity;     // of both regions, at least the object's parts
+  };
+
+  struct FlatObject {
+    int             matrixIndex;
+    int             geometryIndex;
+    uint32_t        partsBegin;
+    uint32_t        numParts;
+    FlatDrawRanges  solid;
+    FlatDrawRanges  wire;
+  };
+
+  struct FlatObjects {
+    std::vector<FlatObject>     objects;
+    std::vector<ObjectPart>     parts;
+    std::vector<DrawStateInfo>  states;
+    std::vector<int>            stateCounts;
+    std::vector<size_t>         offsets;
+    std::vector<int>            counts;
+
+    bool empty() const { return objects.empty(); }
+    void clear() { *this = FlatObjects(); }
+  };
+
   std::vector<Material>       m_materials;
   std::vector<BBox>           m_geometryBboxes;
   std::vector<Geometry>       m_geometry;
   std::vector<MatrixNode>     m_matrices;
+  // world matrices in double precision with LoadConfig::doubleMatrices,
+  // the world matrices of m_matrices are then relative to m_renderOrigin
+  std::vector<glm::dmat4>     m_matricesDouble;
+  glm::dvec3                  m_renderOrigin;
   std::vector<Object>         m_objects;
   std::vector<glm::ivec2>  m_objectAssigns;
 
+  // empty unless LoadConfig::flatObjects, Object::parts and the caches
+  // of m_objects are released then and only this holds them
+  FlatObjects              m_flatObjects;
+
+  // world-space transform per clone, [0] is the identity of the original.
+  // With LoadConfig::instancedClones the arrays above only hold the original
+  // scene and clones are drawn as instances (gl_InstanceID indexes this),
+  // otherwise clones are duplicated and this only holds the identity.
+  std::vector<glm::mat4>   m_instanceMatrices;
+
 
   BBox      m_bbox;
 
   GLuint    m_materialsGL;
   GLuint64  m_materialsADDR;
+  // MaterialCompact SSBO with LoadConfig::compactMaterials, 0 otherwise
+  GLuint    m_materialsCompactGL;
   GLuint    m_matricesGL;
   GLuint64  m_matricesADDR;
   GLuint    m_matricesTexGL;
   GLuint64  m_matricesTexGLADDR;
+  // MatrixCompact TBO with LoadConfig::compactMatrices, 0 otherwise
+  GLuint    m_matricesCompactGL;
+  GLuint    m_matricesCompactTexGL;
+  GLuint64  m_matricesCompactTexGLADDR;
   GLuint    m_geometryBboxesGL;
+  GLuint64  m_geometryBboxesADDR;
   GLuint    m_geometryBboxesTexGL;
   GLuint    m_objectAssignsGL;
 
@@ -208,16 +298,235 @@ public:
   GLuint    m_matricesOrigGL;
   GLuint    m_matricesOrigTexGL;
 
+  GLuint    m_instancesGL;
+  GLuint    m_instancesTexGL;
+  GLuint64  m_instancesTexGLADDR;
+
+  // shared by all geometries with LoadConfig::arenaBuffers, 0 otherwise
+  GLuint    m_arenaVboGL;
+  GLuint    m_arenaIboGL;
+  GLuint64  m_arenaVboADDR;
+  GLuint64  m_arenaIboADDR;
+  size_t    m_arenaVboSize;
+  size_t    m_arenaIboSize;
+
   NodeTree  m_nodeTree;
 
+  bool      m_compactVertices;
+  // LoadConfig::arenaBuffers, also set with LoadConfig::cpuOnly
+  bool      m_arenaBuffers;
+  bool      m_compactMaterials;
+  bool      m_compactMatrices;
+  bool      m_doubleMatrices;
+
+  struct LoadConfig {
+    // number of worker threads used to convert geometries,
+    // 0 or 1 runs the original serial path on the main thread
+    int   threads;
+    // load raw .csf files through a read-only file mapping, index data
+    // is uploaded straight from the mapping, other files ignore this
+    bool  fileMapping;
+    // store the processed scene next to the source file as
+    // <filename>.scenecache and load it directly on later runs
+    bool  sceneCache;
+    // additionally hash the full source file and reject caches that
+    // were written for different content, costs one full read per load
+    bool  sceneCacheVerify;
+    // use VertexCompact instead of Vertex, shaders need USE_COMPACTVERTEX
+    bool  compactVertices;
+    // sub-allocate all geometries from one vertex and one index buffer,
+    // draws then use Geometry::baseVertex and absolute index offsets
+    bool  arenaBuffers;
+    // store indices of geometries with at most 65536 vertices as 16 bit,
+    // DrawRange offsets are in bytes so draws must use Geometry::indexType
+    bool  shortIndices;
+    // reorder triangles within each part for the post-transform vertex
+    // cache and vertices by first use, logs ACMR/ATVR per geometry
+    bool  optimizeMeshes;
+    // additionally sort triangle clusters within each part to reduce
+    // overdraw, requires optimizeMeshes
+    bool  optimizeOverdraw;
+    // clones become instances of the original objects instead of
+    // duplicated matrices, objects and geometries, shaders need
+    // USE_INSTANCEDCLONES
+    bool  instancedClones;
+    // only set up ranges, bboxes, matrices and objects during loadCSF,
+    // geometries are converted and uploaded by later loadProgressive calls
+    bool  progressive;
+    // merge geometries with identical vertex and index content and
+    // materials with identical color, type and payload
+    bool  deduplicate;
+    // store object parts and draw caches in m_flatObjects
+    bool  flatObjects;
+    // additionally store materials as tightly packed MaterialCompact for
+    // the indexed renderers, shaders need USE_COMPACTMATERIAL
+    bool  compactMaterials;
+    // additionally store world matrices as MatrixCompact for the indexed
+    // renderers, shaders need USE_COMPACTMATRIX
+    bool  compactMatrices;
+    // keep a double-precision master copy of the world matrices and render
+    // relative to an origin near the camera, see updateRelativeMatrices
+    bool  doubleMatrices;
+    // read .gltf and .glb files with csfLoadGltf instead of the generic
+    // conversion within CSFile_loadExt
+    bool  gltfDirect;
+    // only build the CPU side of the scene without touching GL, for
+    // headless tools like the scene analysis. Geometries keep vboGL/iboGL
+    // at 0, sceneCache and progressive are ignored.
+    bool  cpuOnly;
+
+    LoadConfig()
+      : threads(0)
+      , fileMapping(false)
+      , sceneCache(false)
+      , sceneCacheVerify(false)
+      , compactVertices(false)
+      , arenaBuffers(false)
+      , shortIndices(false)
+      , optimizeMeshes(false)
+      , optimizeOverdraw(false)
+      , instancedClones(false)
+      , progressive(false)
+      , deduplicate(false)
+      , flatObjects(false)
+      , compactMaterials(false)
+      , compactMatrices(false)
+      , doubleMatrices(false)
+      , gltfDirect(false)
+      , cpuOnly(false)
+    {
+    }
+  };
+
   void  updateObjectDrawCache(Object& object);
-  
-  bool  loadCSF(const char* filename, int clones = 0, int cloneaxis=3);
+
+  // part visibility, draw caches of changed objects are rebuilt by
+  // updateDirtyObjects, works on m_objects or m_flatObjects
+  size_t getNumParts(size_t objectIndex) const;
+  bool  isPartActive(size_t objectIndex, size_t partIndex) const;
+  void  setPartActive(size_t objectIndex, size_t partIndex, bool active);
+  bool  hasDirtyObjects() const { return !m_dirtyObjects.empty(); }
+  // rebuilds the caches of all changed objects on up to threads workers,
+  // dirty receives their indices in ascending order for the renderers
+  void  updateDirtyObjects(std::vector<uint32_t>& dirty, int threads);
+
+  // copies parts and draw caches of all objects into m_flatObjects,
+  // releaseObjects frees the per-object vectors afterwards
+  void  buildFlatObjects(bool releaseObjects);
+
+  bool  loadCSF(const char* filename, int clones = 0, int cloneaxis=3, const LoadConfig& config = LoadConfig());
   void  unload();
 
-  static void enableVertexFormat(int attrPos, int attrNormal);
-  static void disableVertexFormat(int attrPos, int attrNormal);
+  // regenerates only the clone dependent matrices, objects, assigns and
+  // node tree from the original copy, geometry buffers stay resident.
+  // Returns false if a full loadCSF is required instead, e.g. while
+  // loading progressively or with LoadConfig::flatObjects.
+  bool  reclone(int clones, int cloneaxis, int threads);
+
+  // the bbox attributes are only used by the compact vertex format
+  void  enableVertexFormat(int attrPos, int attrNormal, int attrBboxMin, int attrBboxMax) const;
+  void  disableVertexFormat(int attrPos, int attrNormal, int attrBboxMin, int attrBboxMax) const;
+
+  size_t getVertexSize() const
+  {
+    return m_compactVertices ? sizeof(VertexCompact) : sizeof(Vertex);
+  }
+
+  // size of the buffer ranges to bind for a geometry's vboGL/iboGL
+  size_t getVboBindSize(const Geometry& geom) const
+  {
+    return m_arenaVboGL ? m_arenaVboSize : geom.vboSize;
+  }
+  size_t getIboBindSize(const Geometry& geom) const
+  {
+    return m_arenaIboGL ? m_arenaIboSize : geom.iboSize;
+  }
+
+  // instance count for every draw, 1 unless clones are instanced
+  GLuint getNumInstances() const
+  {
+    return GLuint(m_instanceMatrices.size());
+  }
+
+  // LoadConfig::progressive, objects become ready in index order within
+  // each clone copy, not yet ready objects must not be drawn
+  bool isLoading() const
+  {
+    return m_progressive != nullptr;
+  }
+  bool isObjectReady(size_t idx) const
+  {
+    // everything is ready without a running progressive load, which also
+    // covers the empty scene after unload
+    return !m_progressive || (idx % m_copyObjects) < m_readyObjects;
+  }
+  // ready objects per copy, copies start every getNumCopyObjects() objects
+  size_t getNumReadyObjects() const
+  {
+    return m_readyObjects;
+  }
+  size_t getNumCopyObjects() const
+  {
+    return m_copyObjects;
+  }
+
+  // converts and uploads the geometries of the next objects until budget
+  // bytes of vertex and index data are used, at least one geometry.
+  // Returns the new number of ready objects per copy.
+  size_t loadProgressive(size_t budget);
+
   void resetMatrices();
+
+  // LoadConfig::doubleMatrices only, changes the master copy of a node,
+  // it gets converted and uploaded with the next updateRelativeMatrices
+  void setWorldMatrixDouble(size_t nodeIndex, const glm::dmat4& world);
+
+  // moves m_renderOrigin to eye once it is more than rebaseDistance away,
+  // which converts all nodes, otherwise only nodes changed since the last
+  // call are converted. Returns the number of nodes written to m_matricesGL,
+  // view matrices must be made relative to m_renderOrigin as well.
+  size_t updateRelativeMatrices(const glm::dvec3& eye, double rebaseDistance, int threads);
+
+  static void makeGeometryResident(Geometry& geom);
+
+private:
+  struct ProgressiveLoad;
+
+  ProgressiveLoad* m_progressive  = nullptr;
+  size_t           m_readyObjects = 0;
+  size_t           m_copyObjects  = 0;
+
+  std::vector<uint8_t>   m_objectDirty;
+  std::vector<uint32_t>  m_dirtyObjects;
+
+  std::vector<uint8_t>   m_matrixDirty;
+  std::vector<uint32_t>  m_dirtyMatrices;
+  bool                   m_renderOriginValid = false;
+
+  // size of the original copy, clones follow in the same arrays
+  size_t                 m_numBaseNodes      = 0;
+  size_t                 m_numBaseObjects    = 0;
+  size_t                 m_numBaseGeometries = 0;
+  bool                   m_instancedClones   = false;
+  bool                   m_cpuOnly           = false;
+
+  void  createSceneBuffers();
+  void  destroySceneBuffers();
+  void  createClones(const std::vector<NodeTree::nodeID>& baseParents, int clones, int cloneaxis, int threads);
+  void  initMatricesDouble();
+  void  uploadMatrices(const std::vector<uint32_t>& sortedNodes);
+  void  finishProgressive();
+  void  writeFlatDrawRanges(FlatDrawRanges& ranges, const DrawRangeCache& cache);
+  void  createArenaBuffers(size_t vboSize, size_t iboSize);
+
+  // implemented in cadscenecache.cpp
+  // key from path, size, modification time and a few sampled chunks
+  static uint64_t computeCacheKey(const char* filename, int clones, int cloneaxis, const LoadConfig& config);
+  // hash over the full file content, only used with sceneCacheVerify
+  static uint64_t computeCacheContentHash(const char* filename);
+  // a non-zero contentHash must match the one stored in the cache
+  bool  loadCache(const char* filename, uint64_t key, uint64_t contentHash);
+  bool  saveCache(const char* filename, uint64_t key, uint64_t contentHash) const;
 };
 
 
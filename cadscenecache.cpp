@@ -0,0 +1,661 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+
+/* Contact ckubisch@nvidia.com (Christoph Kubisch) for feedback */
+
+#include "cadscene.hpp"
+
+#include <nvh/filemapping.hpp>
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+/*
+  The scene cache stores the fully processed CadScene (including clones),
+  so that a later load of the same file with the same clone settings does
+  not need to touch the CSF data at all.
+
+  All sections are plain arrays aligned to CACHE_ALIGNMENT within the file,
+  the cache is mapped read-only and vertex / index data is uploaded to GL
+  directly from the mapping.
+*/
+
+namespace {
+
+enum CacheSection
+{
+  CACHE_MATERIALS,
+  CACHE_GEOMETRY_BBOXES,
+  CACHE_GEOMETRIES,
+  CACHE_GEOMETRY_PARTS,
+  CACHE_VERTICES,
+  CACHE_INDICES,
+  CACHE_MATRICES,
+  CACHE_OBJECTS,
+  CACHE_OBJECT_PARTS,
+  CACHE_DRAW_STATES,
+  CACHE_DRAW_STATECOUNTS,
+  CACHE_DRAW_OFFSETS,
+  CACHE_DRAW_COUNTS,
+  CACHE_OBJECT_ASSIGNS,
+  CACHE_TREE_NODES,
+  CACHE_TREE_COMPACTNODES,
+  CACHE_INSTANCES,
+  NUM_CACHE_SECTIONS,
+};
+
+static const uint32_t CACHE_MAGIC     = 0x48434353;  // "SCCH"
+static const uint32_t CACHE_VERSION   = 5;
+static const size_t   CACHE_ALIGNMENT = 256;
+
+struct CacheRange
+{
+  uint64_t offset;
+  uint64_t size;
+};
+
+struct CacheHeader
+{
+  uint32_t       magic;
+  uint32_t       version;
+  uint64_t       key;
+  uint64_t       contentHash;  // 0 if written without sceneCacheVerify
+  CadScene::BBox bbox;
+  NodeTree::Node treeRoot;
+  uint64_t       arenaVboSize;  // 0 if geometries own their buffers
+  uint64_t       arenaIboSize;
+  CacheRange     sections[NUM_CACHE_SECTIONS];
+};
+
+struct CacheGeometry
+{
+  uint64_t vboOffset;  // within the cache file
+  uint64_t iboOffset;
+  uint64_t vboSize;
+  uint64_t iboSize;
+  uint64_t arenaVboOffset;
+  uint64_t arenaIboOffset;
+  int      baseVertex;
+  uint32_t indexType;
+  int      numVertices;
+  int      numIndexSolid;
+  int      numIndexWire;
+  int      cloneIdx;
+  uint32_t partsBegin;
+  uint32_t numParts;
+};
+
+struct CacheDrawRanges
+{
+  uint32_t stateBegin;
+  uint32_t numStates;
+  uint32_t rangeBegin;
+  uint32_t numRanges;
+};
+
+struct CacheObject
+{
+  int             matrixIndex;
+  int             geometryIndex;
+  uint32_t        partsBegin;
+  uint32_t        numParts;
+  CacheDrawRanges solid;
+  CacheDrawRanges wire;
+};
+
+struct CacheDrawArrays
+{
+  std::vector<CadScene::DrawStateInfo> states;
+  std::vector<int>                     stateCounts;
+  std::vector<uint64_t>                offsets;
+  std::vector<int>                     counts;
+
+  CacheDrawRanges append(const CadScene::DrawRangeCache& cache)
+  {
+    CacheDrawRanges ranges;
+    ranges.stateBegin = uint32_t(states.size());
+    ranges.numStates  = uint32_t(cache.state.size());
+    ranges.rangeBegin = uint32_t(offsets.size());
+    ranges.numRanges  = uint32_t(cache.offsets.size());
+
+    states.insert(states.end(), cache.state.begin(), cache.state.end());
+    stateCounts.insert(stateCounts.end(), cache.stateCount.begin(), cache.stateCount.end());
+    offsets.insert(offsets.end(), cache.offsets.begin(), cache.offsets.end());
+    counts.insert(counts.end(), cache.counts.begin(), cache.counts.end());
+    return ranges;
+  }
+};
+
+class CacheReader
+{
+public:
+  CacheReader(const uint8_t* data, const CacheHeader& header)
+      : m_data(data)
+      , m_header(header)
+  {
+  }
+
+  template <class T>
+  const T* get(CacheSection section, size_t& count) const
+  {
+    count = size_t(m_header.sections[section].size / sizeof(T));
+    return (const T*)(m_data + m_header.sections[section].offset);
+  }
+
+  template <class T>
+  void read(CacheSection section, std::vector<T>& vec) const
+  {
+    size_t   count;
+    const T* data = get<T>(section, count);
+    vec.assign(data, data + count);
+  }
+
+private:
+  const uint8_t*     m_data;
+  const CacheHeader& m_header;
+};
+
+class CacheWriter
+{
+public:
+  CacheWriter(const char* filename)
+      : m_file(filename, std::ios::binary | std::ios::trunc)
+      , m_offset(0)
+  {
+    // reserve space for header, written last
+    CacheHeader header = {};
+    write(&header, sizeof(header));
+  }
+
+  bool valid() const { return m_file.good(); }
+
+  void section(CacheHeader& header, CacheSection section, const void* data, size_t size)
+  {
+    align();
+    header.sections[section].offset = m_offset;
+    header.sections[section].size   = size;
+    write(data, size);
+  }
+
+  template <class T>
+  void section(CacheHeader& header, CacheSection section, const std::vector<T>& vec)
+  {
+    this->section(header, section, vec.empty() ? nullptr : vec.data(), sizeof(T) * vec.size());
+  }
+
+  // sections whose content is appended piecewise
+  void beginSection(CacheHeader& header, CacheSection section)
+  {
+    align();
+    header.sections[section].offset = m_offset;
+  }
+
+  uint64_t append(const void* data, size_t size)
+  {
+    uint64_t offset = m_offset;
+    write(data, size);
+    return offset;
+  }
+
+  void endSection(CacheHeader& header, CacheSection section)
+  {
+    header.sections[section].size = m_offset - header.sections[section].offset;
+  }
+
+  void finish(const CacheHeader& header)
+  {
+    m_file.seekp(0);
+    m_file.write((const char*)&header, sizeof(header));
+    m_file.flush();
+  }
+
+private:
+  std::ofstream m_file;
+  uint64_t      m_offset;
+
+  void write(const void* data, size_t size)
+  {
+    if(size)
+    {
+      m_file.write((const char*)data, size);
+      m_offset += size;
+    }
+  }
+
+  void align()
+  {
+    static const uint8_t zeros[CACHE_ALIGNMENT] = {};
+    size_t               padding                = size_t((CACHE_ALIGNMENT - (m_offset % CACHE_ALIGNMENT)) % CACHE_ALIGNMENT);
+    write(zeros, padding);
+  }
+};
+
+}  // namespace
+
+
+namespace {
+
+// FNV-1a style over 64-bit words
+struct CacheHash
+{
+  uint64_t hash = 0xcbf29ce484222325ULL;
+
+  void mix(uint64_t value)
+  {
+    hash ^= value;
+    hash *= 0x100000001b3ULL;
+  }
+
+  void mixBytes(const uint8_t* data, size_t size)
+  {
+    size_t words = size / sizeof(uint64_t);
+    for(size_t i = 0; i < words; i++)
+    {
+      uint64_t word;
+      memcpy(&word, data + i * sizeof(uint64_t), sizeof(uint64_t));
+      mix(word);
+    }
+
+    // zero the tail of a partial word
+    if(size % sizeof(uint64_t))
+    {
+      uint64_t word = 0;
+      memcpy(&word, data + words * sizeof(uint64_t), size % sizeof(uint64_t));
+      mix(word);
+    }
+  }
+
+  // 0 is reserved as invalid key
+  uint64_t get() const { return hash ? hash : 1; }
+};
+
+static const size_t CACHE_SAMPLE_SIZE  = 64 * 1024;
+static const size_t CACHE_SAMPLE_COUNT = 4;
+
+}  // namespace
+
+uint64_t CadScene::computeCacheKey(const char* filename, int clones, int cloneaxis, const LoadConfig& config)
+{
+  std::error_code ec;
+  std::filesystem::path path = std::filesystem::absolute(filename, ec);
+  if(ec)
+  {
+    return 0;
+  }
+  uint64_t fileSize = std::filesystem::file_size(path, ec);
+  if(ec)
+  {
+    return 0;
+  }
+  auto fileTime = std::filesystem::last_write_time(path, ec);
+  if(ec)
+  {
+    return 0;
+  }
+
+  std::ifstream file(path, std::ios::binary);
+  if(!file.is_open())
+  {
+    return 0;
+  }
+
+  // anything that changes the processed result (file identity, clone setup,
+  // data layout) must go into the key, the content itself is only sampled,
+  // see computeCacheContentHash for a full check
+  CacheHash key;
+  key.mix(CACHE_VERSION);
+  key.mix(uint64_t(clones));
+  key.mix(uint64_t(cloneaxis));
+  key.mix(config.compactVertices ? sizeof(VertexCompact) : sizeof(Vertex));
+  key.mix(config.arenaBuffers ? 1 : 0);
+  key.mix(config.shortIndices ? 1 : 0);
+  key.mix(config.optimizeMeshes ? (config.optimizeOverdraw ? 2 : 1) : 0);
+  key.mix(config.instancedClones ? 1 : 0);
+  key.mix(config.deduplicate ? 1 : 0);
+  key.mix(config.gltfDirect ? 1 : 0);
+  key.mix(sizeof(Material));
+  key.mix(sizeof(MatrixNode));
+
+  std::string pathString = path.lexically_normal().string();
+  key.mixBytes((const uint8_t*)pathString.data(), pathString.size());
+  key.mix(fileSize);
+  key.mix(uint64_t(fileTime.time_since_epoch().count()));
+
+  // evenly spaced samples, first one at the start, last one at the end
+  std::vector<uint8_t> sample(CACHE_SAMPLE_SIZE);
+  for(size_t i = 0; i < CACHE_SAMPLE_COUNT; i++)
+  {
+    uint64_t offset = 0;
+    if(fileSize > CACHE_SAMPLE_SIZE)
+    {
+      offset = ((fileSize - CACHE_SAMPLE_SIZE) * i) / (CACHE_SAMPLE_COUNT - 1);
+    }
+    file.seekg(std::streamoff(offset));
+    file.read((char*)sample.data(), sample.size());
+    size_t read = size_t(file.gcount());
+    file.clear();
+
+    key.mix(offset);
+    key.mixBytes(sample.data(), read);
+
+    if(fileSize <= CACHE_SAMPLE_SIZE)
+      break;
+  }
+
+  return key.get();
+}
+
+uint64_t CadScene::computeCacheContentHash(const char* filename)
+{
+  std::ifstream file(filename, std::ios::binary);
+  if(!file.is_open())
+  {
+    return 0;
+  }
+
+  CacheHash            content;
+  std::vector<uint8_t> chunk(1024 * 1024);
+  uint64_t             fileSize = 0;
+  while(file)
+  {
+    file.read((char*)chunk.data(), chunk.size());
+    size_t read = size_t(file.gcount());
+    if(!read)
+      break;
+
+    content.mixBytes(chunk.data(), read);
+    fileSize += read;
+  }
+  content.mix(fileSize);
+
+  return content.get();
+}
+
+bool CadScene::saveCache(const char* filename, uint64_t key, uint64_t contentHash) const
+{
+  CacheWriter writer(filename);
+  if(!writer.valid())
+  {
+    return false;
+  }
+
+  CacheHeader header = {};
+  header.magic       = CACHE_MAGIC;
+  header.version     = CACHE_VERSION;
+  header.key         = key;
+  header.contentHash = contentHash;
+  header.bbox        = m_bbox;
+  header.treeRoot    = m_nodeTree.getRootNode();
+  header.arenaVboSize = m_arenaVboGL ? m_arenaVboSize : 0;
+  header.arenaIboSize = m_arenaIboGL ? m_arenaIboSize : 0;
+
+  writer.section(header, CACHE_MATERIALS, m_materials);
+  writer.section(header, CACHE_GEOMETRY_BBOXES, m_geometryBboxes);
+
+  std::vector<CacheGeometry>          geometries(m_geometry.size());
+  std::vector<CadScene::GeometryPart> geometryParts;
+
+  // vertex and index data only lives in GL after load,
+  // read it back for the original (non-clone) geometries
+  std::vector<uint8_t> readback;
+
+  writer.beginSection(header, CACHE_VERTICES);
+  for(size_t i = 0; i < m_geometry.size(); i++)
+  {
+    const Geometry& geom = m_geometry[i];
+    CacheGeometry&  cgeom = geometries[i];
+
+    cgeom.vboSize        = geom.vboSize;
+    cgeom.iboSize        = geom.iboSize;
+    cgeom.arenaVboOffset = geom.vboOffset;
+    cgeom.arenaIboOffset = geom.iboOffset;
+    cgeom.baseVertex     = geom.baseVertex;
+    cgeom.indexType      = geom.indexType;
+    cgeom.numVertices   = geom.numVertices;
+    cgeom.numIndexSolid = geom.numIndexSolid;
+    cgeom.numIndexWire  = geom.numIndexWire;
+    cgeom.cloneIdx      = geom.cloneIdx;
+    cgeom.partsBegin    = uint32_t(geometryParts.size());
+    cgeom.numParts      = uint32_t(geom.parts.size());
+    geometryParts.insert(geometryParts.end(), geom.parts.begin(), geom.parts.end());
+
+    if(geom.cloneIdx < 0)
+    {
+      readback.resize(geom.vboSize);
+      glGetNamedBufferSubData(geom.vboGL, geom.vboOffset, geom.vboSize, readback.data());
+      cgeom.vboOffset = writer.append(readback.data(), geom.vboSize);
+    }
+  }
+  writer.endSection(header, CACHE_VERTICES);
+
+  writer.beginSection(header, CACHE_INDICES);
+  for(size_t i = 0; i < m_geometry.size(); i++)
+  {
+    const Geometry& geom = m_geometry[i];
+    if(geom.cloneIdx < 0)
+    {
+      readback.resize(geom.iboSize);
+      glGetNamedBufferSubData(geom.iboGL, geom.iboOffset, geom.iboSize, readback.data());
+      geometries[i].iboOffset = writer.append(readback.data(), geom.iboSize);
+    }
+  }
+  writer.endSection(header, CACHE_INDICES);
+  readback.clear();
+  readback.shrink_to_fit();
+
+  writer.section(header, CACHE_GEOMETRIES, geometries);
+  writer.section(header, CACHE_GEOMETRY_PARTS, geometryParts);
+  writer.section(header, CACHE_MATRICES, m_matrices);
+
+  std::vector<CacheObject>          objects(m_objects.size());
+  std::vector<CadScene::ObjectPart> objectParts;
+  CacheDrawArrays                   drawArrays;
+  for(size_t i = 0; i < m_objects.size(); i++)
+  {
+    const Object& object  = m_objects[i];
+    CacheObject&  cobject = objects[i];
+
+    cobject.matrixIndex   = object.matrixIndex;
+    cobject.geometryIndex = object.geometryIndex;
+    cobject.partsBegin    = uint32_t(objectParts.size());
+    cobject.numParts      = uint32_t(object.parts.size());
+    objectParts.insert(objectParts.end(), object.parts.begin(), object.parts.end());
+
+    cobject.solid = drawArrays.append(object.cacheSolid);
+    cobject.wire  = drawArrays.append(object.cacheWire);
+  }
+
+  writer.section(header, CACHE_OBJECTS, objects);
+  writer.section(header, CACHE_OBJECT_PARTS, objectParts);
+  writer.section(header, CACHE_DRAW_STATES, drawArrays.states);
+  writer.section(header, CACHE_DRAW_STATECOUNTS, drawArrays.stateCounts);
+  writer.section(header, CACHE_DRAW_OFFSETS, drawArrays.offsets);
+  writer.section(header, CACHE_DRAW_COUNTS, drawArrays.counts);
+  writer.section(header, CACHE_OBJECT_ASSIGNS, m_objectAssigns);
+  writer.section(header, CACHE_TREE_NODES, m_nodeTree.getNodes());
+  writer.section(header, CACHE_TREE_COMPACTNODES, m_nodeTree.getTreeCompactNodes());
+  writer.section(header, CACHE_INSTANCES, m_instanceMatrices);
+
+  writer.finish(header);
+
+  return writer.valid();
+}
+
+static void readDrawRanges(CadScene::DrawRangeCache& cache, const CacheDrawRanges& ranges, const CacheReader& reader)
+{
+  size_t                         count;
+  const CadScene::DrawStateInfo* states      = reader.get<CadScene::DrawStateInfo>(CACHE_DRAW_STATES, count);
+  const int*                     stateCounts = reader.get<int>(CACHE_DRAW_STATECOUNTS, count);
+  const uint64_t*                offsets     = reader.get<uint64_t>(CACHE_DRAW_OFFSETS, count);
+  const int*                     counts      = reader.get<int>(CACHE_DRAW_COUNTS, count);
+
+  cache.state.assign(states + ranges.stateBegin, states + ranges.stateBegin + ranges.numStates);
+  cache.stateCount.assign(stateCounts + ranges.stateBegin, stateCounts + ranges.stateBegin + ranges.numStates);
+  cache.offsets.assign(offsets + ranges.rangeBegin, offsets + ranges.rangeBegin + ranges.numRanges);
+  cache.counts.assign(counts + ranges.rangeBegin, counts + ranges.rangeBegin + ranges.numRanges);
+}
+
+bool CadScene::loadCache(const char* filename, uint64_t key, uint64_t contentHash)
+{
+  nvh::FileReadMapping mapping;
+  if(!mapping.open(filename))
+  {
+    return false;
+  }
+
+  const uint8_t* data = (const uint8_t*)mapping.data();
+  if(mapping.size() < sizeof(CacheHeader))
+  {
+    return false;
+  }
+
+  const CacheHeader& header = *(const CacheHeader*)data;
+  if(header.magic != CACHE_MAGIC || header.version != CACHE_VERSION || header.key != key)
+  {
+    return false;
+  }
+  if(contentHash && header.contentHash != contentHash)
+  {
+    return false;
+  }
+
+  for(int i = 0; i < NUM_CACHE_SECTIONS; i++)
+  {
+    if(header.sections[i].offset + header.sections[i].size > mapping.size())
+    {
+      return false;
+    }
+  }
+
+  if(header.sections[CACHE_TREE_NODES].size / sizeof(NodeTree::Node)
+         != header.sections[CACHE_TREE_COMPACTNODES].size / sizeof(NodeTree::compactID)
+     || !header.sections[CACHE_INSTANCES].size)
+  {
+    return false;
+  }
+
+  CacheReader reader(data, header);
+
+  reader.read(CACHE_MATERIALS, m_materials);
+  reader.read(CACHE_GEOMETRY_BBOXES, m_geometryBboxes);
+  reader.read(CACHE_MATRICES, m_matrices);
+  reader.read(CACHE_OBJECT_ASSIGNS, m_objectAssigns);
+  reader.read(CACHE_INSTANCES, m_instanceMatrices);
+
+  size_t                        numGeometries;
+  size_t                        numParts;
+  const CacheGeometry*          geometries = reader.get<CacheGeometry>(CACHE_GEOMETRIES, numGeometries);
+  const CadScene::GeometryPart* parts      = reader.get<CadScene::GeometryPart>(CACHE_GEOMETRY_PARTS, numParts);
+
+  if(header.arenaVboSize)
+  {
+    createArenaBuffers(size_t(header.arenaVboSize), size_t(header.arenaIboSize));
+  }
+
+  m_geometry.resize(numGeometries);
+  for(size_t i = 0; i < numGeometries; i++)
+  {
+    const CacheGeometry& cgeom = geometries[i];
+    Geometry&            geom  = m_geometry[i];
+
+    geom.vboSize       = size_t(cgeom.vboSize);
+    geom.iboSize       = size_t(cgeom.iboSize);
+    geom.numVertices   = cgeom.numVertices;
+    geom.numIndexSolid = cgeom.numIndexSolid;
+    geom.numIndexWire  = cgeom.numIndexWire;
+    geom.cloneIdx      = cgeom.cloneIdx;
+    geom.baseVertex    = cgeom.baseVertex;
+    geom.indexType     = GLenum(cgeom.indexType);
+    geom.vboOffset     = size_t(cgeom.arenaVboOffset);
+    geom.iboOffset     = size_t(cgeom.arenaIboOffset);
+    geom.parts.assign(parts + cgeom.partsBegin, parts + cgeom.partsBegin + cgeom.numParts);
+
+    if(m_arenaVboGL)
+    {
+      geom.vboGL   = m_arenaVboGL;
+      geom.iboGL   = m_arenaIboGL;
+      geom.vboADDR = m_arenaVboADDR;
+      geom.iboADDR = m_arenaIboADDR;
+      if(geom.cloneIdx < 0)
+      {
+        glNamedBufferSubData(geom.vboGL, geom.vboOffset, geom.vboSize, data + cgeom.vboOffset);
+        glNamedBufferSubData(geom.iboGL, geom.iboOffset, geom.iboSize, data + cgeom.iboOffset);
+      }
+    }
+    else if(geom.cloneIdx < 0)
+    {
+      glCreateBuffers(1, &geom.vboGL);
+      glNamedBufferStorage(geom.vboGL, geom.vboSize, data + cgeom.vboOffset, 0);
+
+      glCreateBuffers(1, &geom.iboGL);
+      glNamedBufferStorage(geom.iboGL, geom.iboSize, data + cgeom.iboOffset, 0);
+
+      makeGeometryResident(geom);
+    }
+    else
+    {
+      // clones always follow their originals
+      const Geometry& geomorig = m_geometry[geom.cloneIdx];
+      geom.vboGL               = geomorig.vboGL;
+      geom.iboGL               = geomorig.iboGL;
+      geom.vboADDR             = geomorig.vboADDR;
+      geom.iboADDR             = geomorig.iboADDR;
+    }
+  }
+
+  size_t                      numObjects;
+  size_t                      numObjectParts;
+  const CacheObject*          objects     = reader.get<CacheObject>(CACHE_OBJECTS, numObjects);
+  const CadScene::ObjectPart* objectParts = reader.get<CadScene::ObjectPart>(CACHE_OBJECT_PARTS, numObjectParts);
+
+  m_objects.resize(numObjects);
+  for(size_t i = 0; i < numObjects; i++)
+  {
+    const CacheObject& cobject = objects[i];
+    Object&            object  = m_objects[i];
+
+    object.matrixIndex   = cobject.matrixIndex;
+    object.geometryIndex = cobject.geometryIndex;
+    object.parts.assign(objectParts + cobject.partsBegin, objectParts + cobject.partsBegin + cobject.numParts);
+
+    readDrawRanges(object.cacheSolid, cobject.solid, reader);
+    readDrawRanges(object.cacheWire, cobject.wire, reader);
+  }
+
+  size_t                      numNodes;
+  size_t                      numCompactNodes;
+  const NodeTree::Node*       nodes        = reader.get<NodeTree::Node>(CACHE_TREE_NODES, numNodes);
+  const NodeTree::compactID*  compactNodes = reader.get<NodeTree::compactID>(CACHE_TREE_COMPACTNODES, numCompactNodes);
+  m_nodeTree.restore(nodes, compactNodes, int(numNodes), header.treeRoot);
+
+  m_bbox.merge(header.bbox);
+
+  if(m_doubleMatrices)
+  {
+    initMatricesDouble();
+  }
+
+  createSceneBuffers();
+
+  return true;
+}
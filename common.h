@@ -24,12 +24,17 @@
 #define VERTEX_NORMAL   1
 #define VERTEX_ASSIGNS  2
 #define VERTEX_WIREMODE 3
+#define VERTEX_BBOXMIN  4
+#define VERTEX_BBOXMAX  5
 
 #define UBO_SCENE     0
 #define UBO_MATRIX    1
 #define UBO_MATERIAL  2
 
+#define SSBO_MATERIAL 0
+
 #define TEX_MATRICES  0
+#define TEX_INSTANCES 1
 
 #define USE_BASEINSTANCE  0
 
@@ -54,6 +59,8 @@ struct SceneData {
   
   ivec2 viewport;
   uvec2 tboMatrices;
+  uvec2 tboInstances;
+  uvec2 _pad;
 };
 
 #ifdef __cplusplus
@@ -86,8 +93,10 @@ layout(std140,binding=UBO_MATRIX) uniform matrixBuffer {
 #extension GL_NV_bindless_texture : enable
 #if GL_NV_bindless_texture
 #define matricesBuffer  samplerBuffer(scene.tboMatrices)
+#define instancesBuffer samplerBuffer(scene.tboInstances)
 #else
 layout(binding=TEX_MATRICES) uniform samplerBuffer matricesBuffer;
+layout(binding=TEX_INSTANCES) uniform samplerBuffer instancesBuffer;
 #endif
 // must match cadscene!
 #define NODE_MATRIX_WORLD     0
@@ -105,4 +114,37 @@ mat4 getIndexedMatrix(int idx, int what)
                 texelFetch(matricesBuffer, i*4 + 3));
 }
 
-#endif
\ No newline at end of file
+#if USE_COMPACTMATRIX
+// must match CadScene::MatrixCompact, rows of the affine world matrix,
+// bound instead of the MatrixNode buffer
+#define NODE_COMPACT_ROWS     3
+
+mat3x4 getIndexedMatrixCompact(int idx)
+{
+  return mat3x4(texelFetch(matricesBuffer, idx * NODE_COMPACT_ROWS + 0),
+                texelFetch(matricesBuffer, idx * NODE_COMPACT_ROWS + 1),
+                texelFetch(matricesBuffer, idx * NODE_COMPACT_ROWS + 2));
+}
+
+// inverse-transpose of the upper 3x3 up to its (positive) scale,
+// as cofactor matrix from the columns, normals are normalized later
+mat3 getNormalMatrixCompact(mat3x4 rows)
+{
+  vec3 c0 = vec3(rows[0].x, rows[1].x, rows[2].x);
+  vec3 c1 = vec3(rows[0].y, rows[1].y, rows[2].y);
+  vec3 c2 = vec3(rows[0].z, rows[1].z, rows[2].z);
+  mat3 cofactor = mat3(cross(c1, c2), cross(c2, c0), cross(c0, c1));
+  return dot(c0, cofactor[0]) < 0.0 ? -cofactor : cofactor;
+}
+#endif
+
+// must match CadScene::m_instanceMatrices
+mat4 getInstanceMatrix(int idx)
+{
+  return mat4(  texelFetch(instancesBuffer, idx*4 + 0),
+                texelFetch(instancesBuffer, idx*4 + 1),
+                texelFetch(instancesBuffer, idx*4 + 2),
+                texelFetch(instancesBuffer, idx*4 + 3));
+}
+
+#endif
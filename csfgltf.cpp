@@ -0,0 +1,446 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+
+/* Contact ckubisch@nvidia.com (Christoph Kubisch) for feedback */
+
+#include "csfgltf.hpp"
+
+#include <nvh/nvprint.hpp>
+#include <nvh/parallel_work.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+// implementation lives in csf.cpp
+#include <cgltf.h>
+
+struct GltfMesh
+{
+  int      geometryIDX   = -1;  // -1 without triangle primitives
+  int      numParts      = 0;
+  uint32_t numVertices   = 0;
+  uint32_t numIndexSolid = 0;
+  bool     hasNormals    = false;
+
+  std::vector<int>      partMaterials;
+  std::vector<uint32_t> indexWire;
+};
+
+struct GltfCounts
+{
+  int    geometries = 0;
+  int    nodes      = 0;
+  size_t vertices   = 0;
+  size_t indexSolid = 0;
+  size_t indexWire  = 0;
+};
+
+static double getTimeMs()
+{
+  return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now().time_since_epoch()).count();
+}
+
+static const float s_identity[16] = {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1};
+
+template <class T>
+static T* allocArray(CSFileMemoryPTR mem, size_t count)
+{
+  if(!count)
+    return nullptr;
+
+  T* data = (T*)CSFileMemory_alloc(mem, sizeof(T) * count, nullptr);
+  memset(data, 0, sizeof(T) * count);
+  return data;
+}
+
+static const cgltf_accessor* findAttribute(const cgltf_primitive& prim, cgltf_attribute_type type)
+{
+  for(cgltf_size i = 0; i < prim.attributes_count; i++)
+  {
+    if(prim.attributes[i].type == type)
+    {
+      return prim.attributes[i].data;
+    }
+  }
+  return nullptr;
+}
+
+static bool isTrianglePrimitive(const cgltf_primitive& prim)
+{
+  return prim.type == cgltf_primitive_type_triangles && findAttribute(prim, cgltf_attribute_type_position);
+}
+
+// thread-safe, the arrays of geom are already allocated
+static void convertMesh(CSFGeometry& geom, GltfMesh& info, const cgltf_mesh& mesh)
+{
+  std::vector<uint64_t> edges;
+
+  uint32_t baseVertex = 0;
+  uint32_t baseIndex  = 0;
+  int      part       = 0;
+  for(cgltf_size p = 0; p < mesh.primitives_count; p++)
+  {
+    const cgltf_primitive& prim = mesh.primitives[p];
+    if(!isTrianglePrimitive(prim))
+      continue;
+
+    const cgltf_accessor* position = findAttribute(prim, cgltf_attribute_type_position);
+    const cgltf_accessor* normal   = findAttribute(prim, cgltf_attribute_type_normal);
+
+    uint32_t numVertices = uint32_t(position->count);
+    float*   vertex      = geom.vertex + size_t(baseVertex) * 3;
+    cgltf_accessor_unpack_floats(position, vertex, size_t(numVertices) * 3);
+
+    if(geom.normal && normal && normal->count == position->count)
+    {
+      cgltf_accessor_unpack_floats(normal, geom.normal + size_t(baseVertex) * 3, size_t(numVertices) * 3);
+    }
+    else if(geom.normal)
+    {
+      // same fallback as CadScene uses for geometries without normals
+      for(uint32_t v = 0; v < numVertices; v++)
+      {
+        const float* pos = vertex + v * 3;
+        float        len = sqrtf(pos[0] * pos[0] + pos[1] * pos[1] + pos[2] * pos[2]);
+        float        inv = len > 0 ? 1.0f / len : 0.0f;
+        float*       nrm = geom.normal + (size_t(baseVertex) + v) * 3;
+        nrm[0]           = pos[0] * inv;
+        nrm[1]           = pos[1] * inv;
+        nrm[2]           = pos[2] * inv;
+      }
+    }
+
+    uint32_t  numIndices = prim.indices ? uint32_t(prim.indices->count) : numVertices;
+    uint32_t* solid      = geom.indexSolid + baseIndex;
+    for(uint32_t i = 0; i < numIndices; i++)
+    {
+      solid[i] = baseVertex + (prim.indices ? uint32_t(cgltf_accessor_read_index(prim.indices, i)) : i);
+    }
+
+    // triangle edges, shared edges are drawn once
+    edges.clear();
+    for(uint32_t t = 0; t < numIndices / 3; t++)
+    {
+      for(uint32_t k = 0; k < 3; k++)
+      {
+        uint32_t a = solid[t * 3 + k];
+        uint32_t b = solid[t * 3 + (k + 1) % 3];
+        if(a != b)
+        {
+          edges.push_back((uint64_t(std::min(a, b)) << 32) | uint64_t(std::max(a, b)));
+        }
+      }
+    }
+    std::sort(edges.begin(), edges.end());
+    edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+    size_t wireBegin = info.indexWire.size();
+    for(uint64_t edge : edges)
+    {
+      info.indexWire.push_back(uint32_t(edge >> 32));
+      info.indexWire.push_back(uint32_t(edge));
+    }
+
+    geom.parts[part].numIndexSolid = int(numIndices);
+    geom.parts[part].numIndexWire  = int(info.indexWire.size() - wireBegin);
+
+    baseVertex += numVertices;
+    baseIndex += numIndices;
+    part++;
+  }
+}
+
+bool csfIsGltf(const char* filename)
+{
+  size_t len = strlen(filename);
+  return (len > 5 && strcmp(filename + len - 5, ".gltf") == 0) || (len > 4 && strcmp(filename + len - 4, ".glb") == 0);
+}
+
+int csfLoadGltf(CSFile** outcsf, const char* filename, CSFileMemoryPTR mem, uint32_t threads)
+{
+  cgltf_options options;
+  memset(&options, 0, sizeof(options));
+
+  cgltf_data* data = nullptr;
+  if(cgltf_parse_file(&options, filename, &data) != cgltf_result_success)
+  {
+    return CADSCENEFILE_ERROR_NOFILE;
+  }
+  if(cgltf_load_buffers(&options, data, filename) != cgltf_result_success)
+  {
+    cgltf_free(data);
+    return CADSCENEFILE_ERROR_OPERATION;
+  }
+
+  CSFile* csf = allocArray<CSFile>(mem, 1);
+  csf->magic     = CADSCENEFILE_MAGIC;
+  csf->version   = CADSCENEFILE_VERSION;
+  csf->fileFlags = CADSCENEFILE_FLAG_UNIQUENODES;
+
+  // counts of all meshes, primitives without a material use an extra default one
+  std::vector<GltfMesh> meshes(data->meshes_count);
+  int                   defaultMaterial = int(data->materials_count);
+  bool                  useDefault      = data->materials_count == 0;
+  for(cgltf_size m = 0; m < data->meshes_count; m++)
+  {
+    const cgltf_mesh& mesh = data->meshes[m];
+    GltfMesh&         info = meshes[m];
+    for(cgltf_size p = 0; p < mesh.primitives_count; p++)
+    {
+      const cgltf_primitive& prim = mesh.primitives[p];
+      if(!isTrianglePrimitive(prim))
+        continue;
+
+      uint32_t numVertices = uint32_t(findAttribute(prim, cgltf_attribute_type_position)->count);
+      info.numVertices += numVertices;
+      info.numIndexSolid += prim.indices ? uint32_t(prim.indices->count) : numVertices;
+      info.hasNormals = info.hasNormals || findAttribute(prim, cgltf_attribute_type_normal);
+      info.partMaterials.push_back(prim.material ? int(prim.material - data->materials) : defaultMaterial);
+      useDefault = useDefault || !prim.material;
+      info.numParts++;
+    }
+
+    if(info.numParts && info.numVertices)
+    {
+      info.geometryIDX = csf->numGeometries++;
+    }
+  }
+
+  csf->geometries = allocArray<CSFGeometry>(mem, csf->numGeometries);
+  for(GltfMesh& info : meshes)
+  {
+    if(info.geometryIDX < 0)
+      continue;
+
+    CSFGeometry& geom = csf->geometries[info.geometryIDX];
+    memcpy(geom.matrix, s_identity, sizeof(s_identity));
+    geom.numParts      = info.numParts;
+    geom.numVertices   = int(info.numVertices);
+    geom.numIndexSolid = int(info.numIndexSolid);
+    geom.vertex        = allocArray<float>(mem, size_t(info.numVertices) * 3);
+    geom.normal        = info.hasNormals ? allocArray<float>(mem, size_t(info.numVertices) * 3) : nullptr;
+    geom.indexSolid    = allocArray<unsigned int>(mem, info.numIndexSolid);
+    geom.parts         = allocArray<CSFGeometryPart>(mem, info.numParts);
+  }
+
+  // unpack accessors straight into the final arrays
+  auto fnConvert = [&](uint64_t m) {
+    if(meshes[m].geometryIDX >= 0)
+    {
+      convertMesh(csf->geometries[meshes[m].geometryIDX], meshes[m], data->meshes[m]);
+    }
+  };
+  nvh::parallel_batches<1>(meshes.size(), fnConvert, std::max(threads, 1u));
+
+  // wire counts are only known after the edges were collected
+  for(GltfMesh& info : meshes)
+  {
+    if(info.geometryIDX < 0)
+      continue;
+
+    CSFGeometry& geom = csf->geometries[info.geometryIDX];
+    geom.numIndexWire = int(info.indexWire.size());
+    geom.indexWire    = allocArray<unsigned int>(mem, info.indexWire.size());
+    if(geom.indexWire)
+    {
+      memcpy(geom.indexWire, info.indexWire.data(), sizeof(unsigned int) * info.indexWire.size());
+    }
+    info.indexWire = std::vector<uint32_t>();
+  }
+
+  // materials
+  csf->numMaterials = int(data->materials_count) + (useDefault ? 1 : 0);
+  csf->materials    = allocArray<CSFMaterial>(mem, csf->numMaterials);
+  for(int i = 0; i < csf->numMaterials; i++)
+  {
+    CSFMaterial& material = csf->materials[i];
+    material.color[0]     = 0.8f;
+    material.color[1]     = 0.8f;
+    material.color[2]     = 0.8f;
+    material.color[3]     = 1.0f;
+
+    if(i == defaultMaterial)
+      continue;
+
+    const cgltf_material& gltfmaterial = data->materials[i];
+    if(gltfmaterial.name)
+    {
+      strncpy(material.name, gltfmaterial.name, sizeof(material.name) - 1);
+    }
+    if(gltfmaterial.has_pbr_metallic_roughness)
+    {
+      memcpy(material.color, gltfmaterial.pbr_metallic_roughness.base_color_factor, sizeof(float) * 4);
+    }
+  }
+
+  // nodes reachable from the default scene in depth-first order, CSF node 0
+  // is an extra root above the scene's root nodes
+  std::vector<const cgltf_node*> roots;
+  const cgltf_scene*             scene = data->scene ? data->scene : (data->scenes_count ? data->scenes : nullptr);
+  if(scene)
+  {
+    roots.assign(scene->nodes, scene->nodes + scene->nodes_count);
+  }
+  else
+  {
+    for(cgltf_size i = 0; i < data->nodes_count; i++)
+    {
+      if(!data->nodes[i].parent)
+      {
+        roots.push_back(&data->nodes[i]);
+      }
+    }
+  }
+
+  std::vector<int>               nodeMap(data->nodes_count, -1);
+  std::vector<const cgltf_node*> order(1, nullptr);
+  std::vector<const cgltf_node*> stack(roots.rbegin(), roots.rend());
+  while(!stack.empty())
+  {
+    const cgltf_node* node = stack.back();
+    stack.pop_back();
+
+    int& mapped = nodeMap[node - data->nodes];
+    if(mapped >= 0)
+      continue;
+
+    mapped = int(order.size());
+    order.push_back(node);
+    for(cgltf_size c = node->children_count; c > 0; c--)
+    {
+      stack.push_back(node->children[c - 1]);
+    }
+  }
+
+  csf->numNodes = int(order.size());
+  csf->rootIDX  = 0;
+  csf->nodes    = allocArray<CSFNode>(mem, order.size());
+  for(size_t n = 0; n < order.size(); n++)
+  {
+    const cgltf_node* node    = order[n];
+    CSFNode&          csfnode = csf->nodes[n];
+
+    csfnode.geometryIDX = -1;
+
+    std::vector<int> children;
+    if(node)
+    {
+      cgltf_node_transform_local(node, csfnode.objectTM);
+      cgltf_node_transform_world(node, csfnode.worldTM);
+      for(cgltf_size c = 0; c < node->children_count; c++)
+      {
+        children.push_back(nodeMap[node->children[c] - data->nodes]);
+      }
+    }
+    else
+    {
+      memcpy(csfnode.objectTM, s_identity, sizeof(s_identity));
+      memcpy(csfnode.worldTM, s_identity, sizeof(s_identity));
+      for(const cgltf_node* root : roots)
+      {
+        children.push_back(nodeMap[root - data->nodes]);
+      }
+      // roots listed twice were only mapped once
+      std::sort(children.begin(), children.end());
+      children.erase(std::unique(children.begin(), children.end()), children.end());
+    }
+
+    csfnode.numChildren = int(children.size());
+    csfnode.children    = allocArray<int>(mem, children.size());
+    if(csfnode.children)
+    {
+      memcpy(csfnode.children, children.data(), sizeof(int) * children.size());
+    }
+
+    const GltfMesh* info = node && node->mesh ? &meshes[node->mesh - data->meshes] : nullptr;
+    if(!info || info->geometryIDX < 0)
+      continue;
+
+    csfnode.geometryIDX = info->geometryIDX;
+    csfnode.numParts    = info->numParts;
+    csfnode.parts       = allocArray<CSFNodePart>(mem, info->numParts);
+    for(int p = 0; p < info->numParts; p++)
+    {
+      csfnode.parts[p].active      = 1;
+      csfnode.parts[p].materialIDX = info->partMaterials[p];
+      csfnode.parts[p].nodeIDX     = -1;
+    }
+  }
+
+  cgltf_free(data);
+
+  *outcsf = csf;
+  return CADSCENEFILE_NOERROR;
+}
+
+static void countFile(GltfCounts& counts, const CSFile* csf)
+{
+  counts            = GltfCounts();
+  counts.geometries = csf->numGeometries;
+  counts.nodes      = csf->numNodes;
+  for(int i = 0; i < csf->numGeometries; i++)
+  {
+    counts.vertices += csf->geometries[i].numVertices;
+    counts.indexSolid += csf->geometries[i].numIndexSolid;
+    counts.indexWire += csf->geometries[i].numIndexWire;
+  }
+}
+
+void csfGltfBenchmark(const char* filename, int runs, uint32_t threads)
+{
+  if(!csfIsGltf(filename))
+  {
+    LOGW("gltf benchmark: %s is not a .gltf or .glb file\n", filename);
+    return;
+  }
+
+  LOGI("gltf benchmark: %s, %d runs\n", filename, runs);
+  for(int route = 0; route < 2; route++)
+  {
+    GltfCounts counts;
+    double     timeTotal = 0;
+    for(int r = 0; r < runs; r++)
+    {
+      CSFileMemoryPTR mem = CSFileMemory_new();
+      CSFile*         csf = nullptr;
+
+      double timeBegin = getTimeMs();
+      int    result    = route ? csfLoadGltf(&csf, filename, mem, threads) : CSFile_loadExt(&csf, filename, mem);
+      timeTotal += getTimeMs() - timeBegin;
+
+      if(result != CADSCENEFILE_NOERROR)
+      {
+        LOGW("  %s failed with %d\n", route ? "direct" : "csf", result);
+        CSFileMemory_delete(mem);
+        return;
+      }
+
+      countFile(counts, csf);
+      CSFileMemory_delete(mem);
+    }
+
+    LOGI("  %-6s %2d thr %8.2f ms  geometries %d nodes %d vertices %d solid %d wire %d\n", route ? "direct" : "csf",
+         route ? threads : 1, timeTotal / double(runs), counts.geometries, counts.nodes, uint32_t(counts.vertices),
+         uint32_t(counts.indexSolid), uint32_t(counts.indexWire));
+  }
+}
@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+
+/* Contact ckubisch@nvidia.com (Christoph Kubisch) for feedback */
+
+#ifndef CSFGLTF_H__
+#define CSFGLTF_H__
+
+#include <fileformats/cadscenefile.h>
+#include <cstddef>
+#include <cstdint>
+
+/*
+  Direct .gltf / .glb ingestion for CadScene::loadCSF.
+
+  cgltf parses the file and loads its buffers once, every mesh becomes
+  one geometry with a part per triangle primitive. The counts of all
+  meshes are known from the accessors, so the final vertex, normal and
+  index arrays are allocated up front and the accessors are unpacked
+  straight into them on multiple threads. Wire indices are the unique
+  triangle edges of each part.
+
+  Only the nodes reachable from the default scene are kept, below a
+  single root node that CSF requires. Textures, skins and morph targets
+  are ignored like in the generic CSFile_loadExt conversion.
+*/
+
+bool csfIsGltf(const char* filename);
+
+// returns a CADSCENEFILE_ status like CSFile_loadExt,
+// all data is allocated from mem and the file is closed again
+int csfLoadGltf(CSFile** outcsf, const char* filename, CSFileMemoryPTR mem, uint32_t threads);
+
+// loads filename runs times through CSFile_loadExt and csfLoadGltf,
+// logs the average time of both and the resulting counts
+void csfGltfBenchmark(const char* filename, int runs, uint32_t threads);
+
+#endif
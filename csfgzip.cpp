@@ -0,0 +1,271 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+
+/* Contact ckubisch@nvidia.com (Christoph Kubisch) for feedback */
+
+#include "csfgzip.hpp"
+
+#include <nvh/filemapping.hpp>
+#include <nvh/nvprint.hpp>
+#include <nvh/parallel_work.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <zlib.h>
+
+// gzip member header with only FEXTRA set, the extra field holds
+// the "CS" subfield with the total member size
+static const size_t  GZ_HEADER_SIZE  = 20;
+static const size_t  GZ_TRAILER_SIZE = 8;
+static const uint8_t GZ_FLAG_EXTRA   = 4;
+
+// ISIZE is 32 bit, keep chunks well below
+static const size_t CHUNK_SIZE_MAX = size_t(1) << 30;
+
+struct GzMember
+{
+  size_t   inOffset;
+  size_t   inSize;   // raw deflate data
+  size_t   outOffset;
+  uint32_t outSize;
+  uint32_t crc;
+};
+
+static double getTimeMs()
+{
+  return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now().time_since_epoch()).count();
+}
+
+static inline uint32_t readU32(const uint8_t* data)
+{
+  return uint32_t(data[0]) | (uint32_t(data[1]) << 8) | (uint32_t(data[2]) << 16) | (uint32_t(data[3]) << 24);
+}
+
+static inline void writeU32(uint8_t* data, uint32_t value)
+{
+  data[0] = uint8_t(value);
+  data[1] = uint8_t(value >> 8);
+  data[2] = uint8_t(value >> 16);
+  data[3] = uint8_t(value >> 24);
+}
+
+static bool parseMembers(std::vector<GzMember>& members, const uint8_t* data, size_t size)
+{
+  size_t offset    = 0;
+  size_t outOffset = 0;
+  while(offset < size)
+  {
+    const uint8_t* header = data + offset;
+    if(size - offset < GZ_HEADER_SIZE + GZ_TRAILER_SIZE || header[0] != 0x1f || header[1] != 0x8b || header[2] != Z_DEFLATED
+       || header[3] != GZ_FLAG_EXTRA || header[10] != 8 || header[11] != 0 || header[12] != 'C' || header[13] != 'S'
+       || header[14] != 4 || header[15] != 0)
+    {
+      return false;
+    }
+
+    size_t memberSize = readU32(header + 16);
+    if(memberSize < GZ_HEADER_SIZE + GZ_TRAILER_SIZE || memberSize > size - offset)
+    {
+      return false;
+    }
+
+    const uint8_t* trailer = header + memberSize - GZ_TRAILER_SIZE;
+
+    GzMember member;
+    member.inOffset  = offset + GZ_HEADER_SIZE;
+    member.inSize    = memberSize - GZ_HEADER_SIZE - GZ_TRAILER_SIZE;
+    member.outOffset = outOffset;
+    member.crc       = readU32(trailer);
+    member.outSize   = readU32(trailer + 4);
+    members.push_back(member);
+
+    offset += memberSize;
+    outOffset += member.outSize;
+  }
+
+  return !members.empty();
+}
+
+static bool inflateMember(uint8_t* out, const uint8_t* in, const GzMember& member)
+{
+  z_stream zs;
+  memset(&zs, 0, sizeof(zs));
+  if(inflateInit2(&zs, -MAX_WBITS) != Z_OK)
+  {
+    return false;
+  }
+
+  zs.next_in   = (Bytef*)(in + member.inOffset);
+  zs.avail_in  = uInt(member.inSize);
+  zs.next_out  = (Bytef*)(out + member.outOffset);
+  zs.avail_out = uInt(member.outSize);
+
+  int  status = inflate(&zs, Z_FINISH);
+  bool valid  = status == Z_STREAM_END && zs.total_out == member.outSize;
+  inflateEnd(&zs);
+
+  return valid && crc32(0, (const Bytef*)(out + member.outOffset), uInt(member.outSize)) == member.crc;
+}
+
+bool csfLoadChunkedGz(CSFile** outcsf, const char* filename, CSFileMemoryPTR mem, uint32_t threads, int& result)
+{
+  nvh::FileReadMapping mapping;
+  if(!mapping.open(filename))
+  {
+    return false;
+  }
+
+  const uint8_t*        in = (const uint8_t*)mapping.data();
+  std::vector<GzMember> members;
+  if(!parseMembers(members, in, mapping.size()))
+  {
+    return false;
+  }
+
+  double timeBegin = getTimeMs();
+
+  size_t   outSize = members.back().outOffset + members.back().outSize;
+  uint8_t* out     = (uint8_t*)CSFileMemory_alloc(mem, outSize, nullptr);
+
+  // members never overlap in the output, so each is its own job
+  std::vector<uint8_t> valid(members.size(), 0);
+  nvh::parallel_batches<1>(
+      members.size(), [&](uint64_t i) { valid[i] = inflateMember(out, in, members[i]) ? 1 : 0; }, threads);
+
+  for(size_t i = 0; i < members.size(); i++)
+  {
+    if(!valid[i])
+    {
+      LOGW("gzip chunks: member %d of %s is corrupt\n", int(i), filename);
+      result = CADSCENEFILE_ERROR_OPERATION;
+      return true;
+    }
+  }
+
+  LOGI("gzip chunks: inflated %d members, %.2f MB in %8.2f ms\n", int(members.size()),
+       double(outSize) / (1024.0 * 1024.0), getTimeMs() - timeBegin);
+
+  result = CSFile_loadRaw(outcsf, outSize, out);
+  return true;
+}
+
+static void deflateMember(std::vector<uint8_t>& member, const uint8_t* data, size_t size, int level)
+{
+  z_stream zs;
+  memset(&zs, 0, sizeof(zs));
+  deflateInit2(&zs, level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+
+  member.resize(GZ_HEADER_SIZE + deflateBound(&zs, uLong(size)) + GZ_TRAILER_SIZE);
+
+  zs.next_in   = (Bytef*)data;
+  zs.avail_in  = uInt(size);
+  zs.next_out  = member.data() + GZ_HEADER_SIZE;
+  zs.avail_out = uInt(member.size() - GZ_HEADER_SIZE - GZ_TRAILER_SIZE);
+  deflate(&zs, Z_FINISH);
+  deflateEnd(&zs);
+
+  size_t memberSize = GZ_HEADER_SIZE + zs.total_out + GZ_TRAILER_SIZE;
+  member.resize(memberSize);
+
+  // mtime 0, xfl 0, os unknown, then XLEN and the "CS" subfield
+  static const uint8_t header[16] = {0x1f, 0x8b, Z_DEFLATED, GZ_FLAG_EXTRA, 0, 0, 0, 0, 0, 255, 8, 0, 'C', 'S', 4, 0};
+  memcpy(member.data(), header, sizeof(header));
+  writeU32(member.data() + 16, uint32_t(memberSize));
+
+  uint8_t* trailer = member.data() + memberSize - GZ_TRAILER_SIZE;
+  writeU32(trailer, uint32_t(crc32(0, (const Bytef*)data, uInt(size))));
+  writeU32(trailer + 4, uint32_t(size));
+}
+
+bool csfRepackChunkedGz(const char* srcFilename, const char* dstFilename, size_t chunkSize, int level, uint32_t threads)
+{
+  chunkSize = chunkSize < CHUNK_SIZE_MAX ? chunkSize : CHUNK_SIZE_MAX;
+  threads   = threads ? threads : 1;
+
+  // gzread passes uncompressed files through as is
+  gzFile src = gzopen(srcFilename, "rb");
+  if(!src)
+  {
+    return false;
+  }
+
+  FILE* dst = fopen(dstFilename, "wb");
+  if(!dst)
+  {
+    gzclose(src);
+    return false;
+  }
+
+  double timeBegin = getTimeMs();
+
+  // one chunk per thread in flight, written in order
+  std::vector<std::vector<uint8_t>> chunks(threads);
+  std::vector<std::vector<uint8_t>> members(threads);
+  std::vector<size_t>               chunkSizes(threads);
+
+  size_t totalIn  = 0;
+  size_t totalOut = 0;
+  bool   success  = true;
+  bool   finished = false;
+  while(success && !finished)
+  {
+    uint32_t numChunks = 0;
+    for(; numChunks < threads && !finished; numChunks++)
+    {
+      chunks[numChunks].resize(chunkSize);
+      int read = gzread(src, chunks[numChunks].data(), unsigned(chunkSize));
+      if(read < 0)
+      {
+        success = false;
+        break;
+      }
+      chunkSizes[numChunks] = size_t(read);
+      finished              = size_t(read) < chunkSize;
+    }
+    if(!success)
+      break;
+
+    nvh::parallel_batches<1>(
+        numChunks, [&](uint64_t i) { deflateMember(members[i], chunks[i].data(), chunkSizes[i], level); }, threads);
+
+    for(uint32_t i = 0; i < numChunks; i++)
+    {
+      // an empty last chunk only happens for sizes that are a multiple of chunkSize
+      if(!chunkSizes[i] && totalIn)
+        continue;
+
+      success = success && fwrite(members[i].data(), 1, members[i].size(), dst) == members[i].size();
+      totalIn += chunkSizes[i];
+      totalOut += members[i].size();
+    }
+  }
+
+  gzclose(src);
+  success = fclose(dst) == 0 && success;
+
+  if(success)
+  {
+    LOGI("gzip chunks: repacked %s, %.2f MB into %.2f MB in %8.2f ms\n", dstFilename, double(totalIn) / (1024.0 * 1024.0),
+         double(totalOut) / (1024.0 * 1024.0), getTimeMs() - timeBegin);
+  }
+  return success;
+}
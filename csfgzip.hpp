@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+
+/* Contact ckubisch@nvidia.com (Christoph Kubisch) for feedback */
+
+#ifndef CSFGZIP_H__
+#define CSFGZIP_H__
+
+#include <fileformats/cadscenefile.h>
+#include <cstddef>
+#include <cstdint>
+
+/*
+  Chunked .csf.gz layout that inflates on multiple threads.
+
+  The file is a regular multi-member gzip stream, so gunzip and the
+  single-stream CSFile_loadExt path still read it. Every member holds at
+  most one chunk of the raw .csf and stores its own compressed size in a
+  "CS" extra field of the gzip header (like BGZF), the uncompressed size
+  is the ISIZE of its trailer. Walking the headers gives every member's
+  input and output range without inflating anything, members are then
+  inflated concurrently straight into the final buffer.
+*/
+
+// returns false if filename is not in the chunked layout, the caller
+// should fall back to CSFile_loadExt then. Otherwise result holds the
+// CSFile_loadRaw status, the data is allocated from mem.
+bool csfLoadChunkedGz(CSFile** outcsf, const char* filename, CSFileMemoryPTR mem, uint32_t threads, int& result);
+
+// re-packs any .csf or .csf.gz into the chunked layout,
+// chunks are compressed in parallel
+bool csfRepackChunkedGz(const char* srcFilename, const char* dstFilename, size_t chunkSize, int level, uint32_t threads);
+
+#endif
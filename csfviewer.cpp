@@ -41,9 +41,15 @@
 #include "transformsystem.hpp"
 
 #include "cadscene.hpp"
+#include "csfgltf.hpp"
+#include "csfgzip.hpp"
+#include "matrixbatch.hpp"
 #include "renderer.hpp"
+#include "sceneanalysis.hpp"
 
 #include <algorithm>
+#include <cstdlib>
+#include <thread>
 
 #include "common.h"
 #include "glm/gtc/matrix_access.hpp"
@@ -123,6 +129,30 @@ public:
     int       zoom          = 100;
     int       msaa          = 0;
     bool      noUI          = false;
+    int       loadThreads   = int(std::thread::hardware_concurrency());
+    bool      loadMapped    = false;
+    bool      loadCache     = false;
+    bool      verifyCache   = false;
+    bool      compactVertex = false;
+    bool      arenaBuffers  = false;
+    bool      shortIndices  = false;
+    bool      meshOptimize  = false;
+    bool      meshOverdraw  = false;
+    bool      cloneInstance = false;
+    int       benchMatrices = 0;
+    bool      loadProgress  = false;
+    int       loadBudget    = 32;  // MB of vertex and index data per frame
+    bool      dedupScene    = false;
+    bool      flatObjects   = false;
+    int       benchFill     = 0;
+    int       benchSort     = 0;  // max draw items of the sort benchmark
+    int       partToggle    = 0;  // random part visibility flips per frame
+    bool      compactMats   = false;
+    bool      compactMatrix = false;
+    bool      doubleMatrix  = false;
+    int       gzipRepack    = 0;  // MB per member, re-packs a .csf.gz before loading
+    bool      gltfDirect    = false;
+    int       benchGltf     = 0;  // runs of both glTF load routes
   };
 
   nvgl::ProgramManager m_progManager;
@@ -143,19 +173,35 @@ public:
 
   std::vector<unsigned int> m_renderersSorted;
   std::string               m_rendererName;
+  std::string               m_analyzeFilename;
+  int                       m_analyzeResult = EXIT_SUCCESS;
 
   Renderer* NV_RESTRICT m_renderer;
   Resources             m_resources;
 
   size_t m_stateChangeID;
 
+  // last full renderer init while a progressive load was running
+  double m_progressInitTime = 0;
+
+  std::vector<uint32_t> m_dirtyObjects;
+  uint32_t              m_toggleSeed = 1;
+
 
   void updateProgramDefine();
   bool initProgram();
+  CadScene::LoadConfig getLoadConfig() const;
   bool initScene(const char* filename, int clones, int cloneaxis);
   bool initFramebuffers(int width, int height);
   void initRenderer(int type, Strategy strategy);
+  void logStrategy();
+  void rebaseCamera(const glm::dvec3& origin);
   void deinitRenderer();
+  void loadProgressive(double time);
+  void toggleParts(int count);
+  void updateDirtyObjects();
+  void repackModel(size_t chunkSize);
+  bool writeAnalysis();
 
   void getCullPrograms(CullingSystem::Programs& cullprograms);
   void getScanPrograms(ScanSystem::Programs& scanprograms);
@@ -179,6 +225,9 @@ public:
   void processUI(double time);
 
   nvh::CameraControl m_control;
+  // m_control works relative to this, with doublematrices it follows
+  // CadScene::m_renderOrigin so the float camera never sees large coordinates
+  glm::dvec3         m_cameraOrigin = glm::dvec3(0);
 
   void end() override { ImGui::ShutdownGL(); }
   // return true to prevent m_windowState updates
@@ -214,7 +263,13 @@ public:
   }
 };
 
-void Sample::updateProgramDefine() {}
+void Sample::updateProgramDefine()
+{
+  m_progManager.m_prepend = std::string("#define USE_COMPACTVERTEX ") + (m_tweak.compactVertex ? "1" : "0") + "\n"
+                           + "#define USE_INSTANCEDCLONES " + (m_tweak.cloneInstance ? "1" : "0") + "\n"
+                           + "#define USE_COMPACTMATERIAL " + (m_tweak.compactMats ? "1" : "0") + "\n"
+                           + "#define USE_COMPACTMATRIX " + (m_tweak.compactMatrix ? "1" : "0") + "\n";
+}
 
 void Sample::getTransformPrograms(TransformSystem::Programs& xformPrograms)
 {
@@ -325,6 +380,29 @@ bool Sample::initProgram()
   return validated;
 }
 
+CadScene::LoadConfig Sample::getLoadConfig() const
+{
+  CadScene::LoadConfig config;
+  config.threads          = m_tweak.loadThreads;
+  config.fileMapping      = m_tweak.loadMapped;
+  config.sceneCache       = m_tweak.loadCache;
+  config.sceneCacheVerify = m_tweak.verifyCache;
+  config.compactVertices  = m_tweak.compactVertex;
+  config.arenaBuffers     = m_tweak.arenaBuffers;
+  config.shortIndices     = m_tweak.shortIndices;
+  config.optimizeMeshes   = m_tweak.meshOptimize;
+  config.optimizeOverdraw = m_tweak.meshOverdraw;
+  config.instancedClones  = m_tweak.cloneInstance;
+  config.progressive      = m_tweak.loadProgress;
+  config.deduplicate      = m_tweak.dedupScene;
+  config.flatObjects      = m_tweak.flatObjects;
+  config.compactMaterials = m_tweak.compactMats;
+  config.compactMatrices  = m_tweak.compactMatrix;
+  config.doubleMatrices   = m_tweak.doubleMatrix;
+  config.gltfDirect       = m_tweak.gltfDirect;
+  return config;
+}
+
 bool Sample::initScene(const char* filename, int clones, int cloneaxis)
 {
   m_scene.unload();
@@ -348,13 +426,61 @@ bool Sample::initScene(const char* filename, int clones, int cloneaxis)
 
   m_resources.stateChangeID++;
 
-  bool status = m_scene.loadCSF(filename, clones, cloneaxis);
+  bool status = m_scene.loadCSF(filename, clones, cloneaxis, getLoadConfig());
+  if(status && m_scene.isLoading())
+  {
+    // renderers start out with the first batch instead of an empty scene
+    m_scene.loadProgressive(size_t(m_tweak.loadBudget) * 1024 * 1024);
+  }
 
   LOGI("\nscene %s\n", filename);
   LOGI("geometries: %6d\n", (uint32_t)m_scene.m_geometry.size());
-  LOGI("materials:  %6d\n", (uint32_t)m_scene.m_materials.size());
-  LOGI("nodes:      %6d\n", (uint32_t)m_scene.m_matrices.size());
+  LOGI("materials:  %6d (%.2f KB", (uint32_t)m_scene.m_materials.size(),
+       double(sizeof(CadScene::Material) * m_scene.m_materials.size()) / 1024.0);
+  if(m_scene.m_compactMaterials)
+  {
+    LOGI(", compact %.2f KB", double(sizeof(CadScene::MaterialCompact) * m_scene.m_materials.size()) / 1024.0);
+  }
+  LOGI(")\n");
+  LOGI("nodes:      %6d (%.2f KB", (uint32_t)m_scene.m_matrices.size(),
+       double(sizeof(CadScene::MatrixNode) * m_scene.m_matrices.size()) / 1024.0);
+  if(m_scene.m_compactMatrices)
+  {
+    LOGI(", compact %.2f KB", double(sizeof(CadScene::MatrixCompact) * m_scene.m_matrices.size()) / 1024.0);
+  }
+  LOGI(")\n");
   LOGI("objects:    %6d\n", (uint32_t)m_scene.m_objects.size());
+  if(m_scene.getNumInstances() > 1)
+  {
+    LOGI("instances:  %6d\n", m_scene.getNumInstances());
+  }
+
+  size_t numVertices = 0;
+  size_t numIndices  = 0;
+  size_t indexBytes  = 0;
+  for(const CadScene::Geometry& geom : m_scene.m_geometry)
+  {
+    if(geom.cloneIdx < 0)
+    {
+      numVertices += geom.numVertices;
+      numIndices += geom.numIndexSolid + geom.numIndexWire;
+      indexBytes += geom.iboSize;
+    }
+  }
+  size_t vertexBytes = numVertices * m_scene.getVertexSize();
+  size_t fullBytes   = numVertices * sizeof(CadScene::Vertex);
+  LOGI("vertices:   %6d (%.2f MB", (uint32_t)numVertices, double(vertexBytes) / (1024.0 * 1024.0));
+  if(m_scene.m_compactVertices)
+  {
+    LOGI(", compact saves %.2f MB", double(fullBytes - vertexBytes) / (1024.0 * 1024.0));
+  }
+  LOGI(")\n");
+  LOGI("indices:    %6d (%.2f MB", (uint32_t)numIndices, double(indexBytes) / (1024.0 * 1024.0));
+  if(m_tweak.shortIndices)
+  {
+    LOGI(", 16-bit saves %.2f MB", double(numIndices * sizeof(GLuint) - indexBytes) / (1024.0 * 1024.0));
+  }
+  LOGI(")\n");
   LOGI("\n");
 
   return status;
@@ -484,10 +610,142 @@ void Sample::initRenderer(int type, Strategy strategy)
   deinitRenderer();
   Renderer::getRegistry()[m_renderersSorted[type]]->updatedPrograms(m_progManager);
   m_renderer             = Renderer::getRegistry()[m_renderersSorted[type]]->create();
-  m_renderer->m_strategy = strategy;
+  m_renderer->m_strategy  = strategy;
+  m_renderer->m_costModel = &Renderer::getCostModel(Renderer::getRegistry()[m_renderersSorted[type]]->name());
   m_renderer->init(&m_scene, m_resources);
 }
 
+void Sample::logStrategy()
+{
+  if(m_tweak.strategy == STRATEGY_ADAPTIVE && !m_scene.isLoading())
+  {
+    Renderer::logAdaptiveStrategy(m_scene, *m_renderer->m_costModel);
+  }
+}
+
+void Sample::rebaseCamera(const glm::dvec3& origin)
+{
+  if(origin == m_cameraOrigin)
+    return;
+
+  // the same camera relative to the new origin, shifted in double before
+  // it is rounded to float again
+  glm::dvec3 delta = m_cameraOrigin - origin;
+  glm::dmat4 view  = glm::dmat4(m_control.m_viewMatrix);
+  view[3]          = view[3] - (view[0] * delta.x + view[1] * delta.y + view[2] * delta.z);
+
+  m_control.m_viewMatrix = glm::mat4(view);
+  m_control.m_sceneOrbit = glm::vec3(glm::dvec3(m_control.m_sceneOrbit) + delta);
+  m_cameraOrigin         = origin;
+}
+
+void Sample::loadProgressive(double time)
+{
+  size_t from = m_scene.getNumReadyObjects();
+  size_t to   = m_scene.loadProgressive(size_t(m_tweak.loadBudget) * 1024 * 1024);
+  if(from == to)
+    return;
+
+  bool   appended    = true;
+  size_t copyObjects = m_scene.getNumCopyObjects();
+  for(size_t c = 0; c < m_scene.m_objects.size() && appended; c += copyObjects)
+  {
+    appended = m_renderer->appendObjects(c + from, c + to);
+  }
+
+  // renderers with GPU side draw lists are rebuilt, but not every frame
+  if(!appended && (!m_scene.isLoading() || time - m_progressInitTime > 0.5))
+  {
+    initRenderer(m_tweak.renderer, m_tweak.strategy);
+    m_progressInitTime = time;
+  }
+
+  // only logs once the last objects became ready
+  logStrategy();
+}
+
+void Sample::toggleParts(int count)
+{
+  if(m_scene.m_objects.empty())
+    return;
+
+  for(int i = 0; i < count; i++)
+  {
+    m_toggleSeed    = m_toggleSeed * 1664525 + 1013904223;
+    size_t object   = (m_toggleSeed >> 8) % m_scene.m_objects.size();
+    size_t numParts = m_scene.getNumParts(object);
+    if(!numParts)
+      continue;
+
+    m_toggleSeed = m_toggleSeed * 1664525 + 1013904223;
+    size_t part  = (m_toggleSeed >> 8) % numParts;
+    m_scene.setPartActive(object, part, !m_scene.isPartActive(object, part));
+  }
+}
+
+void Sample::updateDirtyObjects()
+{
+  m_scene.updateDirtyObjects(m_dirtyObjects, m_tweak.loadThreads);
+  if(!m_renderer->updateObjects(m_dirtyObjects))
+  {
+    initRenderer(m_tweak.renderer, m_tweak.strategy);
+  }
+}
+
+void Sample::repackModel(size_t chunkSize)
+{
+  // foo.csf.gz becomes foo.chunked.csf.gz, which is loaded instead
+  const std::string suffix = ".csf.gz";
+  if(m_modelFilename.size() <= suffix.size()
+     || m_modelFilename.compare(m_modelFilename.size() - suffix.size(), suffix.size(), suffix) != 0)
+  {
+    LOGW("gzip chunks: only .csf.gz files can be repacked\n");
+    return;
+  }
+
+  std::string dstFilename = m_modelFilename.substr(0, m_modelFilename.size() - suffix.size()) + ".chunked" + suffix;
+  if(csfRepackChunkedGz(m_modelFilename.c_str(), dstFilename.c_str(), chunkSize, 6, uint32_t(std::max(1, m_tweak.loadThreads))))
+  {
+    m_modelFilename = dstFilename;
+  }
+  else
+  {
+    LOGW("gzip chunks: could not repack %s\n", m_modelFilename.c_str());
+  }
+}
+
+bool Sample::writeAnalysis()
+{
+  // runs from validateConfig, before any window or GL context exists
+  Renderer::s_fillThreads = uint32_t(std::max(1, m_tweak.loadThreads));
+  if(m_tweak.gzipRepack > 0)
+  {
+    repackModel(size_t(m_tweak.gzipRepack) * 1024 * 1024);
+  }
+
+  CadScene::LoadConfig config = getLoadConfig();
+  config.cpuOnly              = true;
+  if(!m_scene.loadCSF(m_modelFilename.c_str(), 0, 3, config))
+  {
+    LOGE("scene analysis: could not load %s\n", m_modelFilename.c_str());
+    return false;
+  }
+
+  SceneAnalysis analysis;
+  analyzeScene(analysis, m_scene, false);
+  m_scene.unload();
+
+  if(!writeSceneAnalysisJSON(analysis, m_analyzeFilename.c_str()))
+  {
+    LOGW("scene analysis: could not write %s\n", m_analyzeFilename.c_str());
+    return false;
+  }
+
+  LOGI("scene analysis: wrote %s, recommends %s with strategy %d\n", m_analyzeFilename.c_str(),
+       analysis.recommendedRenderer.c_str(), int(analysis.recommendedStrategy));
+  return true;
+}
+
 bool Sample::begin()
 {
   m_renderer      = NULL;
@@ -506,6 +764,7 @@ bool Sample::begin()
 
   Renderer::s_bindless_ubo = !!m_contextWindow.extensionSupported("GL_NV_uniform_buffer_unified_memory");
   LOGI("\nNV_uniform_buffer_unified_memory support: %s\n\n", Renderer::s_bindless_ubo ? "true" : "false");
+  Renderer::s_fillThreads = uint32_t(std::max(1, m_tweak.loadThreads));
 
   bool validated(true);
 
@@ -514,7 +773,27 @@ bool Sample::begin()
   glBindVertexArray(defaultVAO);
 
   validated = validated && initProgram();
+  if(m_tweak.gzipRepack > 0)
+  {
+    repackModel(size_t(m_tweak.gzipRepack) * 1024 * 1024);
+  }
   validated = validated && initScene(m_modelFilename.c_str(), 0, 3);
+  if(m_tweak.benchMatrices > 0)
+  {
+    matrixBatchBenchmark(size_t(m_tweak.benchMatrices), uint32_t(m_tweak.loadThreads));
+  }
+  if(m_tweak.benchGltf > 0)
+  {
+    csfGltfBenchmark(m_modelFilename.c_str(), m_tweak.benchGltf, uint32_t(m_tweak.loadThreads));
+  }
+  if(m_tweak.benchFill > 0)
+  {
+    Renderer::benchmarkFillDrawItems(m_scene, m_tweak.benchFill);
+  }
+  if(m_tweak.benchSort > 0)
+  {
+    Renderer::benchmarkSortDrawItems(m_scene, size_t(m_tweak.benchSort));
+  }
   validated = validated && initFramebuffers(m_windowState.m_winSize[0], m_windowState.m_winSize[1]);
 
 
@@ -548,6 +827,7 @@ bool Sample::begin()
     m_ui.enumAdd(GUI_STRATEGY, STRATEGY_INDIVIDUAL, "drawcall individual");
     m_ui.enumAdd(GUI_STRATEGY, STRATEGY_JOIN, "drawcall join");
     m_ui.enumAdd(GUI_STRATEGY, STRATEGY_GROUPS, "material groups");
+    m_ui.enumAdd(GUI_STRATEGY, STRATEGY_ADAPTIVE, "adaptive per object");
 
     m_ui.enumAdd(GUI_SHADE, SHADE_SOLID, toString(SHADE_SOLID));
     m_ui.enumAdd(GUI_SHADE, SHADE_SOLIDWIRE, toString(SHADE_SOLIDWIRE));
@@ -565,6 +845,11 @@ bool Sample::begin()
   m_control.m_viewMatrix =
       glm::lookAt(m_control.m_sceneOrbit - (-vec3(1, 1, 1) * m_control.m_sceneDimension * 0.5f * (float(m_tweak.zoom) / 100.0f)),
                       m_control.m_sceneOrbit, vec3(0, 1, 0));
+  m_cameraOrigin = glm::dvec3(0);
+  if(m_scene.m_doubleMatrices)
+  {
+    rebaseCamera(glm::dvec3(m_control.m_sceneOrbit));
+  }
 
   m_sceneUbo.wLightPos   = (m_scene.m_bbox.max + m_scene.m_bbox.min) * 0.5f + m_control.m_sceneDimension;
   m_sceneUbo.wLightPos.w = 1.0;
@@ -586,6 +871,7 @@ bool Sample::begin()
 
 
   initRenderer(m_tweak.renderer, m_tweak.strategy);
+  logStrategy();
 
   return validated;
 }
@@ -616,6 +902,7 @@ void Sample::processUI(double time)
     ImGui::Checkbox("clone X", &m_tweak.cloneaxisX);
     ImGui::Checkbox("clone Y", &m_tweak.cloneaxisY);
     ImGui::Checkbox("clone Z", &m_tweak.cloneaxisZ);
+    ImGuiH::InputIntClamped("part toggles", &m_tweak.partToggle, 0, 100000, 100, 1000, ImGuiInputTextFlags_EnterReturnsTrue);
     m_ui.enumCombobox(GUI_MSAA, "msaa", &m_tweak.msaa);
   }
   if(!m_tweak.cloneaxisX && !m_tweak.cloneaxisY && !m_tweak.cloneaxisZ)
@@ -680,9 +967,17 @@ void Sample::think(double time)
   if(m_tweak.clones != m_lastTweak.clones || m_tweak.cloneaxisX != m_lastTweak.cloneaxisX
      || m_tweak.cloneaxisY != m_lastTweak.cloneaxisY || m_tweak.cloneaxisZ != m_lastTweak.cloneaxisZ)
   {
+    int cloneaxis = (int(m_tweak.cloneaxisX) << 0) | (int(m_tweak.cloneaxisY) << 1) | (int(m_tweak.cloneaxisZ) << 2);
     deinitRenderer();
-    initScene(m_modelFilename.c_str(), m_tweak.clones,
-              (int(m_tweak.cloneaxisX) << 0) | (int(m_tweak.cloneaxisY) << 1) | (int(m_tweak.cloneaxisZ) << 2));
+    // the loaded geometry stays, only a full reload re-reads the file
+    if(m_scene.reclone(m_tweak.clones, cloneaxis, m_tweak.loadThreads))
+    {
+      m_resources.stateChangeID++;
+    }
+    else
+    {
+      initScene(m_modelFilename.c_str(), m_tweak.clones, cloneaxis);
+    }
   }
 
   if(m_tweak.renderer != m_lastTweak.renderer || m_tweak.strategy != m_lastTweak.strategy
@@ -690,6 +985,10 @@ void Sample::think(double time)
      || m_tweak.cloneaxisZ != m_lastTweak.cloneaxisZ || m_tweak.clones != m_lastTweak.clones)
   {
     initRenderer(m_tweak.renderer, m_tweak.strategy);
+    if(m_tweak.strategy != m_lastTweak.strategy || m_tweak.clones != m_lastTweak.clones)
+    {
+      logStrategy();
+    }
   }
 
   if(!m_tweak.animateActive && m_lastTweak.animateActive)
@@ -697,6 +996,36 @@ void Sample::think(double time)
     m_scene.resetMatrices();
   }
 
+  if(m_scene.isLoading())
+  {
+    loadProgressive(time);
+  }
+
+  if(m_tweak.partToggle > 0)
+  {
+    toggleParts(m_tweak.partToggle);
+  }
+
+  if(m_scene.hasDirtyObjects())
+  {
+    updateDirtyObjects();
+  }
+
+  if(m_scene.m_doubleMatrices)
+  {
+    // the float camera is relative to m_cameraOrigin, so the eye is exact in double.
+    // Rebasing converts every node, so only do it once the eye moved
+    // a good part of the scene away from the current origin
+    glm::dmat4 viewInv = glm::inverse(glm::dmat4(m_control.m_viewMatrix));
+    glm::dvec3 eye     = m_cameraOrigin + glm::dvec3(viewInv[3]);
+    m_scene.updateRelativeMatrices(eye, double(m_control.m_sceneDimension) * 0.25, m_tweak.loadThreads);
+    rebaseCamera(m_scene.m_renderOrigin);
+  }
+  else
+  {
+    rebaseCamera(glm::dvec3(0));
+  }
+
   m_lastTweak = m_tweak;
 
   int width  = m_windowState.m_winSize[0];
@@ -725,6 +1054,7 @@ void Sample::think(double time)
 
     glm::mat4 projection = glm::perspectiveRH_ZO((45.f), float(width) / float(height),
                                                   m_control.m_sceneDimension * 0.001f, m_control.m_sceneDimension * 10.0f);
+    // with doublematrices camera and world matrices share the render origin
     glm::mat4 view       = m_control.m_viewMatrix;
 
     m_sceneUbo.viewProjMatrix = projection * view;
@@ -737,7 +1067,10 @@ void Sample::think(double time)
     m_sceneUbo.wLightPos   = glm::row(m_sceneUbo.viewMatrixIT, 3);
     m_sceneUbo.wLightPos.w = 1.0;
 
-    m_sceneUbo.tboMatrices = uvec2(m_scene.m_matricesTexGLADDR & 0xFFFFFFFF, m_scene.m_matricesTexGLADDR >> 32);
+    // the indexed shaders only ever fetch one of the two layouts
+    GLuint64 tboMatricesADDR = m_scene.m_compactMatrices ? m_scene.m_matricesCompactTexGLADDR : m_scene.m_matricesTexGLADDR;
+    m_sceneUbo.tboMatrices   = uvec2(tboMatricesADDR & 0xFFFFFFFF, tboMatricesADDR >> 32);
+    m_sceneUbo.tboInstances = uvec2(m_scene.m_instancesTexGLADDR & 0xFFFFFFFF, m_scene.m_instancesTexGLADDR >> 32);
 
     glNamedBufferSubData(buffers.scene_ubo, 0, sizeof(SceneData), &m_sceneUbo);
 
@@ -787,7 +1120,19 @@ void Sample::think(double time)
       object.offset = 0;
       object.size   = sizeof(CadScene::MatrixNode) * m_scene.m_matrices.size();
 
-      m_transformSystem.process(m_scene.m_nodeTree, ids, object, world);
+      if(m_scene.m_compactMatrices)
+      {
+        TransformSystem::Buffer compact;
+        compact.buffer = m_scene.m_matricesCompactGL;
+        compact.offset = 0;
+        compact.size   = sizeof(CadScene::MatrixCompact) * m_scene.m_matrices.size();
+
+        m_transformSystem.process(m_scene.m_nodeTree, ids, object, world, &compact);
+      }
+      else
+      {
+        m_transformSystem.process(m_scene.m_nodeTree, ids, object, world);
+      }
     }
   }
 
@@ -908,6 +1253,31 @@ void Sample::setupConfigParameters()
   m_parameterList.add("clones", &m_tweak.clones);
   m_parameterList.add("xplode", &m_tweak.animateActive);
   m_parameterList.add("zoom", &m_tweak.zoom);
+  m_parameterList.add("loadthreads", &m_tweak.loadThreads);
+  m_parameterList.add("loadmapped", &m_tweak.loadMapped);
+  m_parameterList.add("scenecache", &m_tweak.loadCache);
+  m_parameterList.add("scenecacheverify", &m_tweak.verifyCache);
+  m_parameterList.add("compactvertex", &m_tweak.compactVertex);
+  m_parameterList.add("arenabuffers", &m_tweak.arenaBuffers);
+  m_parameterList.add("shortindices", &m_tweak.shortIndices);
+  m_parameterList.add("meshopt", &m_tweak.meshOptimize);
+  m_parameterList.add("meshoptoverdraw", &m_tweak.meshOverdraw);
+  m_parameterList.add("instancedclones", &m_tweak.cloneInstance);
+  m_parameterList.add("benchmatrices", &m_tweak.benchMatrices);
+  m_parameterList.add("loadprogressive", &m_tweak.loadProgress);
+  m_parameterList.add("loadbudget", &m_tweak.loadBudget);
+  m_parameterList.add("dedup", &m_tweak.dedupScene);
+  m_parameterList.add("flatobjects", &m_tweak.flatObjects);
+  m_parameterList.add("benchfill", &m_tweak.benchFill);
+  m_parameterList.add("benchsort", &m_tweak.benchSort);
+  m_parameterList.add("parttoggle", &m_tweak.partToggle);
+  m_parameterList.add("compactmaterials", &m_tweak.compactMats);
+  m_parameterList.add("compactmatrices", &m_tweak.compactMatrix);
+  m_parameterList.add("doublematrices", &m_tweak.doubleMatrix);
+  m_parameterList.add("gziprepack", &m_tweak.gzipRepack);
+  m_parameterList.add("gltfdirect", &m_tweak.gltfDirect);
+  m_parameterList.add("benchgltf", &m_tweak.benchGltf);
+  m_parameterList.add("analyze", &m_analyzeFilename);
 }
 
 
@@ -920,6 +1290,12 @@ bool Sample::validateConfig()
     m_parameterList.print();
     return false;
   }
+  if(!m_analyzeFilename.empty())
+  {
+    // headless analysis run, returning false skips the window and GL setup
+    m_analyzeResult = writeAnalysis() ? EXIT_SUCCESS : EXIT_FAILURE;
+    return false;
+  }
   return true;
 }
 
@@ -941,5 +1317,6 @@ int main(int argc, const char** argv)
     sample.m_modelFilename = nvh::findFile(std::string("geforce.csf.gz"), directories);
   }
 
-  return sample.run(PROJECT_NAME, argc, argv, SAMPLE_SIZE_WIDTH, SAMPLE_SIZE_HEIGHT);
+  int result = sample.run(PROJECT_NAME, argc, argv, SAMPLE_SIZE_WIDTH, SAMPLE_SIZE_HEIGHT);
+  return sample.m_analyzeFilename.empty() ? result : sample.m_analyzeResult;
 }
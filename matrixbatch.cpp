@@ -0,0 +1,269 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+
+/* Contact ckubisch@nvidia.com (Christoph Kubisch) for feedback */
+
+#include "matrixbatch.hpp"
+
+#include <nvh/nvprint.hpp>
+#include <nvh/parallel_work.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <vector>
+#include "glm/gtc/type_ptr.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MATRIXBATCH_SSE 1
+#include <emmintrin.h>
+#else
+#define MATRIXBATCH_SSE 0
+#endif
+
+static double getTimeMs()
+{
+  return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now().time_since_epoch()).count();
+}
+
+static inline bool isAffine(const glm::mat4& m)
+{
+  return m[0].w == 0.0f && m[1].w == 0.0f && m[2].w == 0.0f && m[3].w == 1.0f;
+}
+
+#if MATRIXBATCH_SSE
+
+// (y,z,x,w) lane rotation, w stays in place so cross() keeps w = 0
+#define MATRIXBATCH_YZX(v) _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 0, 2, 1))
+
+static inline __m128 cross(__m128 a, __m128 b)
+{
+  __m128 r = _mm_sub_ps(_mm_mul_ps(a, MATRIXBATCH_YZX(b)), _mm_mul_ps(MATRIXBATCH_YZX(a), b));
+  return MATRIXBATCH_YZX(r);
+}
+
+static inline __m128 dot(__m128 a, __m128 b)
+{
+  __m128 m = _mm_mul_ps(a, b);
+  m        = _mm_add_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(2, 3, 0, 1)));
+  m        = _mm_add_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(1, 0, 3, 2)));
+  return m;
+}
+
+// in must be affine, columns 0..2 have w = 0, column 3 has w = 1
+static inline void affineInverseTranspose(const glm::mat4& in, glm::mat4& out)
+{
+  const float* src = glm::value_ptr(in);
+  float*       dst = glm::value_ptr(out);
+
+  __m128 a0 = _mm_loadu_ps(src + 0);
+  __m128 a1 = _mm_loadu_ps(src + 4);
+  __m128 a2 = _mm_loadu_ps(src + 8);
+  __m128 t  = _mm_loadu_ps(src + 12);
+
+  // rows of the inverse 3x3 scaled by det, columns of the inverse transpose
+  __m128 c0 = cross(a1, a2);
+  __m128 c1 = cross(a2, a0);
+  __m128 c2 = cross(a0, a1);
+
+  __m128 invDet = _mm_div_ps(_mm_set1_ps(1.0f), dot(a0, c0));
+  c0            = _mm_mul_ps(c0, invDet);
+  c1            = _mm_mul_ps(c1, invDet);
+  c2            = _mm_mul_ps(c2, invDet);
+
+  // -inverse(A) * t goes into the last row, c.w is 0 so t.w drops out
+  __m128 d0 = dot(c0, t);
+  __m128 d1 = dot(c1, t);
+  __m128 d2 = dot(c2, t);
+
+  // (d0,d0,d1,d1) and (d2,d2,0,0) -> (d0,d1,d2,0) negated
+  __m128 d01  = _mm_unpacklo_ps(d0, d1);
+  __m128 d2z  = _mm_unpacklo_ps(d2, _mm_setzero_ps());
+  __m128 last = _mm_sub_ps(_mm_setzero_ps(), _mm_movelh_ps(d01, d2z));
+
+  // transpose-free insertion of the w lanes: (c.xyz, last[i])
+  __m128 c0zw = _mm_unpackhi_ps(c0, _mm_shuffle_ps(last, last, _MM_SHUFFLE(0, 0, 0, 0)));
+  __m128 c1zw = _mm_unpackhi_ps(c1, _mm_shuffle_ps(last, last, _MM_SHUFFLE(1, 1, 1, 1)));
+  __m128 c2zw = _mm_unpackhi_ps(c2, _mm_shuffle_ps(last, last, _MM_SHUFFLE(2, 2, 2, 2)));
+
+  _mm_storeu_ps(dst + 0, _mm_movelh_ps(c0, c0zw));
+  _mm_storeu_ps(dst + 4, _mm_movelh_ps(c1, c1zw));
+  _mm_storeu_ps(dst + 8, _mm_movelh_ps(c2, c2zw));
+  _mm_storeu_ps(dst + 12, _mm_set_ps(1.0f, 0.0f, 0.0f, 0.0f));
+}
+
+#else
+
+static inline void affineInverseTranspose(const glm::mat4& in, glm::mat4& out)
+{
+  glm::vec3 a0(in[0]);
+  glm::vec3 a1(in[1]);
+  glm::vec3 a2(in[2]);
+  glm::vec3 t(in[3]);
+
+  glm::vec3 c0 = glm::cross(a1, a2);
+  glm::vec3 c1 = glm::cross(a2, a0);
+  glm::vec3 c2 = glm::cross(a0, a1);
+
+  float invDet = 1.0f / glm::dot(a0, c0);
+  c0 *= invDet;
+  c1 *= invDet;
+  c2 *= invDet;
+
+  out[0] = glm::vec4(c0, -glm::dot(c0, t));
+  out[1] = glm::vec4(c1, -glm::dot(c1, t));
+  out[2] = glm::vec4(c2, -glm::dot(c2, t));
+  out[3] = glm::vec4(0, 0, 0, 1);
+}
+
+#endif
+
+static inline void inverseTranspose(const glm::mat4& in, glm::mat4& out)
+{
+  if(isAffine(in))
+  {
+    affineInverseTranspose(in, out);
+  }
+  else
+  {
+    out = glm::transpose(glm::inverse(in));
+  }
+}
+
+static void inverseTransposeRange(CadScene::MatrixNode* nodes, size_t begin, size_t end)
+{
+  for(size_t i = begin; i < end; i++)
+  {
+    CadScene::MatrixNode& node = nodes[i];
+    inverseTranspose(node.worldMatrix, node.worldMatrixIT);
+    inverseTranspose(node.objectMatrix, node.objectMatrixIT);
+  }
+}
+
+void matrixBatchInverseTranspose(CadScene::MatrixNode* nodes, size_t count, uint32_t threads)
+{
+  // below this a thread costs more than the work
+  const size_t minPerThread = 4096;
+
+  threads = std::min(threads, uint32_t((count + minPerThread - 1) / minPerThread));
+  if(threads > 1)
+  {
+    nvh::parallel_ranges(
+        count, [&](uint64_t itemBegin, uint64_t itemEnd, uint32_t threadIdx) {
+          inverseTransposeRange(nodes, size_t(itemBegin), size_t(itemEnd));
+        },
+        threads);
+  }
+  else
+  {
+    inverseTransposeRange(nodes, 0, count);
+  }
+}
+
+static void worldInverseTransposeRange(CadScene::MatrixNode* nodes, const uint32_t* indices, size_t begin, size_t end)
+{
+  for(size_t i = begin; i < end; i++)
+  {
+    CadScene::MatrixNode& node = nodes[indices[i]];
+    inverseTranspose(node.worldMatrix, node.worldMatrixIT);
+  }
+}
+
+void matrixBatchWorldInverseTranspose(CadScene::MatrixNode* nodes, const uint32_t* indices, size_t count, uint32_t threads)
+{
+  // below this a thread costs more than the work, only one matrix per node
+  const size_t minPerThread = 8192;
+
+  threads = std::min(threads, uint32_t((count + minPerThread - 1) / minPerThread));
+  if(threads > 1)
+  {
+    nvh::parallel_ranges(
+        count, [&](uint64_t itemBegin, uint64_t itemEnd, uint32_t threadIdx) {
+          worldInverseTransposeRange(nodes, indices, size_t(itemBegin), size_t(itemEnd));
+        },
+        threads);
+  }
+  else
+  {
+    worldInverseTransposeRange(nodes, indices, 0, count);
+  }
+}
+
+void matrixBatchInverseTransposeGLM(CadScene::MatrixNode* nodes, size_t count)
+{
+  for(size_t i = 0; i < count; i++)
+  {
+    CadScene::MatrixNode& node = nodes[i];
+    node.worldMatrixIT         = glm::transpose(glm::inverse(node.worldMatrix));
+    node.objectMatrixIT        = glm::transpose(glm::inverse(node.objectMatrix));
+  }
+}
+
+void matrixBatchBenchmark(size_t count, uint32_t threads)
+{
+  std::vector<CadScene::MatrixNode> nodesGLM(count);
+
+  std::mt19937                          rng(1234);
+  std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+  for(size_t i = 0; i < count; i++)
+  {
+    CadScene::MatrixNode& node = nodesGLM[i];
+    // rotation-like 3x3 with non-uniform scale, keeps determinants away from 0
+    for(int c = 0; c < 3; c++)
+    {
+      node.worldMatrix[c]    = glm::vec4(dist(rng), dist(rng), dist(rng), 0);
+      node.worldMatrix[c][c] = 2.0f + float(c) + dist(rng);
+    }
+    node.worldMatrix[3] = glm::vec4(dist(rng) * 100.0f, dist(rng) * 100.0f, dist(rng) * 100.0f, 1);
+    node.objectMatrix   = node.worldMatrix;
+  }
+  std::vector<CadScene::MatrixNode> nodesBatch = nodesGLM;
+  std::vector<CadScene::MatrixNode> nodesMT    = nodesGLM;
+
+  double timeBegin = getTimeMs();
+  matrixBatchInverseTransposeGLM(nodesGLM.data(), count);
+  double timeGLM = getTimeMs();
+  matrixBatchInverseTranspose(nodesBatch.data(), count, 1);
+  double timeBatch = getTimeMs();
+  matrixBatchInverseTranspose(nodesMT.data(), count, threads);
+  double timeMT = getTimeMs();
+
+  float maxError = 0;
+  for(size_t i = 0; i < count; i++)
+  {
+    const float* ref  = glm::value_ptr(nodesGLM[i].worldMatrixIT);
+    const float* test = glm::value_ptr(nodesBatch[i].worldMatrixIT);
+    const float* mt   = glm::value_ptr(nodesMT[i].worldMatrixIT);
+    for(int k = 0; k < 16; k++)
+    {
+      float scale = std::max(1.0f, std::abs(ref[k]));
+      maxError    = std::max(maxError, std::abs(ref[k] - test[k]) / scale);
+      maxError    = std::max(maxError, std::abs(ref[k] - mt[k]) / scale);
+    }
+  }
+
+  LOGI("matrix inverse-transpose benchmark: %d nodes (2 matrices each), %s\n", uint32_t(count),
+       MATRIXBATCH_SSE ? "sse" : "scalar");
+  LOGI("  glm           %8.2f ms\n", timeGLM - timeBegin);
+  LOGI("  batch         %8.2f ms  %5.2fx\n", timeBatch - timeGLM, (timeGLM - timeBegin) / std::max(timeBatch - timeGLM, 0.001));
+  LOGI("  batch %2d thr  %8.2f ms  %5.2fx\n", threads, timeMT - timeBatch, (timeGLM - timeBegin) / std::max(timeMT - timeBatch, 0.001));
+  LOGI("  max rel error %e\n", maxError);
+}
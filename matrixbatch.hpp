@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+
+/* Contact ckubisch@nvidia.com (Christoph Kubisch) for feedback */
+
+#ifndef MATRIXBATCH_H__
+#define MATRIXBATCH_H__
+
+#include "cadscene.hpp"
+
+/*
+  Batched worldMatrixIT / objectMatrixIT computation for MatrixNodes.
+
+  Matrices with a (0,0,0,1) last row take the affine path, the inverse
+  transpose of the upper 3x3 is its cofactor matrix divided by the
+  determinant and the translation ends up in the last row. Uses SSE when
+  available, other matrices fall back to glm::transpose(glm::inverse()).
+*/
+
+// updates the IT matrices of nodes [0, count), threads > 1 splits into ranges
+void matrixBatchInverseTranspose(CadScene::MatrixNode* nodes, size_t count, uint32_t threads = 1);
+
+// only worldMatrixIT of the nodes listed in indices, for sparse updates
+// like CadScene::updateRelativeMatrices where objectMatrix did not change
+void matrixBatchWorldInverseTranspose(CadScene::MatrixNode* nodes, const uint32_t* indices, size_t count, uint32_t threads = 1);
+
+// reference path, per matrix glm::transpose(glm::inverse())
+void matrixBatchInverseTransposeGLM(CadScene::MatrixNode* nodes, size_t count);
+
+// times both paths on count random affine nodes and logs results and max error
+void matrixBatchBenchmark(size_t count, uint32_t threads);
+
+#endif
@@ -0,0 +1,420 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+
+/* Contact ckubisch@nvidia.com (Christoph Kubisch) for feedback */
+
+#include "meshoptimizer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// Forsyth, "Linear-Speed Vertex Cache Optimisation"
+// the modeled LRU cache is larger than the FIFO used for the statistics,
+// which only steers the scoring and is not meant to match hardware
+static const int   FORSYTH_CACHE_SIZE    = 32;
+static const float FORSYTH_DECAY_POWER   = 1.5f;
+static const float FORSYTH_LAST_TRI      = 0.75f;
+static const float FORSYTH_VALENCE_SCALE = 2.0f;
+static const float FORSYTH_VALENCE_POWER = 0.5f;
+
+static float vertexScore(int cachePos, int remaining)
+{
+  if(remaining == 0)
+  {
+    return -1.0f;
+  }
+
+  float score = 0.0f;
+  if(cachePos >= 0)
+  {
+    if(cachePos < 3)
+    {
+      // the vertices of the last triangle get a fixed score,
+      // so its neighbors are not always preferred
+      score = FORSYTH_LAST_TRI;
+    }
+    else
+    {
+      float scaler = 1.0f / float(FORSYTH_CACHE_SIZE - 3);
+      score        = powf(1.0f - float(cachePos - 3) * scaler, FORSYTH_DECAY_POWER);
+    }
+  }
+
+  // boost vertices with few remaining triangles to finish them off
+  score += FORSYTH_VALENCE_SCALE * powf(float(remaining), -FORSYTH_VALENCE_POWER);
+  return score;
+}
+
+MeshOptimizer::CacheStats MeshOptimizer::computeCacheStats(const GLuint* indices, size_t numIndices, size_t numVertices, int cacheSize)
+{
+  CacheStats stats;
+  stats.triangles = numIndices / 3;
+  if(!stats.triangles)
+  {
+    return stats;
+  }
+
+  std::vector<uint32_t> stamps(numVertices, 0);
+  uint32_t              time       = uint32_t(cacheSize) + 1;
+  size_t                misses     = 0;
+  size_t                referenced = 0;
+
+  for(size_t i = 0; i < stats.triangles * 3; i++)
+  {
+    GLuint v = indices[i];
+    if(!stamps[v])
+    {
+      referenced++;
+    }
+    if(time - stamps[v] > uint32_t(cacheSize))
+    {
+      stamps[v] = time++;
+      misses++;
+    }
+  }
+
+  stats.acmr = double(misses) / double(stats.triangles);
+  stats.atvr = double(misses) / double(referenced);
+  return stats;
+}
+
+void MeshOptimizer::optimizeVertexFetch(CadScene::Vertex* vertices, size_t numVertices, GLuint* indices, size_t numIndices)
+{
+  const GLuint        unused = ~GLuint(0);
+  std::vector<GLuint> remap(numVertices, unused);
+
+  GLuint next = 0;
+  for(size_t i = 0; i < numIndices; i++)
+  {
+    GLuint& idx = indices[i];
+    if(remap[idx] == unused)
+    {
+      remap[idx] = next++;
+    }
+    idx = remap[idx];
+  }
+
+  for(size_t v = 0; v < numVertices; v++)
+  {
+    if(remap[v] == unused)
+    {
+      remap[v] = next++;
+    }
+  }
+
+  std::vector<CadScene::Vertex> reordered(numVertices);
+  for(size_t v = 0; v < numVertices; v++)
+  {
+    reordered[remap[v]] = vertices[v];
+  }
+  memcpy(vertices, reordered.data(), sizeof(CadScene::Vertex) * numVertices);
+}
+
+void MeshOptimizer::resize(size_t numVertices)
+{
+  if(m_cachePos.size() < numVertices)
+  {
+    // all per-vertex state is returned to these values after each range
+    m_cachePos.resize(numVertices, -1);
+    m_remaining.resize(numVertices, 0);
+    m_adjOffset.resize(numVertices, 0);
+    m_vertexScore.resize(numVertices, 0.0f);
+    m_stamps.resize(numVertices, 0);
+  }
+}
+
+void MeshOptimizer::optimizeVertexCache(GLuint* indices, size_t numIndices, size_t numVertices)
+{
+  size_t numTris = numIndices / 3;
+  if(numTris < 2)
+  {
+    return;
+  }
+
+  resize(numVertices);
+
+  // triangle adjacency per vertex, only the first m_remaining[v]
+  // entries starting at m_adjOffset[v] are still to be emitted
+  m_touched.clear();
+  for(size_t i = 0; i < numTris * 3; i++)
+  {
+    GLuint v = indices[i];
+    if(!m_remaining[v])
+    {
+      m_touched.push_back(v);
+    }
+    m_remaining[v]++;
+  }
+
+  int offset = 0;
+  for(GLuint v : m_touched)
+  {
+    m_adjOffset[v] = offset;
+    offset += m_remaining[v];
+  }
+
+  m_adjacency.resize(numTris * 3);
+  for(size_t i = 0; i < numTris * 3; i++)
+  {
+    m_adjacency[m_adjOffset[indices[i]]++] = int(i / 3);
+  }
+  for(GLuint v : m_touched)
+  {
+    m_adjOffset[v] -= m_remaining[v];
+    m_vertexScore[v] = vertexScore(-1, m_remaining[v]);
+  }
+
+  m_triScore.resize(numTris);
+  m_triEmitted.assign(numTris, 0);
+
+  int   best      = -1;
+  float bestScore = -1.0f;
+  for(size_t t = 0; t < numTris; t++)
+  {
+    m_triScore[t] = m_vertexScore[indices[t * 3 + 0]] + m_vertexScore[indices[t * 3 + 1]] + m_vertexScore[indices[t * 3 + 2]];
+    if(m_triScore[t] > bestScore)
+    {
+      bestScore = m_triScore[t];
+      best      = int(t);
+    }
+  }
+
+  int cache[FORSYTH_CACHE_SIZE + 3];
+  int cacheCount = 0;
+
+  m_output.resize(numTris * 3);
+  size_t scan = 0;
+
+  for(size_t n = 0; n < numTris; n++)
+  {
+    if(best < 0)
+    {
+      // nothing adjacent to the cache, continue with the next remaining triangle
+      while(m_triEmitted[scan])
+      {
+        scan++;
+      }
+      best = int(scan);
+    }
+
+    const GLuint* tri = indices + size_t(best) * 3;
+    m_triEmitted[best] = 1;
+    m_output[n * 3 + 0] = tri[0];
+    m_output[n * 3 + 1] = tri[1];
+    m_output[n * 3 + 2] = tri[2];
+
+    for(int k = 0; k < 3; k++)
+    {
+      GLuint v    = tri[k];
+      int*   list = &m_adjacency[m_adjOffset[v]];
+      int    last = m_remaining[v] - 1;
+      for(int a = 0; a <= last; a++)
+      {
+        if(list[a] == best)
+        {
+          std::swap(list[a], list[last]);
+          break;
+        }
+      }
+      m_remaining[v]--;
+    }
+
+    // emitted vertices move to the front, the rest keeps its order
+    int newCache[FORSYTH_CACHE_SIZE + 3];
+    int newCount = 0;
+    for(int k = 0; k < 3; k++)
+    {
+      if(std::find(newCache, newCache + newCount, int(tri[k])) == newCache + newCount)
+      {
+        newCache[newCount++] = int(tri[k]);
+      }
+    }
+    for(int i = 0; i < cacheCount; i++)
+    {
+      if(cache[i] != int(tri[0]) && cache[i] != int(tri[1]) && cache[i] != int(tri[2]))
+      {
+        newCache[newCount++] = cache[i];
+      }
+    }
+
+    // entries past the cache size were just evicted, their scores drop as well
+    for(int i = 0; i < newCount; i++)
+    {
+      int v         = newCache[i];
+      m_cachePos[v] = i < FORSYTH_CACHE_SIZE ? i : -1;
+
+      float score = vertexScore(m_cachePos[v], m_remaining[v]);
+      float delta = score - m_vertexScore[v];
+      const int* list = &m_adjacency[m_adjOffset[v]];
+      for(int a = 0; a < m_remaining[v]; a++)
+      {
+        m_triScore[list[a]] += delta;
+      }
+      m_vertexScore[v] = score;
+    }
+
+    cacheCount = std::min(newCount, FORSYTH_CACHE_SIZE);
+    memcpy(cache, newCache, sizeof(int) * cacheCount);
+
+    best      = -1;
+    bestScore = -1.0f;
+    for(int i = 0; i < cacheCount; i++)
+    {
+      int        v    = cache[i];
+      const int* list = &m_adjacency[m_adjOffset[v]];
+      for(int a = 0; a < m_remaining[v]; a++)
+      {
+        if(m_triScore[list[a]] > bestScore)
+        {
+          bestScore = m_triScore[list[a]];
+          best      = list[a];
+        }
+      }
+    }
+  }
+
+  for(GLuint v : m_touched)
+  {
+    m_cachePos[v] = -1;
+  }
+
+  memcpy(indices, m_output.data(), sizeof(GLuint) * numTris * 3);
+}
+
+int MeshOptimizer::simulateMisses(const GLuint* tri)
+{
+  int misses = 0;
+  for(int k = 0; k < 3; k++)
+  {
+    GLuint v = tri[k];
+    if(m_time - m_stamps[v] > uint32_t(STATS_CACHE_SIZE))
+    {
+      m_stamps[v] = m_time++;
+      misses++;
+    }
+  }
+  return misses;
+}
+
+void MeshOptimizer::optimizeOverdraw(GLuint* indices, size_t numIndices, const CadScene::Vertex* vertices, size_t numVertices, float threshold)
+{
+  size_t numTris = numIndices / 3;
+  if(numTris < 2)
+  {
+    return;
+  }
+
+  resize(numVertices);
+
+  // flush the simulated cache from previous ranges
+  m_time += STATS_CACHE_SIZE + 1;
+
+  size_t totalMisses = 0;
+  for(size_t t = 0; t < numTris; t++)
+  {
+    totalMisses += simulateMisses(indices + t * 3);
+  }
+  double acmrLimit = threshold * double(totalMisses) / double(numTris);
+
+  // a triangle that misses all its vertices is a natural restart point,
+  // only split there if the current cluster stayed within the limit
+  std::vector<size_t> clusterBegins;
+  clusterBegins.push_back(0);
+
+  m_time += STATS_CACHE_SIZE + 1;
+
+  size_t clusterMisses = 0;
+  size_t clusterTris   = 0;
+  for(size_t t = 0; t < numTris; t++)
+  {
+    int misses = simulateMisses(indices + t * 3);
+    if(misses == 3 && clusterTris && double(clusterMisses) / double(clusterTris) <= acmrLimit)
+    {
+      clusterBegins.push_back(t);
+      clusterMisses = 0;
+      clusterTris   = 0;
+    }
+    clusterMisses += misses;
+    clusterTris++;
+  }
+
+  size_t numClusters = clusterBegins.size();
+  if(numClusters < 2)
+  {
+    return;
+  }
+  clusterBegins.push_back(numTris);
+
+  // area weighted centroid and average normal per cluster
+  std::vector<glm::vec3> centroids(numClusters);
+  std::vector<glm::vec3> normals(numClusters);
+  glm::vec3              meshCentroid(0.0f);
+  float                  meshArea = 0.0f;
+
+  for(size_t c = 0; c < numClusters; c++)
+  {
+    glm::vec3 centroid(0.0f);
+    glm::vec3 normal(0.0f);
+    float     area = 0.0f;
+    for(size_t t = clusterBegins[c]; t < clusterBegins[c + 1]; t++)
+    {
+      glm::vec3 p0 = glm::vec3(vertices[indices[t * 3 + 0]].position);
+      glm::vec3 p1 = glm::vec3(vertices[indices[t * 3 + 1]].position);
+      glm::vec3 p2 = glm::vec3(vertices[indices[t * 3 + 2]].position);
+
+      glm::vec3 cross   = glm::cross(p1 - p0, p2 - p0);
+      float     triArea = glm::length(cross);
+
+      centroid += (p0 + p1 + p2) * (triArea / 3.0f);
+      normal += cross;
+      area += triArea;
+    }
+
+    centroids[c] = area > 0 ? centroid / area : glm::vec3(vertices[indices[clusterBegins[c] * 3]].position);
+    normals[c]   = normal;
+
+    meshCentroid += centroid;
+    meshArea += area;
+  }
+  meshCentroid = meshArea > 0 ? meshCentroid / meshArea : centroids[0];
+
+  // clusters facing away from the center are likely in front, draw them first
+  std::vector<float>  sortKeys(numClusters);
+  std::vector<size_t> order(numClusters);
+  for(size_t c = 0; c < numClusters; c++)
+  {
+    float len   = glm::length(normals[c]);
+    sortKeys[c] = len > 0 ? glm::dot(centroids[c] - meshCentroid, normals[c] / len) : 0.0f;
+    order[c]    = c;
+  }
+  std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return sortKeys[a] > sortKeys[b]; });
+
+  m_output.resize(numTris * 3);
+  size_t out = 0;
+  for(size_t c : order)
+  {
+    size_t count = (clusterBegins[c + 1] - clusterBegins[c]) * 3;
+    memcpy(&m_output[out], indices + clusterBegins[c] * 3, sizeof(GLuint) * count);
+    out += count;
+  }
+
+  memcpy(indices, m_output.data(), sizeof(GLuint) * numTris * 3);
+}
@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+
+/* Contact ckubisch@nvidia.com (Christoph Kubisch) for feedback */
+
+#ifndef MESHOPTIMIZER_H__
+#define MESHOPTIMIZER_H__
+
+#include <vector>
+#include "cadscene.hpp"
+
+/*
+  Load-time reordering of triangle lists for the post-transform vertex cache
+  (Forsyth's linear-speed optimizer), optional cluster sorting to reduce
+  overdraw, and vertex fetch reordering by first use.
+
+  Triangles only move within the index range passed in, callers run it per
+  part so part boundaries and all DrawRanges stay valid.
+
+  Not thread-safe per instance, use one MeshOptimizer per worker.
+*/
+
+class MeshOptimizer {
+public:
+  struct CacheStats {
+    double  acmr;       // transformed vertices per triangle
+    double  atvr;       // transformed vertices per referenced vertex
+    size_t  triangles;
+
+    CacheStats() : acmr(0), atvr(0), triangles(0) {}
+  };
+
+  // FIFO size used for the statistics, typical for current hardware
+  static const int STATS_CACHE_SIZE = 16;
+
+  static CacheStats computeCacheStats(const GLuint* indices, size_t numIndices, size_t numVertices, int cacheSize = STATS_CACHE_SIZE);
+
+  // reorders vertices by first use within indices (all ranges of the geometry),
+  // unreferenced vertices are kept at the end, indices are remapped in place
+  static void optimizeVertexFetch(CadScene::Vertex* vertices, size_t numVertices, GLuint* indices, size_t numIndices);
+
+  // in-place on a single triangle list range
+  void optimizeVertexCache(GLuint* indices, size_t numIndices, size_t numVertices);
+
+  // in-place on a vertex cache optimized range, splits it into clusters at
+  // cache restarts and sorts them front to back from the range's centroid.
+  // threshold limits the acmr loss, 1.05 allows 5% more transformed vertices
+  void optimizeOverdraw(GLuint* indices, size_t numIndices, const CadScene::Vertex* vertices, size_t numVertices, float threshold);
+
+  MeshOptimizer() : m_time(0) {}
+
+private:
+  std::vector<int>     m_cachePos;
+  std::vector<int>     m_remaining;
+  std::vector<int>     m_adjOffset;
+  std::vector<float>   m_vertexScore;
+  std::vector<GLuint>  m_touched;
+  std::vector<int>     m_adjacency;
+  std::vector<float>   m_triScore;
+  std::vector<uint8_t> m_triEmitted;
+  std::vector<GLuint>  m_output;
+
+  // FIFO simulation for optimizeOverdraw, a vertex is cached if
+  // m_time - m_stamps[v] <= STATS_CACHE_SIZE, so no reset is needed
+  std::vector<uint32_t> m_stamps;
+  uint32_t              m_time;
+
+  void resize(size_t numVertices);
+  int  simulateMisses(const GLuint* tri);
+};
+
+#endif
@@ -319,6 +319,46 @@ void NodeTree::clear()
   m_treeCompactChangeID = 0;
   m_levels.clear();
   m_nodes.clear();
+  m_unusedNodes.clear();
   m_treeCompactNodes.clear();
+
+  clearNode(m_root);
+  m_root.levelidx =  0;
+  m_root.level    = -1;
 }
 
+void NodeTree::restore( const Node* nodes, const compactID* compactNodes, int numNodes, const Node& root )
+{
+  clear();
+
+  m_root = root;
+  m_nodes.assign( nodes, nodes + numNodes );
+  m_treeCompactNodes.assign( compactNodes, compactNodes + numNodes );
+
+  // nodes already know their slots within the levels, just refill them
+  for (nodeID i = 0; i < (nodeID)numNodes; i++){
+    const Node& node = m_nodes[i];
+    if (!isValid(node.levelidx))
+      continue;
+
+    Level& level = getLevel(node.level);
+    level.changeID++;
+
+    if (level.nodes.size() <= node.levelidx){
+      level.nodes.resize(node.levelidx+1, INVALID);
+    }
+    level.nodes[node.levelidx] = i;
+
+    if (isValid(node.leafidx)){
+      if (level.leaves.size() <= node.leafidx){
+        level.leaves.resize(node.leafidx+1, INVALID);
+      }
+      level.leaves[node.leafidx] = i;
+    }
+
+    m_levelsUsed = node.level+1 > m_levelsUsed ? node.level+1 : m_levelsUsed;
+    m_nodesActive++;
+  }
+
+  m_treeCompactChangeID++;
+}
@@ -141,6 +141,20 @@ public:
     return m_nodesActive;
   }
 
+  // raw node state, allows storing a built tree and restoring it
+  // later without walking the hierarchy again
+  inline const std::vector<Node>& getNodes() const
+  {
+    return m_nodes;
+  }
+
+  inline const Node& getRootNode() const
+  {
+    return m_root;
+  }
+
+  void    restore(const Node* nodes, const compactID* compactNodes, int numNodes, const Node& root);
+
 private:
 
   inline Level& getLevel(int level)
@@ -160,6 +160,12 @@ namespace nvtoken
 
   // Emulation related
 
+  // firstIndex is in units of the index type set by the last element address token
+  static inline size_t nvtokenIndexSize( GLenum type )
+  {
+    return type == GL_UNSIGNED_INT ? sizeof(GLuint) : (type == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLubyte));
+  }
+
   static inline GLenum nvtokenDrawCommandSequenceSW( const void* NV_RESTRICT stream, size_t streamSize, GLenum mode, GLenum type, const StateSystem::State& state )
   {
     const GLubyte* NV_RESTRICT current = (GLubyte*)stream;
@@ -197,7 +203,7 @@ namespace nvtoken
       case GL_DRAW_ELEMENTS_COMMAND_NV:
         {
           const DrawElementsCommandNV* cmd = (const DrawElementsCommandNV*)current;
-          glDrawElementsBaseVertex(mode, cmd->count, type, (const GLvoid*)(cmd->firstIndex * sizeof(GLuint)), cmd->baseVertex);
+          glDrawElementsBaseVertex(mode, cmd->count, type, (const GLvoid*)(cmd->firstIndex * nvtokenIndexSize(type)), cmd->baseVertex);
         }
         break;
       case GL_DRAW_ARRAYS_COMMAND_NV:
@@ -209,7 +215,7 @@ namespace nvtoken
       case GL_DRAW_ELEMENTS_STRIP_COMMAND_NV:
         {
           const DrawElementsCommandNV* cmd = (const DrawElementsCommandNV*)current;
-          glDrawElementsBaseVertex(modeStrip, cmd->count, type, (const GLvoid*)(cmd->firstIndex * sizeof(GLuint)), cmd->baseVertex);
+          glDrawElementsBaseVertex(modeStrip, cmd->count, type, (const GLvoid*)(cmd->firstIndex * nvtokenIndexSize(type)), cmd->baseVertex);
         }
         break;
       case GL_DRAW_ARRAYS_STRIP_COMMAND_NV:
@@ -22,7 +22,13 @@
 
 #include <assert.h>
 #include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <random>
 #include "renderer.hpp"
+#include "tokenbase.hpp"
+#include <nvh/nvprint.hpp>
+#include <nvh/parallel_work.hpp>
 
 #include "common.h"
 
@@ -35,6 +41,7 @@ namespace csfviewer
   //////////////////////////////////////////////////////////////////////////
 
   bool Renderer::s_bindless_ubo = false;
+  uint32_t Renderer::s_fillThreads = 1;
 
   CullingSystem   Renderer::s_cullsys;
   ScanSystem      Renderer::s_scansys;
@@ -51,40 +58,68 @@ namespace csfviewer
   }
 
 
-  static void FillCache( std::vector<Renderer::DrawItem>& drawItems, const CadScene::Object& obj, const CadScene::Geometry& geo,  bool solid, int objectIndex ) 
+  // Object and CadScene::FlatObject both end up as these views, so the
+  // fill functions below serve both representations
+  struct ObjectView {
+    int                             geometryIndex;
+    const CadScene::ObjectPart*     parts;
+    size_t                          numParts;
+  };
+
+  struct CacheView {
+    const CadScene::DrawStateInfo*  state;
+    const int*                      stateCount;
+    size_t                          numStates;
+    const size_t*                   offsets;
+    const int*                      counts;
+  };
+
+  static inline CacheView GetCacheView( const CadScene::DrawRangeCache& cache )
+  {
+    CacheView view = { cache.state.data(), cache.stateCount.data(), cache.state.size(), cache.offsets.data(), cache.counts.data() };
+    return view;
+  }
+
+  static inline CacheView GetCacheView( const CadScene::FlatObjects& flat, const CadScene::FlatDrawRanges& ranges )
+  {
+    CacheView view = { flat.states.data() + ranges.stateBegin, flat.stateCounts.data() + ranges.stateBegin, ranges.numStates,
+                       flat.offsets.data() + ranges.rangeBegin, flat.counts.data() + ranges.rangeBegin };
+    return view;
+  }
+
+  static inline void AddDrawItem( std::vector<Renderer::DrawItem>& drawItems, const ObjectView& obj, const CadScene::Geometry& geo,
+                                  bool solid, int materialIndex, int matrixIndex, int objectIndex, size_t offset, int count )
+  {
+    Renderer::DrawItem di;
+    di.set(solid, materialIndex, obj.geometryIndex, matrixIndex, objectIndex,
+           uint32_t((offset - geo.iboOffset) / geo.getIndexSize()), uint32_t(count));
+
+    drawItems.push_back(di);
+  }
+
+  static void FillCache( std::vector<Renderer::DrawItem>& drawItems, const ObjectView& obj, const CadScene::Geometry& geo, const CacheView& cache, bool solid, int objectIndex ) 
   {
     int begin = 0;
-    const CadScene::DrawRangeCache &cache = solid ? obj.cacheSolid : obj.cacheWire;
 
-    for (size_t s = 0; s < cache.state.size(); s++)
+    for (size_t s = 0; s < cache.numStates; s++)
     {
       const CadScene::DrawStateInfo &state = cache.state[s];
       for (int d = 0; d < cache.stateCount[s]; d++){
         // evict
-        Renderer::DrawItem di;
-        di.geometryIndex = obj.geometryIndex;
-        di.matrixIndex   = state.matrixIndex;
-        di.materialIndex = state.materialIndex;
-        di.objectIndex   = objectIndex;
-
-        di.solid = solid;
-        di.range.offset = cache.offsets[begin + d];
-        di.range.count  = cache.counts [begin + d];
-
-        drawItems.push_back(di);
+        AddDrawItem(drawItems, obj, geo, solid, state.materialIndex, state.matrixIndex, objectIndex, cache.offsets[begin + d], cache.counts[begin + d]);
       }
       begin += cache.stateCount[s];
     }
   }
 
-  static void FillJoin( std::vector<Renderer::DrawItem>& drawItems, const CadScene::Object& obj, const CadScene::Geometry& geo,  bool solid, int objectIndex ) 
+  static void FillJoin( std::vector<Renderer::DrawItem>& drawItems, const ObjectView& obj, const CadScene::Geometry& geo,  bool solid, int objectIndex ) 
   {
     CadScene::DrawRange range;
 
     int lastMaterial = -1;
     int lastMatrix   = -1;
 
-    for (size_t p = 0; p < obj.parts.size(); p++){
+    for (size_t p = 0; p < obj.numParts; p++){
       const CadScene::ObjectPart&   part = obj.parts[p];
       const CadScene::GeometryPart& mesh = geo.parts[p];
 
@@ -94,16 +129,7 @@ namespace csfviewer
 
         if (range.count){
           // evict
-          Renderer::DrawItem di;
-          di.geometryIndex = obj.geometryIndex;
-          di.matrixIndex   = lastMatrix;
-          di.materialIndex = lastMaterial;
-          di.objectIndex   = objectIndex;
-
-          di.solid = solid;
-          di.range = range;
-
-          drawItems.push_back(di);
+          AddDrawItem(drawItems, obj, geo, solid, lastMaterial, lastMatrix, objectIndex, range.offset, range.count);
         }
 
         range = CadScene::DrawRange();
@@ -119,63 +145,768 @@ namespace csfviewer
       range.count += solid ? mesh.indexSolid.count : mesh.indexWire.count;
     }
 
-    // evict
-    Renderer::DrawItem di;
-    di.geometryIndex = obj.geometryIndex;
-    di.matrixIndex   = lastMatrix;
-    di.materialIndex = lastMaterial;
-    di.objectIndex   = objectIndex;
+    // evict, objects without active parts have nothing left to draw
+    if (range.count){
+      AddDrawItem(drawItems, obj, geo, solid, lastMaterial, lastMatrix, objectIndex, range.offset, range.count);
+    }
+  }
 
-    di.solid = solid;
-    di.range = range;
+  static void FillIndividual( std::vector<Renderer::DrawItem>& drawItems, const ObjectView& obj, const CadScene::Geometry& geo, bool solid, int objectIndex ) 
+  {
+    for (size_t p = 0; p < obj.numParts; p++){
+      const CadScene::ObjectPart&   part = obj.parts[p];
+      const CadScene::GeometryPart& mesh = geo.parts[p];
 
-    drawItems.push_back(di);
+      if (!part.active) continue;
+
+      const CadScene::DrawRange& range = solid ? mesh.indexSolid : mesh.indexWire;
+      AddDrawItem(drawItems, obj, geo, solid, part.materialIndex, part.matrixIndex, objectIndex, range.offset, range.count);
+    }
+  }
+
+  // STRATEGY_ADAPTIVE
+
+  static const CostModel s_costModels[] = {
+    // classic binds per state change
+    { "uborange",             "uborange_sorted",             1.00, 2.0, 1.50, 0.60, 0.60, 0.0   },
+    { "uborange_bindless",    "uborange_sorted_bindless",    0.60, 2.0, 0.50, 0.30, 0.30, 0.0   },
+    // matrix and material are indices, only buffer and mode changes split the multi-draw
+    { "indexedmdi",           "indexedmdi_sorted",           0.05, 2.0, 1.50, 0.0,  0.0,  0.0   },
+    // everything is in the token stream, mode changes start a new state object segment
+    { "tokenbuffer",          "tokenbuffer_sorted",          0.02, 4.0, 0.0,  0.0,  0.0,  0.004 },
+  };
+  static const size_t s_numCostModels = sizeof(s_costModels) / sizeof(s_costModels[0]);
+
+  const CostModel* Renderer::getCostModels( size_t& count )
+  {
+    count = s_numCostModels;
+    return s_costModels;
+  }
+
+  const CostModel& Renderer::getCostModel( const char* name )
+  {
+    const CostModel* best       = &s_costModels[s_numCostModels - 1];
+    size_t           bestLength = 0;
+    for (size_t m = 0; name && m < s_numCostModels; m++){
+      const CostModel& model = s_costModels[m];
+      if (strcmp(name, model.name) == 0 || strcmp(name, model.nameSorted) == 0){
+        return model;
+      }
+      size_t length = strlen(model.name);
+      if (length > bestLength && strncmp(name, model.name, length) == 0){
+        best       = &model;
+        bestLength = length;
+      }
+    }
+    return *best;
+  }
+
+  // what one strategy generates for an object, binds are the matrix and
+  // material changes that survive redundancy filtering within the object
+  struct StrategyEstimate {
+    uint32_t  draws;
+    uint32_t  matrixBinds;
+    uint32_t  materialBinds;
+  };
+
+  static inline void AddBinds( StrategyEstimate& estimate, int& lastMaterial, int& lastMatrix, int materialIndex, int matrixIndex )
+  {
+    estimate.materialBinds += materialIndex != lastMaterial ? 1 : 0;
+    estimate.matrixBinds   += matrixIndex != lastMatrix ? 1 : 0;
+    lastMaterial = materialIndex;
+    lastMatrix   = matrixIndex;
+  }
+
+  static inline uint32_t GetBinds( const StrategyEstimate& estimate )
+  {
+    return estimate.matrixBinds + estimate.materialBinds;
   }
 
-  static void FillIndividual( std::vector<Renderer::DrawItem>& drawItems, const CadScene::Object& obj, const CadScene::Geometry& geo, bool solid, int objectIndex ) 
+  // mirrors FillCache, FillJoin and FillIndividual without emitting items
+  static void EstimatePass( StrategyEstimate* NV_RESTRICT estimates, const ObjectView& obj, const CadScene::Geometry& geo, const CacheView& cache, bool solid )
   {
-    for (size_t p = 0; p < obj.parts.size(); p++){
+    StrategyEstimate& groups      = estimates[STRATEGY_GROUPS];
+    StrategyEstimate& join        = estimates[STRATEGY_JOIN];
+    StrategyEstimate& individual  = estimates[STRATEGY_INDIVIDUAL];
+
+    int lastMaterial = -1;
+    int lastMatrix   = -1;
+    for (size_t s = 0; s < cache.numStates; s++){
+      AddBinds(groups, lastMaterial, lastMatrix, cache.state[s].materialIndex, cache.state[s].matrixIndex);
+      groups.draws += cache.stateCount[s];
+    }
+
+    int joinMaterial = -1;
+    int joinMatrix   = -1;
+    int runMaterial  = -1;
+    int runMatrix    = -1;
+    int runCount     = 0;
+    lastMaterial = -1;
+    lastMatrix   = -1;
+    for (size_t p = 0; p < obj.numParts; p++){
       const CadScene::ObjectPart&   part = obj.parts[p];
       const CadScene::GeometryPart& mesh = geo.parts[p];
 
       if (!part.active) continue;
 
-      Renderer::DrawItem di;
-      di.geometryIndex = obj.geometryIndex;
-      di.matrixIndex   = part.matrixIndex;
-      di.materialIndex = part.materialIndex;
-      di.objectIndex   = objectIndex;
+      if (part.materialIndex != runMaterial || part.matrixIndex != runMatrix){
+        if (runCount){
+          AddBinds(join, joinMaterial, joinMatrix, runMaterial, runMatrix);
+          join.draws++;
+        }
+        runMaterial = part.materialIndex;
+        runMatrix   = part.matrixIndex;
+        runCount    = 0;
+      }
+      runCount += solid ? mesh.indexSolid.count : mesh.indexWire.count;
 
-      di.solid = solid;
-      di.range = solid ? mesh.indexSolid : mesh.indexWire;
+      AddBinds(individual, lastMaterial, lastMatrix, part.materialIndex, part.matrixIndex);
+      individual.draws++;
+    }
+    if (runCount){
+      AddBinds(join, joinMaterial, joinMatrix, runMaterial, runMatrix);
+      join.draws++;
+    }
+  }
 
-      drawItems.push_back(di);
+  static inline size_t GetDrawTokenSize( const CadScene* NV_RESTRICT scene )
+  {
+    return scene->getNumInstances() > 1 ? sizeof(NVTokenDrawElemsInstanced) : sizeof(NVTokenDrawElemsUsed);
+  }
+
+  static inline size_t GetTokenBytes( const StrategyEstimate& estimate, size_t drawTokenSize )
+  {
+    return size_t(estimate.draws) * drawTokenSize + size_t(GetBinds(estimate)) * sizeof(NVTokenUbo);
+  }
+
+  // mode and buffer changes are the same for all strategies of an object
+  static inline double GetEstimatedCost( const CostModel& model, const StrategyEstimate& estimate, size_t drawTokenSize )
+  {
+    return double(estimate.draws)         * model.draw
+         + double(estimate.matrixBinds)   * model.matrix
+         + double(estimate.materialBinds) * model.material
+         + double(GetTokenBytes(estimate, drawTokenSize)) * model.tokenByte;
+  }
+
+  // fills estimates for the fixed strategies and returns the cheapest,
+  // ties keep the earlier strategy
+  static Strategy ChooseStrategy( StrategyEstimate* NV_RESTRICT estimates, const CostModel& model, const ObjectView& obj, const CadScene::Geometry& geo,
+                                  const CacheView& cacheSolid, const CacheView& cacheWire, bool solid, bool wire, size_t drawTokenSize )
+  {
+    memset(estimates, 0, sizeof(StrategyEstimate) * STRATEGY_ADAPTIVE);
+    if (solid)  EstimatePass(estimates, obj, geo, cacheSolid, true);
+    if (wire)   EstimatePass(estimates, obj, geo, cacheWire,  false);
+
+    Strategy best     = STRATEGY_GROUPS;
+    double   bestCost = GetEstimatedCost(model, estimates[STRATEGY_GROUPS], drawTokenSize);
+    for (int s = STRATEGY_GROUPS + 1; s < STRATEGY_ADAPTIVE; s++){
+      double cost = GetEstimatedCost(model, estimates[s], drawTokenSize);
+      if (cost < bestCost){
+        best     = Strategy(s);
+        bestCost = cost;
+      }
     }
+    return best;
   }
 
+  static void GetObjectViews( const CadScene* NV_RESTRICT scene, size_t i, ObjectView& obj, CacheView& cacheSolid, CacheView& cacheWire )
+  {
+    const CadScene::FlatObjects& flat = scene->m_flatObjects;
+    if (!flat.empty()){
+      const CadScene::FlatObject& fobj = flat.objects[i];
+      obj.geometryIndex = fobj.geometryIndex;
+      obj.parts         = flat.parts.data() + fobj.partsBegin;
+      obj.numParts      = fobj.numParts;
+      cacheSolid        = GetCacheView(flat, fobj.solid);
+      cacheWire         = GetCacheView(flat, fobj.wire);
+    }
+    else{
+      const CadScene::Object& sobj = scene->m_objects[i];
+      obj.geometryIndex = sobj.geometryIndex;
+      obj.parts         = sobj.parts.data();
+      obj.numParts      = sobj.parts.size();
+      cacheSolid        = GetCacheView(sobj.cacheSolid);
+      cacheWire         = GetCacheView(sobj.cacheWire);
+    }
+  }
+
+  void Renderer::logAdaptiveStrategy( const CadScene& scene, const CostModel& model )
+  {
+    const char* names[] = { "groups", "join", "individual", "adaptive" };
+
+    size_t drawTokenSize = GetDrawTokenSize(&scene);
+
+    StrategyEstimate totals[STRATEGY_ADAPTIVE + 1] = {};
+    size_t           chosen[STRATEGY_ADAPTIVE]     = {};
+    size_t           objects = 0;
+
+    for (size_t i = 0; i < scene.m_objects.size(); i++){
+      if (!scene.isObjectReady(i)) continue;
+
+      ObjectView obj;
+      CacheView  cacheSolid;
+      CacheView  cacheWire;
+      GetObjectViews(&scene, i, obj, cacheSolid, cacheWire);
+
+      StrategyEstimate estimates[STRATEGY_ADAPTIVE];
+      Strategy best = ChooseStrategy(estimates, model, obj, scene.m_geometry[obj.geometryIndex], cacheSolid, cacheWire, true, true, drawTokenSize);
+
+      for (int s = STRATEGY_GROUPS; s < STRATEGY_ADAPTIVE; s++){
+        totals[s].draws         += estimates[s].draws;
+        totals[s].matrixBinds   += estimates[s].matrixBinds;
+        totals[s].materialBinds += estimates[s].materialBinds;
+      }
+      totals[STRATEGY_ADAPTIVE].draws         += estimates[best].draws;
+      totals[STRATEGY_ADAPTIVE].matrixBinds   += estimates[best].matrixBinds;
+      totals[STRATEGY_ADAPTIVE].materialBinds += estimates[best].materialBinds;
+      chosen[best]++;
+      objects++;
+    }
+
+    LOGI("adaptive strategy: %s cost model, %d objects, groups %d join %d individual %d\n", model.name, (uint32_t)objects,
+         (uint32_t)chosen[STRATEGY_GROUPS], (uint32_t)chosen[STRATEGY_JOIN], (uint32_t)chosen[STRATEGY_INDIVIDUAL]);
+    LOGI("  strategy        draws     binds   token KB    cost ms\n");
+    for (int s = STRATEGY_GROUPS; s <= STRATEGY_ADAPTIVE; s++){
+      LOGI("  %-10s %10d %9d %10.1f %10.3f\n", names[s], totals[s].draws, GetBinds(totals[s]),
+           double(GetTokenBytes(totals[s], drawTokenSize)) / 1024.0, GetEstimatedCost(model, totals[s], drawTokenSize) / 1000.0);
+    }
+  }
 
   void Renderer::fillDrawItems( std::vector<DrawItem>& drawItems, size_t from, size_t to, bool solid, bool wire )
+  {
+    // below this a thread costs more than the work
+    const size_t minPerThread = 8192;
+
+    to = std::min(to, m_scene->m_objects.size());
+    if (from >= to) return;
+
+    if (m_strategy == STRATEGY_ADAPTIVE){
+      // the threads below only write the choices of their own objects
+      int mode = (solid ? 1 : 0) | (wire ? 2 : 0);
+      if (mode != m_adaptiveMode || m_costModel != m_adaptiveModel){
+        m_adaptiveChoices.clear();
+        m_adaptiveMode  = mode;
+        m_adaptiveModel = m_costModel;
+      }
+      if (m_adaptiveChoices.size() < m_scene->m_objects.size()){
+        m_adaptiveChoices.resize(m_scene->m_objects.size(), 0);
+      }
+    }
+
+    uint32_t threads = std::min(s_fillThreads, uint32_t((to - from + minPerThread - 1) / minPerThread));
+    if (threads <= 1){
+      fillDrawItemsRange(drawItems, from, to, solid, wire);
+      return;
+    }
+
+    if (m_fillArenas.size() < threads){
+      m_fillArenas.resize(threads);
+    }
+
+    nvh::parallel_ranges(to - from, [&](uint64_t itemBegin, uint64_t itemEnd, uint32_t threadIdx) {
+      std::vector<DrawItem>& arena = m_fillArenas[threadIdx];
+      arena.clear();
+      fillDrawItemsRange(arena, from + size_t(itemBegin), from + size_t(itemEnd), solid, wire);
+    }, threads);
+
+    // ranges are handed out in thread order, concatenating keeps the serial result
+    std::vector<size_t> offsets(threads + 1, drawItems.size());
+    for (uint32_t t = 0; t < threads; t++){
+      offsets[t + 1] = offsets[t] + m_fillArenas[t].size();
+    }
+    drawItems.resize(offsets[threads]);
+
+    nvh::parallel_ranges(threads, [&](uint64_t itemBegin, uint64_t itemEnd, uint32_t threadIdx) {
+      for (uint64_t t = itemBegin; t < itemEnd; t++){
+        std::copy(m_fillArenas[t].begin(), m_fillArenas[t].end(), drawItems.begin() + offsets[t]);
+      }
+    }, threads);
+  }
+
+  void Renderer::fillDrawItemsRange( std::vector<DrawItem>& drawItems, size_t from, size_t to, bool solid, bool wire )
   {
     const CadScene* NV_RESTRICT scene = m_scene;
-    for (size_t i = from; i < scene->m_objects.size() && i < to; i++){
-      const CadScene::Object& obj = scene->m_objects[i];
+    const CostModel& model = m_costModel ? *m_costModel : getCostModel(NULL);
+    size_t drawTokenSize = GetDrawTokenSize(scene);
+
+    for (size_t i = from; i < to; i++){
+      if (!scene->isObjectReady(i)) continue;
+
+      ObjectView obj;
+      CacheView  cacheSolid;
+      CacheView  cacheWire;
+      GetObjectViews(scene, i, obj, cacheSolid, cacheWire);
+
       const CadScene::Geometry& geo = scene->m_geometry[obj.geometryIndex];
 
-      if (m_strategy == STRATEGY_GROUPS){
-        if (solid)  FillCache(drawItems, obj, geo, true,  int(i));
-        if (wire)   FillCache(drawItems, obj, geo, false, int(i));
+      Strategy strategy = m_strategy;
+      if (strategy == STRATEGY_ADAPTIVE){
+        uint8_t& choice = m_adaptiveChoices[i];
+        if (!choice){
+          StrategyEstimate estimates[STRATEGY_ADAPTIVE];
+          choice = uint8_t(ChooseStrategy(estimates, model, obj, geo, cacheSolid, cacheWire, solid, wire, drawTokenSize) + 1);
+        }
+        strategy = Strategy(choice - 1);
+      }
+
+      if (strategy == STRATEGY_GROUPS){
+        if (solid)  FillCache(drawItems, obj, geo, cacheSolid, true,  int(i));
+        if (wire)   FillCache(drawItems, obj, geo, cacheWire,  false, int(i));
       }
-      else if (m_strategy == STRATEGY_JOIN) {
+      else if (strategy == STRATEGY_JOIN) {
         if (solid)  FillJoin(drawItems, obj, geo, true,  int(i));
         if (wire)   FillJoin(drawItems, obj, geo, false, int(i));
       }
-      else if (m_strategy == STRATEGY_INDIVIDUAL){
+      else if (strategy == STRATEGY_INDIVIDUAL){
         if (solid)  FillIndividual(drawItems, obj, geo, true,  int(i));
         if (wire)   FillIndividual(drawItems, obj, geo, false, int(i));
       }
     }
   }
 
+  void Renderer::invalidateAdaptive( const std::vector<uint32_t>& objects )
+  {
+    for (size_t i = 0; i < objects.size(); i++){
+      if (objects[i] < m_adaptiveChoices.size()){
+        m_adaptiveChoices[objects[i]] = 0;
+      }
+    }
+  }
+
+  size_t Renderer::patchDrawItems( std::vector<DrawItem>& drawItems, const std::vector<uint32_t>& objects, bool solid, bool wire )
+  {
+    invalidateAdaptive(objects);
+
+    std::vector<uint8_t> patched(m_scene->m_objects.size(), 0);
+    for (size_t i = 0; i < objects.size(); i++){
+      patched[objects[i]] = 1;
+    }
+
+    drawItems.erase(std::remove_if(drawItems.begin(), drawItems.end(),
+                                   [&](const DrawItem& di) { return patched[di.objectIndex()] != 0; }),
+                    drawItems.end());
+
+    size_t begin = drawItems.size();
+    for (size_t i = 0; i < objects.size(); i++){
+      fillDrawItems(drawItems, objects[i], objects[i] + 1, solid, wire);
+    }
+    return begin;
+  }
+
+  void Renderer::SortedDrawList::init( Renderer* renderer, bool solid, bool wire, bool objectOrder )
+  {
+    m_renderer    = renderer;
+    m_solid       = solid;
+    m_wire        = wire;
+    m_objectOrder = objectOrder;
+
+    m_items.clear();
+    renderer->fillDrawItems(m_items, 0, renderer->m_scene->m_objects.size(), solid, wire);
+    renderer->sortDrawItems(m_items, 0, objectOrder);
+  }
+
+  void Renderer::SortedDrawList::clear()
+  {
+    m_items.clear();
+    m_added.clear();
+    m_window.clear();
+    m_removed.clear();
+  }
+
+  Renderer::DrawListChange Renderer::SortedDrawList::insertObjects( size_t from, size_t to )
+  {
+    return replace(NULL, NULL, from, to);
+  }
+
+  Renderer::DrawListChange Renderer::SortedDrawList::removeObjects( const std::vector<uint32_t>& objects )
+  {
+    return replace(&objects, NULL, 0, 0);
+  }
+
+  Renderer::DrawListChange Renderer::SortedDrawList::updateObjects( const std::vector<uint32_t>& objects )
+  {
+    return replace(&objects, &objects, 0, 0);
+  }
+
+  Renderer::DrawListChange Renderer::SortedDrawList::replace( const std::vector<uint32_t>* removed, const std::vector<uint32_t>* refilled, size_t from, size_t to )
+  {
+    bool objectOrder = m_objectOrder;
+    auto compare = [objectOrder](const DrawItem& a, const DrawItem& b) {
+      if (a.solid() != b.solid()) return a.solid();
+      if (objectOrder && a.objectIndex() != b.objectIndex()) return a.objectIndex() < b.objectIndex();
+      return DrawItem_compare_groups(a, b);
+    };
+
+    // remove in place, only the items behind the first removed one move
+    size_t removedBegin = m_items.size();
+    size_t removedEnd   = m_items.size();
+    size_t numRemoved   = 0;
+    if (removed && !removed->empty()){
+      m_renderer->invalidateAdaptive(*removed);
+      m_removed.assign(m_renderer->m_scene->m_objects.size(), 0);
+      for (size_t i = 0; i < removed->size(); i++){
+        m_removed[(*removed)[i]] = 1;
+      }
+
+      size_t write = 0;
+      for (size_t i = 0; i < m_items.size(); i++){
+        if (m_removed[m_items[i].objectIndex()]){
+          if (!numRemoved) removedBegin = i;
+          removedEnd = i + 1;
+          numRemoved++;
+          continue;
+        }
+        if (write != i){
+          m_items[write] = m_items[i];
+        }
+        write++;
+      }
+      m_items.resize(write);
+    }
+
+    m_added.clear();
+    if (refilled){
+      for (size_t i = 0; i < refilled->size(); i++){
+        m_renderer->fillDrawItems(m_added, (*refilled)[i], (*refilled)[i] + 1, m_solid, m_wire);
+      }
+    }
+    else{
+      m_renderer->fillDrawItems(m_added, from, to, m_solid, m_wire);
+    }
+
+    // only the new items are sorted, then merged with the window of
+    // existing items they fall into
+    size_t numKept  = m_items.size();
+    size_t numAdded = m_added.size();
+    size_t windowBegin = numKept;
+    size_t windowEnd   = numKept;
+    if (numAdded){
+      m_renderer->sortDrawItems(m_added, 0, objectOrder);
+
+      windowBegin = std::lower_bound(m_items.begin(), m_items.end(), m_added.front(), compare) - m_items.begin();
+      windowEnd   = std::upper_bound(m_items.begin() + windowBegin, m_items.end(), m_added.back(), compare) - m_items.begin();
+
+      m_window.assign(m_items.begin() + windowBegin, m_items.begin() + windowEnd);
+      m_items.resize(numKept + numAdded);
+      std::copy_backward(m_items.begin() + windowEnd, m_items.begin() + numKept, m_items.end());
+      std::merge(m_window.begin(), m_window.end(), m_added.begin(), m_added.end(), m_items.begin() + windowBegin, compare);
+    }
+
+    DrawListChange change;
+    if (!numRemoved && !numAdded){
+      change.begin  = m_items.size();
+      change.end    = m_items.size();
+      change.oldEnd = m_items.size();
+      return change;
+    }
+
+    // in the kept items, removal touched [removedBegin, removedEnd - numRemoved)
+    // and the merge [windowBegin, windowEnd)
+    size_t keptBegin = std::min(numRemoved ? removedBegin : numKept, numAdded ? windowBegin : numKept);
+    size_t keptEnd   = std::max(numRemoved ? removedEnd - numRemoved : 0, numAdded ? windowEnd : 0);
+    keptEnd = std::max(keptBegin, keptEnd);
+
+    change.begin  = keptBegin;
+    change.end    = keptEnd + numAdded;
+    change.oldEnd = keptEnd + numRemoved;
+    return change;
+  }
+
+  void Renderer::getPatchRange( const DrawListChange& change, size_t numItems, size_t& next, size_t& oldNext )
+  {
+    next    = std::min(change.end + 1, numItems);
+    oldNext = change.oldEnd + (next - change.end);
+  }
+
+  void Renderer::spliceItemOffsets( std::vector<size_t>& offsets, size_t begin, size_t oldNext, const std::vector<size_t>& fragment )
+  {
+    size_t base  = offsets[begin];
+    size_t shift = base + fragment.back() - offsets[oldNext];
+    for (size_t i = oldNext; i < offsets.size(); i++){
+      offsets[i] += shift;
+    }
+
+    size_t numNew = fragment.size() - 1;
+    size_t numOld = oldNext - begin;
+    if (numNew > numOld){
+      offsets.insert(offsets.begin() + begin, numNew - numOld, 0);
+    }
+    else{
+      offsets.erase(offsets.begin() + begin, offsets.begin() + begin + numOld - numNew);
+    }
+    for (size_t i = 0; i < numNew; i++){
+      offsets[begin + i] = base + fragment[i];
+    }
+  }
+
+  bool Renderer::updateGrowingBuffer( GLuint& buffer, size_t& capacity, const void* data, size_t size, size_t begin, size_t end )
+  {
+    if (buffer && capacity && size <= capacity){
+      if (end > begin){
+        glNamedBufferSubData(buffer, begin, end - begin, (const uint8_t*)data + begin);
+      }
+      return false;
+    }
+
+    if (buffer){
+      glDeleteBuffers(1, &buffer);
+    }
+    // a quarter more, patches rarely grow a list by that much at once
+    capacity = std::max(size + size / 4, size_t(256));
+    glCreateBuffers(1, &buffer);
+    glNamedBufferStorage(buffer, capacity, NULL, GL_DYNAMIC_STORAGE_BIT);
+    if (size && data){
+      glNamedBufferSubData(buffer, 0, size, data);
+    }
+    return true;
+  }
+
+  bool Renderer::spliceGrowingBuffer( GLuint& buffer, size_t& capacity, GLuint& scratch, size_t& scratchCapacity,
+                                      size_t oldSize, size_t begin, size_t oldEnd, const void* data, size_t size )
+  {
+    size_t tail    = oldSize - oldEnd;
+    size_t newSize = begin + size + tail;
+    bool   created = false;
+
+    if (!buffer || !capacity || newSize > capacity){
+      GLuint oldBuffer = buffer;
+      capacity = std::max(newSize + newSize / 4, size_t(256));
+      glCreateBuffers(1, &buffer);
+      glNamedBufferStorage(buffer, capacity, NULL, GL_DYNAMIC_STORAGE_BIT);
+      if (oldBuffer){
+        if (begin){
+          glCopyNamedBufferSubData(oldBuffer, buffer, 0, 0, begin);
+        }
+        if (tail){
+          glCopyNamedBufferSubData(oldBuffer, buffer, oldEnd, begin + size, tail);
+        }
+        glDeleteBuffers(1, &oldBuffer);
+      }
+      created = true;
+    }
+    else if (tail && begin + size != oldEnd){
+      size_t distance = begin + size > oldEnd ? begin + size - oldEnd : oldEnd - begin - size;
+      if (distance >= tail){
+        glCopyNamedBufferSubData(buffer, buffer, oldEnd, begin + size, tail);
+      }
+      else{
+        if (tail > scratchCapacity){
+          glDeleteBuffers(1, &scratch);
+          scratchCapacity = tail + tail / 4;
+          glCreateBuffers(1, &scratch);
+          glNamedBufferStorage(scratch, scratchCapacity, NULL, 0);
+        }
+        glCopyNamedBufferSubData(buffer, scratch, oldEnd, 0, tail);
+        glCopyNamedBufferSubData(scratch, buffer, 0, begin + size, tail);
+      }
+    }
+
+    if (size){
+      glNamedBufferSubData(buffer, begin, size, data);
+    }
+    return created;
+  }
+
+  static double getTimeMs()
+  {
+    return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now().time_since_epoch()).count();
+  }
+
+  void Renderer::benchmarkFillDrawItems( CadScene& scene, int iterations )
+  {
+    if (!scene.m_flatObjects.empty()){
+      LOGW("fillDrawItems benchmark: needs the per-object vectors, load without flatobjects\n");
+      return;
+    }
+
+    Renderer renderer;
+    renderer.m_scene = &scene;
+
+    std::vector<DrawItem> drawItems;
+    const char* names[] = { "groups", "join", "individual", "adaptive" };
+
+    uint32_t threads = s_fillThreads;
+
+    LOGI("fillDrawItems benchmark: %d objects, %d iterations\n", (uint32_t)scene.m_objects.size(), iterations);
+    LOGI("  strategy       items   objects ms   flat ms  speedup  %2d thr ms  speedup\n", threads);
+    for (int s = STRATEGY_GROUPS; s <= STRATEGY_ADAPTIVE; s++){
+      renderer.m_strategy = Strategy(s);
+
+      // objects and flat single threaded, then objects again threaded
+      double timeRuns[3] = {};
+      for (int run = 0; run < 3; run++){
+        if (run == 1){
+          scene.buildFlatObjects(false);
+        }
+        else if (run == 2){
+          scene.m_flatObjects.clear();
+        }
+        s_fillThreads = run == 2 ? threads : 1;
+
+        double timeBegin = getTimeMs();
+        for (int i = 0; i < iterations; i++){
+          // time the full STRATEGY_ADAPTIVE choice, not the cached one
+          renderer.m_adaptiveChoices.clear();
+          drawItems.clear();
+          renderer.fillDrawItems(drawItems, 0, scene.m_objects.size(), true, true);
+        }
+        timeRuns[run] = (getTimeMs() - timeBegin) / double(iterations);
+      }
+      s_fillThreads = threads;
+
+      LOGI("  %-10s %9d %12.3f %9.3f %7.2fx %10.3f %7.2fx\n", names[s], (uint32_t)drawItems.size(), timeRuns[0], timeRuns[1],
+           timeRuns[0] / std::max(timeRuns[1], 0.0001), timeRuns[2], timeRuns[0] / std::max(timeRuns[2], 0.0001));
+    }
+  }
+
+  // fields of the packed sort key from the top: solid, object (only with
+  // objectOrder), material, geometry, matrix
+  struct SortKeyLayout {
+    uint32_t  shiftSolid;
+    uint32_t  shiftObject;
+    uint32_t  shiftMaterial;
+    uint32_t  shiftGeometry;
+    uint32_t  totalBits;
+    bool      objectOrder;
+  };
+
+  static inline uint32_t GetBitsFor( size_t maxValue )
+  {
+    uint32_t bits = 0;
+    while (bits < 64 && (uint64_t(1) << bits) <= maxValue){
+      bits++;
+    }
+    return bits;
+  }
+
+  static bool SetupSortKeyLayout( SortKeyLayout& layout, const CadScene& scene, bool objectOrder )
+  {
+    uint32_t bitsMatrix   = GetBitsFor(scene.m_matrices.size());
+    uint32_t bitsGeometry = GetBitsFor(scene.m_geometry.size());
+    uint32_t bitsMaterial = GetBitsFor(scene.m_materials.size());
+    uint32_t bitsObject   = objectOrder ? GetBitsFor(scene.m_objects.size()) : 0;
+
+    layout.objectOrder   = objectOrder;
+    layout.shiftGeometry = bitsMatrix;
+    layout.shiftMaterial = layout.shiftGeometry + bitsGeometry;
+    layout.shiftObject   = layout.shiftMaterial + bitsMaterial;
+    layout.shiftSolid    = layout.shiftObject + bitsObject;
+    layout.totalBits     = layout.shiftSolid + 1;
+
+    return layout.totalBits <= 64;
+  }
+
+  static inline uint64_t GetSortKey( const Renderer::DrawItem& di, const SortKeyLayout& layout )
+  {
+    uint64_t key = uint64_t(di.matrixIndex());
+    key |= uint64_t(di.geometryIndex()) << layout.shiftGeometry;
+    key |= uint64_t(di.materialIndex()) << layout.shiftMaterial;
+    if (layout.objectOrder){
+      key |= uint64_t(di.objectIndex()) << layout.shiftObject;
+    }
+    key |= uint64_t(di.solid() ? 0 : 1) << layout.shiftSolid;
+    return key;
+  }
+
+  void Renderer::sortDrawItems( std::vector<DrawItem>& drawItems, size_t begin, bool objectOrder )
+  {
+    size_t count = drawItems.size() - std::min(begin, drawItems.size());
+    if (count < 2) return;
+
+    SortKeyLayout layout;
+    if (!SetupSortKeyLayout(layout, *m_scene, objectOrder) || count > size_t(~uint32_t(0))){
+      std::sort(drawItems.begin() + begin, drawItems.end(), [objectOrder](const DrawItem& a, const DrawItem& b) {
+        if (a.solid() != b.solid()) return a.solid();
+        if (objectOrder && a.objectIndex() != b.objectIndex()) return a.objectIndex() < b.objectIndex();
+        return DrawItem_compare_groups(a, b);
+      });
+      return;
+    }
+
+    std::vector<SortPair>& pairs = m_sortPairs;
+    std::vector<SortPair>& temp  = m_sortPairsTemp;
+    pairs.resize(count);
+    temp.resize(count);
+    for (size_t i = 0; i < count; i++){
+      pairs[i].key   = GetSortKey(drawItems[begin + i], layout);
+      pairs[i].index = uint32_t(i);
+    }
+
+    // 8 bit digits from the lowest on, each pass is stable
+    size_t histogram[256];
+    for (uint32_t shift = 0; shift < layout.totalBits; shift += 8){
+      memset(histogram, 0, sizeof(histogram));
+      for (size_t i = 0; i < count; i++){
+        histogram[(pairs[i].key >> shift) & 0xFF]++;
+      }
+
+      // all keys share this digit
+      if (histogram[(pairs[0].key >> shift) & 0xFF] == count) continue;
+
+      size_t sum = 0;
+      for (int d = 0; d < 256; d++){
+        size_t digitCount = histogram[d];
+        histogram[d] = sum;
+        sum += digitCount;
+      }
+      for (size_t i = 0; i < count; i++){
+        temp[histogram[(pairs[i].key >> shift) & 0xFF]++] = pairs[i];
+      }
+      pairs.swap(temp);
+    }
+
+    m_sortItems.resize(count);
+    for (size_t i = 0; i < count; i++){
+      m_sortItems[i] = drawItems[begin + pairs[i].index];
+    }
+    std::copy(m_sortItems.begin(), m_sortItems.end(), drawItems.begin() + begin);
+  }
+
+  void Renderer::benchmarkSortDrawItems( const CadScene& scene, size_t maxItems )
+  {
+    if (scene.m_objects.empty()){
+      return;
+    }
+
+    Renderer renderer;
+    renderer.m_scene = &scene;
+
+    SortKeyLayout layout;
+    bool fits = SetupSortKeyLayout(layout, scene, false);
+
+    LOGI("sortDrawItems benchmark: %d bit keys%s\n", layout.totalBits, fits ? "" : ", too wide, std::sort fallback");
+    LOGI("       items   std::sort ms    radix ms  speedup\n");
+
+    std::mt19937 rng(1234);
+    for (size_t numItems = 100000; numItems <= maxItems; numItems *= 10){
+      std::vector<DrawItem> itemsStd(numItems);
+      for (size_t i = 0; i < numItems; i++){
+        bool solid        = (rng() & 3) != 0;
+        int objectIndex   = int(rng() % scene.m_objects.size());
+        int materialIndex = int(rng() % scene.m_materials.size());
+        int geometryIndex = int(rng() % scene.m_geometry.size());
+        int matrixIndex   = int(rng() % scene.m_matrices.size());
+        itemsStd[i].set(solid, materialIndex, geometryIndex, matrixIndex, objectIndex, 0, 0);
+      }
+      std::vector<DrawItem> itemsRadix = itemsStd;
+
+      double timeBegin = getTimeMs();
+      std::sort(itemsStd.begin(), itemsStd.end(), DrawItem_compare_groups);
+      double timeStd = getTimeMs();
+      renderer.sortDrawItems(itemsRadix);
+      double timeRadix = getTimeMs();
+
+      // equal keys may end up in a different order, but never unequal ones
+      bool valid = true;
+      for (size_t i = 0; i < numItems && valid; i++){
+        valid = !DrawItem_compare_groups(itemsStd[i], itemsRadix[i]) && !DrawItem_compare_groups(itemsRadix[i], itemsStd[i]);
+      }
+
+      LOGI("  %10d %14.2f %11.2f %7.2fx%s\n", uint32_t(numItems), timeStd - timeBegin, timeRadix - timeStd,
+           (timeStd - timeBegin) / std::max(timeRadix - timeStd, 0.001), valid ? "" : "  MISMATCH");
+    }
+  }
+
 }
 
 
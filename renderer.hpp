@@ -33,6 +33,7 @@
 #define GL_UNIFORM_BUFFER_LENGTH_NV                         0x9370
 #endif
 
+#include <assert.h>
 #include "cadscene.hpp"
 #include <NvFoundation.h>
 #include <nvgl/programmanager_gl.hpp>
@@ -51,6 +52,21 @@ namespace csfviewer {
     STRATEGY_GROUPS,
     STRATEGY_JOIN,
     STRATEGY_INDIVIDUAL,
+    STRATEGY_ADAPTIVE,    // per object the one of the above with the lowest estimated cost
+  };
+
+  // rough cost per event in microseconds of CPU or command front-end time,
+  // only meant to rank renderers and strategies against each other. Used by
+  // STRATEGY_ADAPTIVE and the scene analysis, see Renderer::getCostModels.
+  struct CostModel {
+    const char* name;
+    const char* nameSorted;
+    double      draw;
+    double      mode;
+    double      buffer;
+    double      matrix;
+    double      material;
+    double      tokenByte;
   };
 
   enum ShadeType {
@@ -109,26 +125,132 @@ namespace csfviewer {
   class Renderer {
   public:
 
+    // 24 byte draw record: material, geometry, matrix and object as full
+    // 32-bit ids, firstIndex in index elements relative to the geometry's
+    // start within its index buffer (Geometry::getBaseIndex), and
+    // count << 1 | solid in the last word.
+    // A 16 byte record with bit-packed ids was tried first, but its id
+    // limits (e.g. 12 bit materials, 20 bit geometries) break as soon as
+    // clones multiply geometries, matrices and objects or material tables
+    // grow, so the 8 extra bytes are the price for fitting every scene.
     struct DrawItem {
-      bool                solid;
-      int                 materialIndex;
-      int                 geometryIndex;
-      int                 matrixIndex;
-      int                 objectIndex;
-      CadScene::DrawRange range;
+      uint32_t  m_materialIndex;
+      uint32_t  m_geometryIndex;
+      uint32_t  m_matrixIndex;
+      uint32_t  m_objectIndex;
+      uint32_t  m_firstIndex;
+      uint32_t  m_countSolid;
+
+      void set( bool solid, int materialIndex, int geometryIndex, int matrixIndex, int objectIndex, uint32_t firstIndex, uint32_t count )
+      {
+        assert( count < (uint32_t(1) << 31) );
+        m_materialIndex = uint32_t(materialIndex);
+        m_geometryIndex = uint32_t(geometryIndex);
+        m_matrixIndex   = uint32_t(matrixIndex);
+        m_objectIndex   = uint32_t(objectIndex);
+        m_firstIndex    = firstIndex;
+        m_countSolid    = (count << 1) | (solid ? 1 : 0);
+      }
+
+      bool      solid() const         { return (m_countSolid & 1) != 0; }
+      int       materialIndex() const { return int(m_materialIndex); }
+      int       geometryIndex() const { return int(m_geometryIndex); }
+      int       matrixIndex() const   { return int(m_matrixIndex); }
+      int       objectIndex() const   { return int(m_objectIndex); }
+      // add Geometry::getBaseIndex for the index within the buffer
+      uint32_t  firstIndex() const    { return m_firstIndex; }
+      uint32_t  count() const         { return m_countSolid >> 1; }
     };
+    static_assert(sizeof(DrawItem) == 24, "DrawItem must stay 4 ids, firstIndex and count|solid");
 
     static bool DrawItem_compare_groups(const DrawItem& a, const DrawItem& b)
     {
       int diff = 0;
-      diff = diff != 0 ? diff : (a.solid == b.solid ? 0 : ( a.solid ? -1 : 1 ));
-      diff = diff != 0 ? diff : (a.materialIndex - b.materialIndex);
-      diff = diff != 0 ? diff : (a.geometryIndex - b.geometryIndex);
-      diff = diff != 0 ? diff : (a.matrixIndex - b.matrixIndex);
+      diff = diff != 0 ? diff : (a.solid() == b.solid() ? 0 : ( a.solid() ? -1 : 1 ));
+      diff = diff != 0 ? diff : (a.materialIndex() - b.materialIndex());
+      diff = diff != 0 ? diff : (a.geometryIndex() - b.geometryIndex());
+      diff = diff != 0 ? diff : (a.matrixIndex() - b.matrixIndex());
 
       return diff < 0;
     }
 
+    // which items of a SortedDrawList differ after a change: the new items
+    // [begin,end) replaced the old [begin,oldEnd), the items before are
+    // unchanged and the ones after only shifted by end - oldEnd
+    struct DrawListChange {
+      size_t  begin;
+      size_t  end;
+      size_t  oldEnd;
+
+      bool isEmpty() const { return begin == end && begin == oldEnd; }
+    };
+
+    // draw items that stay sorted across scene edits. The items of changed
+    // objects are removed, their new items are sorted on their own and
+    // merged back in, so renderers can patch only the commands they
+    // generated for the returned change.
+    class SortedDrawList {
+    public:
+      SortedDrawList()
+        : m_renderer(NULL)
+        , m_solid(true)
+        , m_wire(true)
+        , m_objectOrder(false)
+      {
+
+      }
+
+      // fills and sorts all ready objects, objectOrder as in sortDrawItems
+      void init( Renderer* renderer, bool solid, bool wire, bool objectOrder );
+      void clear();
+
+      // adds objects [from,to) that are not in the list yet
+      DrawListChange insertObjects( size_t from, size_t to );
+      // objects must be ascending
+      DrawListChange removeObjects( const std::vector<uint32_t>& objects );
+      // re-fills the items of objects (ascending), e.g. after part toggles
+      DrawListChange updateObjects( const std::vector<uint32_t>& objects );
+
+      const std::vector<DrawItem>& getItems() const { return m_items; }
+
+    private:
+      DrawListChange replace( const std::vector<uint32_t>* removed, const std::vector<uint32_t>* refilled, size_t from, size_t to );
+
+      Renderer*             m_renderer;
+      bool                  m_solid;
+      bool                  m_wire;
+      bool                  m_objectOrder;
+      std::vector<DrawItem> m_items;
+      // scratch
+      std::vector<DrawItem> m_added;
+      std::vector<DrawItem> m_window;
+      std::vector<uint8_t>  m_removed;
+    };
+
+    // commands generated from a SortedDrawList only depend on their item
+    // and the one before, so the first item behind a change is regenerated
+    // along with it. Returns the regenerated items [change.begin,next) and
+    // the end of the old items [change.begin,oldNext) they replace.
+    static void getPatchRange( const DrawListChange& change, size_t numItems, size_t& next, size_t& oldNext );
+
+    // per-item offset tables hold the offset of every item's first command
+    // plus the total. Replaces the entries of the old items [begin,oldNext)
+    // by fragment, the offsets of the regenerated items [begin,next)
+    // relative to offsets[begin] plus their size, and shifts the ones behind.
+    static void spliceItemOffsets( std::vector<size_t>& offsets, size_t begin, size_t oldNext, const std::vector<size_t>& fragment );
+
+    // uploads bytes [begin,end) of data, or (re)creates buffer with room to
+    // grow and uploads all of data if size exceeds capacity. Returns true if
+    // the buffer was recreated, its GPU address must be queried again then.
+    static bool updateGrowingBuffer( GLuint& buffer, size_t& capacity, const void* data, size_t size, size_t begin, size_t end );
+
+    // replaces bytes [begin,oldEnd) of the oldSize bytes in buffer by the
+    // size bytes of data. The bytes behind are moved on the GPU, through
+    // scratch as copies within one buffer must not overlap. Recreates
+    // buffer with room to grow if needed and returns true then.
+    static bool spliceGrowingBuffer( GLuint& buffer, size_t& capacity, GLuint& scratch, size_t& scratchCapacity,
+                                     size_t oldSize, size_t begin, size_t oldEnd, const void* data, size_t size );
+
     class Type {
     public:
       Type() {
@@ -147,6 +269,9 @@ namespace csfviewer {
     typedef std::vector<Type*> Registry;
 
     static bool s_bindless_ubo;
+    // workers of fillDrawItems, large object ranges are split into one
+    // contiguous range per thread and concatenated in object order
+    static uint32_t s_fillThreads;
     static Registry& getRegistry()
     {
       static Registry s_registry;
@@ -160,13 +285,73 @@ namespace csfviewer {
     virtual void init(const CadScene* NV_RESTRICT scene, const Resources& resources) {}
     virtual void deinit() {}
     virtual void draw(ShadeType shadetype, const Resources& resources, nvh::Profiler& profiler, nvgl::ProgramManager &progManager ) {}
+    // adds objects [from,to) that became ready during a progressive load,
+    // returns false if the renderer needs a full init() instead
+    virtual bool appendObjects(size_t from, size_t to) { return false; }
+    // the draw caches of these objects changed (CadScene::updateDirtyObjects),
+    // returns false if the renderer needs a full init() instead
+    virtual bool updateObjects(const std::vector<uint32_t>& objects) { return false; }
     virtual ~Renderer() {}
 
 
     void fillDrawItems( std::vector<DrawItem>& drawItems, size_t from, size_t to, bool solid, bool wire);
+    // removes the items of objects (ascending) and appends them anew, returns
+    // where the appended items begin
+    size_t patchDrawItems( std::vector<DrawItem>& drawItems, const std::vector<uint32_t>& objects, bool solid, bool wire);
+
+    // times fillDrawItems over the per-object vectors and CadScene::FlatObjects
+    // for every strategy, the scene must not use LoadConfig::flatObjects
+    static void benchmarkFillDrawItems( CadScene& scene, int iterations );
+
+    // sorts drawItems from begin on like DrawItem_compare_groups, objectOrder
+    // additionally orders by objectIndex right after solid. Stable LSD radix
+    // sort of packed 64-bit keys whose fields are sized from the scene counts,
+    // falls back to std::sort if they do not fit.
+    void sortDrawItems( std::vector<DrawItem>& drawItems, size_t begin = 0, bool objectOrder = false);
+
+    // times std::sort with DrawItem_compare_groups against sortDrawItems on
+    // random items within the scene counts, from 100k up to maxItems
+    static void benchmarkSortDrawItems( const CadScene& scene, size_t maxItems );
+
+    // logs how many ready objects STRATEGY_ADAPTIVE assigns to each strategy,
+    // and its estimated draws, binds and token bytes against the fixed ones
+    static void logAdaptiveStrategy( const CadScene& scene, const CostModel& model );
+
+    // one cost model per renderer family
+    static const CostModel* getCostModels( size_t& count );
+    // model of a renderer by its registry name, exact or longest matching
+    // family prefix, anything else gets the token buffer model
+    static const CostModel& getCostModel( const char* name );
 
     Strategy                    m_strategy;
     const CadScene* NV_RESTRICT  m_scene;
+    // ranks the strategies of STRATEGY_ADAPTIVE, NULL is getCostModel(NULL)
+    const CostModel*            m_costModel = NULL;
+
+  private:
+    void fillDrawItemsRange( std::vector<DrawItem>& drawItems, size_t from, size_t to, bool solid, bool wire);
+    // drops the cached STRATEGY_ADAPTIVE choice of changed objects
+    void invalidateAdaptive( const std::vector<uint32_t>& objects );
+
+    // STRATEGY_ADAPTIVE choice per object, 0 if not yet chosen, otherwise
+    // strategy + 1. Only valid for the solid/wire combination and cost
+    // model it was made with.
+    std::vector<uint8_t>    m_adaptiveChoices;
+    int                     m_adaptiveMode = 0;
+    const CostModel*        m_adaptiveModel = NULL;
+
+    // per thread output of the threaded fillDrawItems, keeps its capacity
+    std::vector< std::vector<DrawItem> > m_fillArenas;
+
+    struct SortPair {
+      uint64_t  key;
+      uint32_t  index;
+    };
+
+    // scratch of sortDrawItems, kept for renderers sorting every frame
+    std::vector<SortPair>   m_sortPairs;
+    std::vector<SortPair>   m_sortPairsTemp;
+    std::vector<DrawItem>   m_sortItems;
   };
 }
 
@@ -153,19 +153,23 @@ namespace csfviewer
 #if USE_GPU_INDIRECT
       GLuint    indirectGL;
       GLuint64  indirectADDR;
+      size_t    indirectCapacity;
 #endif
 
 #if USE_VERTEX_ASSIGNS
       GLuint    assignGL;
       GLuint64  assignADDR;
+      size_t    assignCapacity;
 #endif
 
       ShadeCommand() {
 #if USE_GPU_INDIRECT
         indirectGL = 0;
+        indirectCapacity = 0;
 #endif
 #if USE_VERTEX_ASSIGNS
         assignGL = 0;
+        assignCapacity = 0;
 #endif
       }
     };
@@ -174,6 +178,8 @@ namespace csfviewer
     void init(const CadScene* NV_RESTRICT scene, const Resources& resources);
     void deinit();
     void draw(ShadeType shadetype, const Resources& resources, nvh::Profiler& profiler, nvgl::ProgramManager &progManager);
+    bool appendObjects(size_t from, size_t to);
+    bool updateObjects(const std::vector<uint32_t>& objects);
 
     bool                        m_vbum;
     bool                        m_sort;
@@ -182,6 +188,8 @@ namespace csfviewer
     RendererIndexedMDI()
       : m_vbum(false) 
       , m_sort(false)
+      , m_spliceScratch(0)
+      , m_spliceScratchCapacity(0)
     {
 
     }
@@ -189,6 +197,16 @@ namespace csfviewer
   private:
 
     ShadeCommand    m_shades[NUM_SHADES];
+
+    // the sorted variants keep their list and patch the indirect buffers,
+    // command c of a shade draws item c of the list
+    SortedDrawList        m_drawList;
+    GLuint                m_spliceScratch;
+    size_t                m_spliceScratchCapacity;
+
+    bool PatchIndirects(const DrawListChange& change);
+    void RebuildSorted(ShadeType shade);
+    void UpdateBuffers(ShadeCommand& sc, size_t indirectBegin, size_t indirectEnd, size_t assignBegin, size_t assignEnd);
     
     GLuint packBaseInstance( int matrixIndex, int materialIndex )
     {
@@ -197,11 +215,30 @@ namespace csfviewer
       return (GLuint(matrixIndex) | (GLuint(materialIndex) << 20));
     }
 
-    void GenerateIndirects(std::vector<DrawItem>& drawItems, ShadeType shade, const CadScene* NV_RESTRICT scene, const Resources& resources )
+    IndexedCommand GetCommand(const DrawItem& di, const CadScene* NV_RESTRICT scene, GLuint baseInstance)
+    {
+      const CadScene::Geometry& geo = scene->m_geometry[di.geometryIndex()];
+
+      IndexedCommand drawelems;
+      drawelems.cmd.count = di.count();
+      drawelems.cmd.firstIndex = GLuint(geo.getBaseIndex()) + di.firstIndex();
+      drawelems.cmd.baseVertex = geo.baseVertex;
+      drawelems.cmd.instanceCount = scene->getNumInstances();
+#if USE_VERTEX_ASSIGNS
+      drawelems.cmd.baseInstance = baseInstance;
+#else
+      drawelems.cmd.baseInstance = packBaseInstance(di.matrixIndex(), di.materialIndex());
+#endif
+      return drawelems;
+    }
+
+    void GenerateIndirects(const std::vector<DrawItem>& drawItems, ShadeType shade, const CadScene* NV_RESTRICT scene )
     {
       int lastMaterial = -1;
       int lastGeometry = -1;
       int lastMatrix   = -1;
+      GLuint lastVbo   = 0;
+      GLenum lastIndexType = GL_UNSIGNED_INT;
       bool lastSolid   = true;
 
       ShadeCommand& sc = m_shades[shade];
@@ -223,12 +260,19 @@ namespace csfviewer
       for (int i = 0; i < drawItems.size(); i++){
         const DrawItem& di = drawItems[i];
 
-        if (shade == SHADE_SOLID && !di.solid){
+        if (shade == SHADE_SOLID && !di.solid()){
           if (m_sort) break;
           continue;
         }
 
-        if (lastGeometry != di.geometryIndex || (shade == SHADE_SOLIDWIRE && di.solid != lastSolid)){
+        // geometries sharing buffers (arena or clones) can be drawn within
+        // the same MDI call, unless the compact format needs a new bbox
+        // or the index type differs
+        const CadScene::Geometry& geo = scene->m_geometry[di.geometryIndex()];
+        bool newGeometry = scene->m_compactVertices ? lastGeometry != di.geometryIndex() : lastVbo != geo.vboGL;
+        newGeometry = newGeometry || lastIndexType != geo.indexType;
+
+        if (newGeometry || (shade == SHADE_SOLIDWIRE && di.solid() != lastSolid)){
           sc.offsets.push_back( begin );
           sc.sizes.  push_back( GLsizei((indirectStream.size()-begin)) );
           sc.solids. push_back( lastSolid );
@@ -238,30 +282,24 @@ namespace csfviewer
         }
 
 #if USE_VERTEX_ASSIGNS
-        if (lastMatrix != di.matrixIndex || lastMaterial != di.materialIndex)
+        if (lastMatrix != di.matrixIndex() || lastMaterial != di.materialIndex())
         {
           // push indices
-          assigns.push_back(di.matrixIndex);
-          assigns.push_back(di.materialIndex);
+          assigns.push_back(di.matrixIndex());
+          assigns.push_back(di.materialIndex());
           numAssigns++;
 
-          lastMatrix    = di.matrixIndex;
-          lastMaterial  = di.materialIndex;
+          lastMatrix    = di.matrixIndex();
+          lastMaterial  = di.materialIndex();
         }
 #endif
 
-        IndexedCommand drawelems;
-        drawelems.cmd.count = di.range.count;
-        drawelems.cmd.firstIndex = GLuint((di.range.offset )/sizeof(GLuint));
-#if USE_VERTEX_ASSIGNS
-        drawelems.cmd.baseInstance = numAssigns - 1;
-#else
-        drawelems.cmd.baseInstance = packBaseInstance(di.matrixIndex, di.materialIndex);
-#endif
-        indirectStream.push_back(drawelems);
+        indirectStream.push_back(GetCommand(di, scene, numAssigns - 1));
 
-        lastGeometry = di.geometryIndex;
-        lastSolid = di.solid;
+        lastGeometry = di.geometryIndex();
+        lastVbo = geo.vboGL;
+        lastIndexType = geo.indexType;
+        lastSolid = di.solid();
       }
 
       sc.offsets.push_back( begin );
@@ -270,6 +308,84 @@ namespace csfviewer
       sc.geometries.push_back( lastGeometry );
     }
 
+    // commands of the sorted items [from,to), their assigns are numbered
+    // from assignBase on and don't share any with the commands around
+    void GenerateSortedIndirects(const std::vector<DrawItem>& drawItems, size_t from, size_t to, ShadeType shade, const CadScene* NV_RESTRICT scene,
+                                 std::vector<IndexedCommand>& indirectStream, std::vector<int>& assigns, GLuint assignBase)
+    {
+      int lastMaterial = -1;
+      int lastMatrix   = -1;
+      GLuint numAssigns = assignBase;
+
+      for (size_t i = from; i < to; i++){
+        const DrawItem& di = drawItems[i];
+
+        if (shade == SHADE_SOLID && !di.solid()){
+          break;
+        }
+
+#if USE_VERTEX_ASSIGNS
+        if (lastMatrix != di.matrixIndex() || lastMaterial != di.materialIndex())
+        {
+          assigns.push_back(di.matrixIndex());
+          assigns.push_back(di.materialIndex());
+          numAssigns++;
+
+          lastMatrix    = di.matrixIndex();
+          lastMaterial  = di.materialIndex();
+        }
+#endif
+
+        indirectStream.push_back(GetCommand(di, scene, numAssigns - 1));
+      }
+    }
+
+    bool IsNewSegment(const DrawItem& last, const DrawItem& di, ShadeType shade, const CadScene* NV_RESTRICT scene)
+    {
+      const CadScene::Geometry& lastGeo = scene->m_geometry[last.geometryIndex()];
+      const CadScene::Geometry& geo     = scene->m_geometry[di.geometryIndex()];
+      bool newGeometry = scene->m_compactVertices ? last.geometryIndex() != di.geometryIndex() : lastGeo.vboGL != geo.vboGL;
+      newGeometry = newGeometry || lastGeo.indexType != geo.indexType;
+
+      return newGeometry || (shade == SHADE_SOLIDWIRE && di.solid() != last.solid());
+    }
+
+    // MDI segments after the sorted commands [cmdBegin,cmdOldEnd) were
+    // replaced by [cmdBegin,cmdEnd). Only the segment starts within the
+    // change are evaluated again, the ones behind just move.
+    void SpliceSegments(ShadeCommand& sc, const std::vector<DrawItem>& drawItems, ShadeType shade, const CadScene* NV_RESTRICT scene,
+                        size_t cmdBegin, size_t cmdOldEnd, size_t cmdEnd)
+    {
+      size_t numCommands = sc.indirects.size();
+      size_t first = std::lower_bound(sc.offsets.begin(), sc.offsets.end(), cmdBegin)  - sc.offsets.begin();
+      size_t last  = std::upper_bound(sc.offsets.begin(), sc.offsets.end(), cmdOldEnd) - sc.offsets.begin();
+
+      sc.offsets.erase(sc.offsets.begin() + first, sc.offsets.begin() + last);
+      sc.sizes.erase(sc.sizes.begin() + first, sc.sizes.begin() + last);
+      sc.solids.erase(sc.solids.begin() + first, sc.solids.begin() + last);
+      sc.geometries.erase(sc.geometries.begin() + first, sc.geometries.begin() + last);
+
+      for (size_t i = first; i < sc.offsets.size(); i++){
+        sc.offsets[i] = sc.offsets[i] + cmdEnd - cmdOldEnd;
+      }
+
+      size_t added = 0;
+      for (size_t c = cmdBegin; c <= cmdEnd && c < numCommands; c++){
+        if (c == 0 || IsNewSegment(drawItems[c - 1], drawItems[c], shade, scene)){
+          sc.offsets.insert(sc.offsets.begin() + first + added, c);
+          sc.sizes.insert(sc.sizes.begin() + first + added, 0);
+          sc.solids.insert(sc.solids.begin() + first + added, drawItems[c].solid());
+          sc.geometries.insert(sc.geometries.begin() + first + added, drawItems[c].geometryIndex());
+          added++;
+        }
+      }
+
+      for (size_t i = first ? first - 1 : 0; i < first + added && i < sc.offsets.size(); i++){
+        size_t end = i + 1 < sc.offsets.size() ? sc.offsets[i + 1] : numCommands;
+        sc.sizes[i] = end - sc.offsets[i];
+      }
+    }
+
   };
 
   static RendererIndexedMDI::Type s_indexed;
@@ -282,18 +398,25 @@ namespace csfviewer
     m_scene = scene;
     resources.usingUboProgram(false);
 
+    if (m_sort){
+      // kept sorted across updateObjects/appendObjects, which then only
+      // patch the indirect and assign buffers
+      m_drawList.init(this, true, true, false);
+
+      for (int i = SHADE_SOLID; i <= SHADE_SOLIDWIRE; i++){
+        RebuildSorted(ShadeType(i));
+      }
+      return;
+    }
+
     std::vector<DrawItem> drawItems;
 
     fillDrawItems(drawItems,0,scene->m_objects.size(), true, true);
 
-    if (m_sort){
-      std::sort(drawItems.begin(),drawItems.end(),DrawItem_compare_groups);
-    }
-
     // build SC
 
-    GenerateIndirects(drawItems, SHADE_SOLID, scene, resources);
-    GenerateIndirects(drawItems, SHADE_SOLIDWIRE, scene, resources);
+    GenerateIndirects(drawItems, SHADE_SOLID, scene);
+    GenerateIndirects(drawItems, SHADE_SOLIDWIRE, scene);
 
     for (size_t i = 0; i <= SHADE_SOLIDWIRE; i++){
       ShadeCommand& sc = m_shades[i];
@@ -315,13 +438,122 @@ namespace csfviewer
 #endif
     }
 
-    m_shades[SHADE_SOLIDWIRE_SPLIT] = m_shades[SHADE_SOLIDWIRE];
+  }
+
+  void RendererIndexedMDI::RebuildSorted(ShadeType shade)
+  {
+    const std::vector<DrawItem>& items = m_drawList.getItems();
+    ShadeCommand& sc = m_shades[shade];
+
+    sc.indirects.clear();
+    sc.assigns.clear();
+    sc.sizes.clear();
+    sc.offsets.clear();
+    sc.solids.clear();
+    sc.geometries.clear();
+
+    GenerateSortedIndirects(items, 0, items.size(), shade, m_scene, sc.indirects, sc.assigns, 0);
+    SpliceSegments(sc, items, shade, m_scene, 0, 0, sc.indirects.size());
+
+#if USE_VERTEX_ASSIGNS
+    // recreated to drop the assigns of replaced commands
+    sc.assignCapacity = 0;
+#endif
+    UpdateBuffers(sc, 0, sc.indirects.size(), 0, sc.assigns.size());
+  }
+
+  void RendererIndexedMDI::UpdateBuffers(ShadeCommand& sc, size_t indirectBegin, size_t indirectEnd, size_t assignBegin, size_t assignEnd)
+  {
+#if USE_GPU_INDIRECT
+    if (updateGrowingBuffer(sc.indirectGL, sc.indirectCapacity, sc.indirects.data(), sizeof(IndexedCommand) * sc.indirects.size(),
+                            sizeof(IndexedCommand) * indirectBegin, sizeof(IndexedCommand) * indirectEnd) && m_vbum){
+      glGetNamedBufferParameterui64vNV(sc.indirectGL, GL_BUFFER_GPU_ADDRESS_NV, &sc.indirectADDR);
+      glMakeNamedBufferResidentNV(sc.indirectGL, GL_READ_ONLY);
+    }
+#endif
+#if USE_VERTEX_ASSIGNS
+    if (updateGrowingBuffer(sc.assignGL, sc.assignCapacity, sc.assigns.data(), sizeof(int) * sc.assigns.size(),
+                            sizeof(int) * assignBegin, sizeof(int) * assignEnd) && m_vbum){
+      glGetNamedBufferParameterui64vNV(sc.assignGL, GL_BUFFER_GPU_ADDRESS_NV, &sc.assignADDR);
+      glMakeNamedBufferResidentNV(sc.assignGL, GL_READ_ONLY);
+    }
+#endif
+  }
+
+  bool RendererIndexedMDI::appendObjects(size_t from, size_t to)
+  {
+    if (!m_sort) return false;
+
+    return PatchIndirects(m_drawList.insertObjects(from, to));
+  }
+
+  bool RendererIndexedMDI::updateObjects(const std::vector<uint32_t>& objects)
+  {
+    if (!m_sort) return false;
+
+    return PatchIndirects(m_drawList.updateObjects(objects));
+  }
+
+  bool RendererIndexedMDI::PatchIndirects(const DrawListChange& change)
+  {
+    if (change.isEmpty()) return true;
+
+    const std::vector<DrawItem>& items = m_drawList.getItems();
+
+    std::vector<IndexedCommand> indirects;
+    std::vector<int>            assigns;
+
+    for (int i = SHADE_SOLID; i <= SHADE_SOLIDWIRE; i++){
+      ShadeType shade = ShadeType(i);
+      ShadeCommand& sc = m_shades[i];
+
+      // a command only depends on its item, SHADE_SOLID has none for the
+      // wire items at the end
+      size_t oldCommands = sc.indirects.size();
+      size_t cmdBegin    = std::min(change.begin, oldCommands);
+      size_t cmdOldEnd   = std::min(change.oldEnd, oldCommands);
+
+      indirects.clear();
+      assigns.clear();
+      GenerateSortedIndirects(items, change.begin, change.end, shade, m_scene, indirects, assigns, GLuint(sc.assigns.size() / 2));
+
+#if USE_VERTEX_ASSIGNS
+      if (sizeof(int) * (sc.assigns.size() + assigns.size()) > sc.assignCapacity){
+        // out of room for the new assigns, start over compacted
+        RebuildSorted(shade);
+        continue;
+      }
+
+      // new assigns go behind all others, so the baseInstance of the
+      // commands around the change stays valid
+      glNamedBufferSubData(sc.assignGL, sizeof(int) * sc.assigns.size(), sizeof(int) * assigns.size(), assigns.data());
+      sc.assigns.insert(sc.assigns.end(), assigns.begin(), assigns.end());
+#endif
 
+#if USE_GPU_INDIRECT
+      if (spliceGrowingBuffer(sc.indirectGL, sc.indirectCapacity, m_spliceScratch, m_spliceScratchCapacity, sizeof(IndexedCommand) * oldCommands,
+                              sizeof(IndexedCommand) * cmdBegin, sizeof(IndexedCommand) * cmdOldEnd, indirects.data(), sizeof(IndexedCommand) * indirects.size()) && m_vbum){
+        glGetNamedBufferParameterui64vNV(sc.indirectGL, GL_BUFFER_GPU_ADDRESS_NV, &sc.indirectADDR);
+        glMakeNamedBufferResidentNV(sc.indirectGL, GL_READ_ONLY);
+      }
+#endif
+      sc.indirects.erase(sc.indirects.begin() + cmdBegin, sc.indirects.begin() + cmdOldEnd);
+      sc.indirects.insert(sc.indirects.begin() + cmdBegin, indirects.begin(), indirects.end());
+
+      SpliceSegments(sc, items, shade, m_scene, cmdBegin, cmdOldEnd, cmdBegin + indirects.size());
+    }
+
+    return true;
   }
 
   void RendererIndexedMDI::deinit()
   {
-    for (size_t i = 0; i < SHADE_SOLIDWIRE; i++){
+    m_drawList.clear();
+    glDeleteBuffers(1,&m_spliceScratch);
+    m_spliceScratch = 0;
+    m_spliceScratchCapacity = 0;
+
+    for (size_t i = 0; i <= SHADE_SOLIDWIRE; i++){
       ShadeCommand& sc = m_shades[i];
       if (m_vbum){
 #if USE_GPU_INDIRECT
@@ -345,7 +577,8 @@ namespace csfviewer
     const CadScene* NV_RESTRICT scene = m_scene;
     bool vbum = m_vbum;
 
-    scene->enableVertexFormat(VERTEX_POS,VERTEX_NORMAL);
+    scene->enableVertexFormat(VERTEX_POS,VERTEX_NORMAL,VERTEX_BBOXMIN,VERTEX_BBOXMAX);
+    nvgl::bindMultiTexture(GL_TEXTURE0 + TEX_INSTANCES, GL_TEXTURE_BUFFER, scene->m_instancesTexGL);
 
     glUseProgram(resources.programIdx);
 
@@ -361,7 +594,9 @@ namespace csfviewer
     glVertexAttribBinding(VERTEX_ASSIGNS,1);
     glEnableVertexAttribArray(VERTEX_ASSIGNS);
     glBindVertexBuffer(1,0,0,sizeof(GLint)*2);
-    glVertexBindingDivisor(1,1);
+    // instanced clones share the assigns of the original,
+    // so every instance of a draw must fetch baseInstance
+    glVertexBindingDivisor(1,scene->getNumInstances());
 #endif
     if (vbum){
       glEnableClientState(GL_VERTEX_ATTRIB_ARRAY_UNIFIED_NV);
@@ -379,12 +614,18 @@ namespace csfviewer
       glBindBufferBase(GL_UNIFORM_BUFFER, UBO_SCENE, resources.sceneUbo);
       glBindBufferBase(GL_UNIFORM_BUFFER, UBO_MATERIAL, scene->m_materialsGL);
     }
+    if (scene->m_materialsCompactGL){
+      // indexed shaders fetch from the packed table instead (USE_COMPACTMATERIAL)
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SSBO_MATERIAL, scene->m_materialsCompactGL);
+    }
 
-    nvgl::bindMultiTexture(GL_TEXTURE0 + TEX_MATRICES, GL_TEXTURE_BUFFER, scene->m_matricesTexGL);
+    // 3x4 rows with USE_COMPACTMATRIX, the normal matrix is derived in the shader
+    nvgl::bindMultiTexture(GL_TEXTURE0 + TEX_MATRICES, GL_TEXTURE_BUFFER, scene->m_compactMatrices ? scene->m_matricesCompactTexGL : scene->m_matricesTexGL);
     glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
 
     {
-      ShadeCommand& sc = m_shades[shadetype];
+      // the split pass draws the same commands
+      ShadeCommand& sc = m_shades[shadetype == SHADE_SOLIDWIRE_SPLIT ? SHADE_SOLIDWIRE : shadetype];
       if (vbum){
   #if USE_GPU_INDIRECT
         glBufferAddressRangeNV(GL_DRAW_INDIRECT_ADDRESS_NV, 0,       sc.indirectADDR, sc.indirects.size() * sizeof(IndexedCommand) );
@@ -408,20 +649,34 @@ namespace csfviewer
   #endif
 
       int lastGeometry = -1;
+      GLuint lastVbo  = 0;
+      GLenum indexType = GL_UNSIGNED_INT;
       bool lastSolid  = true;
       for (size_t i = 0; i < sc.geometries.size(); i++){
         int geometryIndex = sc.geometries[i];
 
         if (geometryIndex != lastGeometry){
           const CadScene::Geometry& geo = m_scene->m_geometry[ geometryIndex ];
-          if (vbum){
-            glBufferAddressRangeNV(GL_VERTEX_ATTRIB_ARRAY_ADDRESS_NV, 0,  geo.vboADDR, geo.numVertices * sizeof(CadScene::Vertex));
-            glBufferAddressRangeNV(GL_ELEMENT_ARRAY_ADDRESS_NV,0,         geo.iboADDR, (geo.numIndexSolid+geo.numIndexWire) * sizeof(GLuint));
+          if (lastVbo != geo.vboGL){
+            if (vbum){
+              glBufferAddressRangeNV(GL_VERTEX_ATTRIB_ARRAY_ADDRESS_NV, 0,  geo.vboADDR, m_scene->getVboBindSize(geo));
+              glBufferAddressRangeNV(GL_ELEMENT_ARRAY_ADDRESS_NV,0,         geo.iboADDR, m_scene->getIboBindSize(geo));
+            }
+            else{
+              glBindVertexBuffer(0, geo.vboGL, 0, GLsizei(m_scene->getVertexSize()));
+              glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, geo.iboGL);
+            }
+            lastVbo = geo.vboGL;
           }
-          else{
-            glBindVertexBuffer(0, geo.vboGL, 0, sizeof(CadScene::Vertex));
-            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, geo.iboGL);
+          if (m_scene->m_compactVertices){
+            if (vbum){
+              glBufferAddressRangeNV(GL_VERTEX_ATTRIB_ARRAY_ADDRESS_NV, CadScene::VERTEX_BBOX_BINDING, m_scene->m_geometryBboxesADDR + sizeof(CadScene::BBox) * geometryIndex, sizeof(CadScene::BBox));
+            }
+            else{
+              glBindVertexBuffer(CadScene::VERTEX_BBOX_BINDING, m_scene->m_geometryBboxesGL, sizeof(CadScene::BBox) * geometryIndex, 0);
+            }
           }
+          indexType    = geo.indexType;
           lastGeometry = geometryIndex;
         }
 
@@ -430,7 +685,7 @@ namespace csfviewer
           SetWireMode((!solid));
         }
 
-        glMultiDrawElementsIndirect(solid ? GL_TRIANGLES : GL_LINES,GL_UNSIGNED_INT, (const void*)(offset + sc.offsets[i] * sizeof(IndexedCommand)), GLsizei(sc.sizes[i]), 0);
+        glMultiDrawElementsIndirect(solid ? GL_TRIANGLES : GL_LINES,indexType, (const void*)(offset + sc.offsets[i] * sizeof(IndexedCommand)), GLsizei(sc.sizes[i]), 0);
 
         lastSolid = solid;
       }
@@ -446,6 +701,7 @@ namespace csfviewer
 
     glBindBufferBase(GL_UNIFORM_BUFFER,UBO_SCENE, 0);
     glBindBufferBase(GL_UNIFORM_BUFFER,UBO_MATERIAL, 0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER,SSBO_MATERIAL, 0);
 
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
     glBindVertexBuffer(0,0,0,0);
@@ -468,7 +724,8 @@ namespace csfviewer
 
     SetWireMode(GL_FALSE);
 
-    scene->disableVertexFormat(VERTEX_POS,VERTEX_NORMAL);
+    nvgl::bindMultiTexture(GL_TEXTURE0 + TEX_INSTANCES, GL_TEXTURE_BUFFER, 0);
+    scene->disableVertexFormat(VERTEX_POS,VERTEX_NORMAL,VERTEX_BBOXMIN,VERTEX_BBOXMAX);
 
   }
 
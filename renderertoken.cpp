@@ -206,17 +206,53 @@ namespace csfviewer
     void init(const CadScene* NV_RESTRICT scene, const Resources& resources);
     void deinit();
     void draw(ShadeType shadetype, const Resources& resources, nvh::Profiler& profiler, nvgl::ProgramManager &progManager);
+    bool appendObjects(size_t from, size_t to);
+    bool updateObjects(const std::vector<uint32_t>& objects);
 
   private:
 
     std::vector<DrawItem>       m_drawItems;
 
-    void GenerateTokens(std::vector<DrawItem>& drawItems, ShadeType shade, const CadScene* NV_RESTRICT scene, const Resources& resources )
+    // sorted variants keep their list and patch the token buffers
+    SortedDrawList              m_drawList;
+    // per sorted item its first token byte, one more for the stream end
+    std::vector<size_t>         m_itemOffsets[SHADE_SOLIDWIRE + 1];
+
+    bool isPatchable() const
+    {
+      return m_sort && !USE_PERFRAMEBUILD;
+    }
+
+    bool PatchTokens(const DrawListChange& change);
+
+    // tokens of the sorted items [from,to) continuing the state of the item
+    // before, itemOffsets gets their offsets in tokenStream plus its size
+    void GenerateSortedTokens(const std::vector<DrawItem>& drawItems, size_t from, size_t to, ShadeType shade, const CadScene* NV_RESTRICT scene,
+                              std::string& tokenStream, std::vector<size_t>& itemOffsets)
+    {
+      ItemState state;
+      if (from > 0){
+        state.setFromItem(drawItems[from - 1], scene);
+      }
+
+      for (size_t i = from; i < to; i++){
+        const DrawItem& di = drawItems[i];
+
+        itemOffsets.push_back(tokenStream.size());
+
+        if (shade == SHADE_SOLID && !di.solid()){
+          continue;
+        }
+
+        enqueueItemTokens(tokenStream, di, state, scene);
+      }
+
+      itemOffsets.push_back(tokenStream.size());
+    }
+
+    void GenerateTokens(const std::vector<DrawItem>& drawItems, ShadeType shade, const CadScene* NV_RESTRICT scene, const Resources& resources, std::vector<size_t>* itemOffsets = NULL )
     {
-      int lastMaterial = -1;
-      int lastGeometry = -1;
-      int lastMatrix   = -1;
-      bool lastSolid   = true;
+      ItemState state;
 
       ShadeCommand& sc = m_shades[shade];
       sc.fbos.clear();
@@ -247,67 +283,36 @@ namespace csfviewer
 #endif
       }
 
+      if (itemOffsets){
+        itemOffsets->clear();
+        itemOffsets->reserve(drawItems.size() + 1);
+      }
+
       for (int i = 0; i < drawItems.size(); i++){
         const DrawItem& di = drawItems[i];
 
-        if (shade == SHADE_SOLID && !di.solid){
+        if (itemOffsets){
+          itemOffsets->push_back(tokenStream.size());
+        }
+
+        if (shade == SHADE_SOLID && !di.solid()){
           continue;
         }
 
-        if (shade == SHADE_SOLIDWIRE && di.solid != lastSolid){
+        if (shade == SHADE_SOLIDWIRE && di.solid() != state.lastSolid){
           sc.offsets.push_back( begin );
           sc.sizes.  push_back( GLsizei((tokenStream.size()-begin)) );
-          sc.states. push_back( m_stateObjects[ lastSolid ? STATE_TRISOFFSET : STATE_LINES ] );
+          sc.states. push_back( m_stateObjects[ state.lastSolid ? STATE_TRISOFFSET : STATE_LINES ] );
           sc.fbos.   push_back( 0 );
 
           begin = tokenStream.size();
         }
 
-        if (lastGeometry != di.geometryIndex){
-          const CadScene::Geometry &geo = scene->m_geometry[di.geometryIndex];
-          NVTokenVbo vbo;
-          vbo.cmd.index = 0;
-          vbo.setBuffer(geo.vboGL, geo.vboADDR, 0);
-          nvtokenEnqueue(tokenStream, vbo);
-
-          NVTokenIbo ibo;
-          ibo.setBuffer(geo.iboGL, geo.iboADDR);
-          ibo.cmd.typeSizeInByte = 4;
-          nvtokenEnqueue(tokenStream, ibo);
-
-          lastGeometry = di.geometryIndex;
-        }
-
-        if (lastMatrix != di.matrixIndex){
-
-          NVTokenUbo ubo;
-          ubo.cmd.index   = UBO_MATRIX;
-          ubo.cmd.stage   = UBOSTAGE_VERTEX;
-          ubo.setBuffer(scene->m_matricesGL, scene->m_matricesADDR, sizeof(CadScene::MatrixNode) * di.matrixIndex, sizeof(CadScene::MatrixNode));
-          nvtokenEnqueue(tokenStream, ubo);
-
-          lastMatrix = di.matrixIndex;
-        }
-
-        if (lastMaterial != di.materialIndex){
-
-          NVTokenUbo ubo;
-          ubo.cmd.index   = UBO_MATERIAL;
-          ubo.cmd.stage   = UBOSTAGE_FRAGMENT;
-          ubo.setBuffer(scene->m_materialsGL, scene->m_materialsADDR, sizeof(CadScene::Material) * di.materialIndex, sizeof(CadScene::Material));
-          nvtokenEnqueue(tokenStream, ubo);
-
-          lastMaterial = di.materialIndex;
-        }
-
-
-        NVTokenDrawElemsUsed drawelems;
-        drawelems.setMode(di.solid ? GL_TRIANGLES : GL_LINES);
-        drawelems.cmd.count = di.range.count;
-        drawelems.cmd.firstIndex = GLuint((di.range.offset )/sizeof(GLuint));
-        nvtokenEnqueue(tokenStream, drawelems);
+        enqueueItemTokens(tokenStream, di, state, scene);
+      }
 
-        lastSolid = di.solid;
+      if (itemOffsets){
+        itemOffsets->push_back(tokenStream.size());
       }
 
       sc.offsets.push_back( begin );
@@ -316,7 +321,7 @@ namespace csfviewer
         sc.states. push_back( m_stateObjects[ STATE_TRIS ] );
       }
       else{
-        sc.states. push_back( m_stateObjects[ lastSolid ? STATE_TRISOFFSET : STATE_LINES ] );
+        sc.states. push_back( m_stateObjects[ state.lastSolid ? STATE_TRISOFFSET : STATE_LINES ] );
       }
       sc.fbos. push_back( 0 );
 
@@ -342,31 +347,87 @@ namespace csfviewer
 
     std::vector<DrawItem> drawItems;
 
-    fillDrawItems(drawItems,0,scene->m_objects.size(), true, true);
-
-    if (USE_PERFRAMEBUILD){
-      m_drawItems = drawItems;
+    if (isPatchable()){
+      m_drawList.init(this, true, true, false);
     }
+    else{
+      fillDrawItems(drawItems,0,scene->m_objects.size(), true, true);
+
+      if (USE_PERFRAMEBUILD){
+        m_drawItems = drawItems;
+      }
 
-    if (m_sort){
-      std::sort(drawItems.begin(),drawItems.end(),DrawItem_compare_groups);
+      if (m_sort){
+        sortDrawItems(drawItems);
+      }
     }
 
-    GenerateTokens(drawItems, SHADE_SOLID, scene, resources);
+    const std::vector<DrawItem>& items = isPatchable() ? m_drawList.getItems() : drawItems;
+
+    GenerateTokens(items, SHADE_SOLID, scene, resources, isPatchable() ? &m_itemOffsets[SHADE_SOLID] : NULL);
 
     TokenRendererBase::printStats(SHADE_SOLID);
 
-    GenerateTokens(drawItems, SHADE_SOLIDWIRE, scene, resources);
+    GenerateTokens(items, SHADE_SOLIDWIRE, scene, resources, isPatchable() ? &m_itemOffsets[SHADE_SOLIDWIRE] : NULL);
 
     TokenRendererBase::printStats(SHADE_SOLIDWIRE);
 
     TokenRendererBase::finalize(resources);
   }
 
+  bool RendererToken::appendObjects(size_t from, size_t to)
+  {
+    if (!isPatchable()) return false;
+
+    return PatchTokens(m_drawList.insertObjects(from, to));
+  }
+
+  bool RendererToken::updateObjects(const std::vector<uint32_t>& objects)
+  {
+    if (!isPatchable()) return false;
+
+    return PatchTokens(m_drawList.updateObjects(objects));
+  }
+
+  bool RendererToken::PatchTokens(const DrawListChange& change)
+  {
+    if (change.isEmpty()) return true;
+
+    const std::vector<DrawItem>& items = m_drawList.getItems();
+
+    // only the changed items and the one behind are regenerated, the
+    // tokens after them stay equal and just move
+    size_t next, oldNext;
+    getPatchRange(change, items.size(), next, oldNext);
+
+    size_t      begins[NUM_SHADES];
+    size_t      oldEnds[NUM_SHADES];
+    std::string fragments[NUM_SHADES];
+    std::vector<size_t> fragmentOffsets;
+
+    size_t firstWire = std::partition_point(items.begin(), items.end(), [](const DrawItem& di) { return di.solid(); }) - items.begin();
+
+    for (int i = SHADE_SOLID; i <= SHADE_SOLIDWIRE; i++){
+      std::vector<size_t>& itemOffsets = m_itemOffsets[i];
+      begins[i]  = itemOffsets[change.begin];
+      oldEnds[i] = itemOffsets[oldNext];
+
+      fragmentOffsets.clear();
+      GenerateSortedTokens(items, change.begin, next, ShadeType(i), m_scene, fragments[i], fragmentOffsets);
+      spliceItemOffsets(itemOffsets, change.begin, oldNext, fragmentOffsets);
+
+      setupSortedSegments(ShadeType(i), itemOffsets[firstWire], itemOffsets.back());
+    }
+
+    TokenRendererBase::spliceTokenStreams(begins, oldEnds, fragments);
+    return true;
+  }
+
   void RendererToken::deinit()
   {
     TokenRendererBase::deinit();
     m_drawItems.clear();
+    m_drawList.clear();
   }
 
   void RendererToken::draw(ShadeType shadetype, const Resources& resources, nvh::Profiler& profiler, nvgl::ProgramManager &progManager)
@@ -374,7 +435,8 @@ namespace csfviewer
     const CadScene* NV_RESTRICT scene = m_scene;
 
     // do state setup (primarily for sake of state capturing)
-    scene->enableVertexFormat(VERTEX_POS,VERTEX_NORMAL);
+    scene->enableVertexFormat(VERTEX_POS,VERTEX_NORMAL,VERTEX_BBOXMIN,VERTEX_BBOXMAX);
+    nvgl::bindMultiTexture(GL_TEXTURE0 + TEX_INSTANCES, GL_TEXTURE_BUFFER, scene->m_instancesTexGL);
 
     if (m_bindlessVboUbo){
       glEnableClientState(GL_VERTEX_ATTRIB_ARRAY_UNIFIED_NV);
@@ -398,7 +460,7 @@ namespace csfviewer
 #endif
       {
         nvh::Profiler::Section _tempTimer(profiler ,"Sort");
-        std::sort(drawItems.begin(),drawItems.end(),DrawItem_compare_groups);
+        sortDrawItems(drawItems);
       }
 
       {
@@ -466,7 +528,8 @@ namespace csfviewer
       glDisableClientState(GL_UNIFORM_BUFFER_UNIFIED_NV);
     }
 
-    scene->disableVertexFormat(VERTEX_POS,VERTEX_NORMAL);
+    nvgl::bindMultiTexture(GL_TEXTURE0 + TEX_INSTANCES, GL_TEXTURE_BUFFER, 0);
+    scene->disableVertexFormat(VERTEX_POS,VERTEX_NORMAL,VERTEX_BBOXMIN,VERTEX_BBOXMAX);
   }
 
 }
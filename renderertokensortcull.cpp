@@ -125,23 +125,11 @@ namespace csfviewer
     void deinit();
     void draw(ShadeType shadetype, const Resources& resources, nvh::Profiler& profiler, nvgl::ProgramManager &progManager);
     void drawScene(ShadeType shadetype, const Resources& resources, nvh::Profiler& profiler, nvgl::ProgramManager &progManager, const char*what);
+    bool appendObjects(size_t from, size_t to);
+    bool updateObjects(const std::vector<uint32_t>& objects);
 
   private:
 
-    static bool DrawItem_compare_groups(const DrawItem& a, const DrawItem& b)
-    {
-      int diff = 0;
-      diff = diff != 0 ? diff : (a.solid == b.solid ? 0 : ( a.solid ? -1 : 1 ));
-#if USE_OBJECTSORT_CULLING
-      diff = diff != 0 ? diff : (a.objectIndex - b.objectIndex);
-#endif
-      diff = diff != 0 ? diff : (a.materialIndex - b.materialIndex);
-      diff = diff != 0 ? diff : (a.geometryIndex - b.geometryIndex);
-      diff = diff != 0 ? diff : (a.matrixIndex - b.matrixIndex);
-
-      return diff < 0;
-    }
-
     struct CullSequence {
       GLuint    offset;
       GLint     endoffset;
@@ -164,6 +152,26 @@ namespace csfviewer
       ScanSystem::Buffer   tokenOutSizes;
       ScanSystem::Buffer   tokenOutScan;
       ScanSystem::Buffer   tokenOutScanOffset;
+
+      // buffers are allocated with room to grow, so patches rarely recreate them.
+      // Culling compacts the tokens in the order of tokenOffsets, so patched
+      // tokens are appended to tokenOrig, whose size is the bytes in use
+      size_t               tokenOrigCapacity;
+      size_t               tokenSizesCapacity;
+      size_t               tokenObjectsCapacity;
+      size_t               tokenOffsetsCapacity;
+      GLuint               tokenOutCapacity; // in tokens
+
+      CullShade()
+        : numTokens(0)
+        , tokenOrigCapacity(0)
+        , tokenSizesCapacity(0)
+        , tokenObjectsCapacity(0)
+        , tokenOffsetsCapacity(0)
+        , tokenOutCapacity(0)
+      {
+
+      }
     };
 
     class CullJobToken : public CullingSystem::Job
@@ -180,13 +188,25 @@ namespace csfviewer
       CullShade* NV_RESTRICT cullshade;
     };
 
-    std::vector<DrawItem>       m_drawItems;
+    SortedDrawList              m_drawList;
 
     CullJobToken                m_culljob;
     CullShade                   m_cullshades[NUM_SHADES];
     GLuint                      m_maxGrps;
 
+    // per shade the token arrays of the culling buffers, and per item the
+    // byte offset and index of its first token plus the totals
+    std::vector<GLuint>         m_tokenSizes[SHADE_SOLIDWIRE + 1];
+    std::vector<GLuint>         m_tokenOffsets[SHADE_SOLIDWIRE + 1];
+    std::vector<GLint>          m_tokenObjects[SHADE_SOLIDWIRE + 1];
+    std::vector<size_t>         m_itemOffsets[SHADE_SOLIDWIRE + 1];
+    std::vector<size_t>         m_itemTokens[SHADE_SOLIDWIRE + 1];
+
     void PrepareCullJob(ShadeType shade);
+    void UpdateCullBuffers(ShadeType shade);
+    void UpdateCullScratch(ShadeType shade);
+    void SetupSortedSequences(ShadeType shade, size_t firstWire);
+    bool PatchTokens(const DrawListChange& change);
 
 
     template <class T>
@@ -197,35 +217,74 @@ namespace csfviewer
       tokenObjects.push_back(obj);
     }
 
-    void GenerateTokens(std::vector<DrawItem>& drawItems, ShadeType shade, const CadScene* NV_RESTRICT scene, const Resources& resources )
+    void GenerateItemTokens(const DrawItem& di, ItemState& state, const CadScene* NV_RESTRICT scene, std::string& tokenStream,
+                            std::vector<GLuint> &tokenSizes, std::vector<GLuint> &tokenOffsets, std::vector<GLint>& tokenObjects)
+    {
+      int bufferObjIndex = -1;
+#if USE_OBJECTSORT_CULLING
+      bufferObjIndex = di.objectIndex();
+      if (di.objectIndex() != state.lastObject || di.solid() != state.lastSolid){
+        // whenever an object changes or we switches from solid to edges (happens only once in this sorted scenario)
+        // we have to ensure all buffers are reset as well
+        state.lastObject = di.objectIndex();
+        state.lastMaterial = -1;
+        state.lastGeometry = -1;
+        state.lastMatrix   = -1;
+        state.lastVbo      = 0;
+      }
+#endif
+
+      TokenArrays arrays = { tokenSizes, tokenOffsets, tokenObjects };
+      enqueueItemTokens(tokenStream, di, state, scene, &arrays, bufferObjIndex);
+    }
+
+    // tokens of the items [from,to) continuing the state of the item before,
+    // appended to tokenStream and the token arrays. Per item the offset of
+    // its first token and index of it are appended, plus the totals.
+    void GenerateItemRangeTokens(const std::vector<DrawItem>& drawItems, size_t from, size_t to, ShadeType shade, const CadScene* NV_RESTRICT scene,
+                                 std::string& tokenStream, std::vector<size_t>& itemOffsets, std::vector<size_t>& itemTokens,
+                                 std::vector<GLuint> &tokenSizes, std::vector<GLuint> &tokenOffsets, std::vector<GLint>& tokenObjects)
     {
-      int lastMaterial = -1;
-      int lastGeometry = -1;
-      int lastMatrix   = -1;
-      int lastObject   = -1;
-      bool lastSolid   = true;
+      ItemState state;
+      if (from > 0){
+        state.setFromItem(drawItems[from - 1], scene);
+      }
 
-      ShadeCommand& sc = m_shades[shade];
-      CullShade& cull = m_cullshades[shade];
+      for (size_t i = from; i < to; i++){
+        const DrawItem& di = drawItems[i];
 
-      sc.fbos.clear();
-      sc.offsets.clear();
-      sc.sizes.clear();
-      sc.states.clear();
+        itemOffsets.push_back(tokenStream.size());
+        itemTokens.push_back(tokenSizes.size());
 
-      std::string& tokenStream = m_tokenStreams[shade];
-      tokenStream.clear();
+        if (shade == SHADE_SOLID && !di.solid()){
+          continue;
+        }
+
+        GenerateItemTokens(di, state, scene, tokenStream, tokenSizes, tokenOffsets, tokenObjects);
+      }
+
+      itemOffsets.push_back(tokenStream.size());
+      itemTokens.push_back(tokenSizes.size());
+    }
 
+    void GenerateTokens(const std::vector<DrawItem>& drawItems, ShadeType shade, const CadScene* NV_RESTRICT scene, const Resources& resources )
+    {
+      CullShade& cull = m_cullshades[shade];
 
-      cull.numTokens = 0;
-      GLuint beginToken = 0;
+      std::string& tokenStream = m_tokenStreams[shade];
+      tokenStream.clear();
 
-      size_t begin = 0;
-      size_t start = begin;
+      std::vector<GLuint>& tokenSizes   = m_tokenSizes[shade];
+      std::vector<GLuint>& tokenOffsets = m_tokenOffsets[shade];
+      std::vector<GLint>&  tokenObjects = m_tokenObjects[shade];
+      tokenSizes.clear();
+      tokenOffsets.clear();
+      tokenObjects.clear();
 
-      std::vector<GLuint> tokenSizes;
-      std::vector<GLuint> tokenOffsets;
-      std::vector<GLint>  tokenObjects;
+      std::vector<size_t>& itemOffsets = m_itemOffsets[shade];
+      std::vector<size_t>& itemTokens  = m_itemTokens[shade];
+      itemOffsets.clear();
+      itemTokens.clear();
 
       {
         NVTokenUbo ubo;
@@ -233,147 +292,28 @@ namespace csfviewer
         ubo.cmd.stage   = UBOSTAGE_VERTEX;
         ubo.setBuffer(resources.sceneUbo, resources.sceneAddr, 0, sizeof(SceneData) );
         nvtokenEnqueue(tokenStream, ubo);
-        handleToken(tokenSizes,tokenOffsets,tokenObjects, ubo, tokenStream.size()-start, -1);
-        cull.numTokens++;
+        handleToken(tokenSizes,tokenOffsets,tokenObjects, ubo, tokenStream.size(), -1);
 
         ubo.cmd.stage   = UBOSTAGE_FRAGMENT;
         nvtokenEnqueue(tokenStream, ubo);
-        handleToken(tokenSizes,tokenOffsets,tokenObjects, ubo, tokenStream.size()-start, -1);
-        cull.numTokens++;
+        handleToken(tokenSizes,tokenOffsets,tokenObjects, ubo, tokenStream.size(), -1);
 
 #if USE_POLYOFFSETTOKEN
         NVTokenPolygonOffset offset;
         offset.cmd.bias = 1;
         offset.cmd.scale = 1;
         nvtokenEnqueue(tokenStream, offset);
-        handleToken(tokenSizes,tokenOffsets,tokenObjects, offset, tokenStream.size()-start, -1);
-        cull.numTokens++;
-#endif
-      }
-
-      for (int i = 0; i < drawItems.size(); i++){
-        const DrawItem& di = drawItems[i];
-
-        if (shade == SHADE_SOLID && !di.solid){
-          continue;
-        }
-
-        int bufferObjIndex = -1;
-#if USE_OBJECTSORT_CULLING
-        bufferObjIndex = di.objectIndex;
-        if (di.objectIndex != lastObject || di.solid != lastSolid){
-          // whenever an object changes or we switches from solid to edges (happens only once in this sorted scenario)
-          // we have to ensure all buffers are reset as well
-          lastObject = di.objectIndex;
-          lastMaterial = -1;
-          lastGeometry = -1;
-          lastMatrix   = -1;
-        }
+        handleToken(tokenSizes,tokenOffsets,tokenObjects, offset, tokenStream.size(), -1);
 #endif
-
-        if (shade == SHADE_SOLIDWIRE && di.solid != lastSolid){
-          sc.offsets.push_back( begin );
-          sc.sizes.  push_back( GLsizei((tokenStream.size()-begin)) );
-          sc.states. push_back( m_stateObjects[ lastSolid ? STATE_TRISOFFSET : STATE_LINES ] );
-          sc.fbos.   push_back( 0 );
-          CullSequence cullseq;
-          cullseq.num     = cull.numTokens - beginToken;
-          cullseq.first   = beginToken;
-          cullseq.offset  = GLuint((begin-start)/sizeof(GLuint));
-          cullseq.endoffset = GLuint((tokenStream.size()-start)/sizeof(GLuint));
-          cull.sequnces.push_back(cullseq);
-
-          beginToken = cull.numTokens;
-          begin = tokenStream.size();
-        }
-
-        if (lastGeometry != di.geometryIndex){
-          const CadScene::Geometry &geo = scene->m_geometry[di.geometryIndex];
-          NVTokenVbo vbo;
-          vbo.cmd.index = 0;
-          vbo.setBuffer(geo.vboGL, geo.vboADDR, 0);
-
-          nvtokenEnqueue(tokenStream, vbo);
-          handleToken(tokenSizes,tokenOffsets,tokenObjects, vbo, tokenStream.size()-start, bufferObjIndex);
-          cull.numTokens++;
-
-          NVTokenIbo ibo;
-          ibo.setBuffer(geo.iboGL, geo.iboADDR);
-          ibo.cmd.typeSizeInByte = 4;
-          nvtokenEnqueue(tokenStream, ibo);
-          handleToken(tokenSizes,tokenOffsets,tokenObjects, vbo, tokenStream.size()-start, bufferObjIndex);
-          cull.numTokens++;
-
-          lastGeometry = di.geometryIndex;
-        }
-
-        if (lastMatrix != di.matrixIndex){
-
-          NVTokenUbo ubo;
-          ubo.cmd.index   = UBO_MATRIX;
-          ubo.cmd.stage   = UBOSTAGE_VERTEX;
-          ubo.setBuffer(scene->m_matricesGL, scene->m_matricesADDR, sizeof(CadScene::MatrixNode) * di.matrixIndex, sizeof(CadScene::MatrixNode) );
-          nvtokenEnqueue(tokenStream, ubo);
-          handleToken(tokenSizes,tokenOffsets,tokenObjects, ubo, tokenStream.size()-start, bufferObjIndex);
-          cull.numTokens++;
-
-          lastMatrix = di.matrixIndex;
-        }
-
-        if (lastMaterial != di.materialIndex){
-
-          NVTokenUbo ubo;
-          ubo.cmd.index   = UBO_MATERIAL;
-          ubo.cmd.stage   = UBOSTAGE_FRAGMENT;
-          ubo.setBuffer(scene->m_materialsGL, scene->m_materialsADDR, sizeof(CadScene::Material) * di.materialIndex, sizeof(CadScene::Material) );
-          nvtokenEnqueue(tokenStream, ubo);
-          handleToken(tokenSizes,tokenOffsets,tokenObjects, ubo, tokenStream.size()-start, bufferObjIndex);
-          cull.numTokens++;
-
-          lastMaterial = di.materialIndex;
-        }
-
-
-        NVTokenDrawElemsUsed drawelems;
-        drawelems.setMode(di.solid ? GL_TRIANGLES : GL_LINES);
-        drawelems.cmd.count = di.range.count;
-        drawelems.cmd.firstIndex = GLuint((di.range.offset )/sizeof(GLuint));
-        nvtokenEnqueue(tokenStream, drawelems);
-        handleToken(tokenSizes,tokenOffsets,tokenObjects, drawelems, tokenStream.size()-start, di.objectIndex);
-        cull.numTokens++;
-
-        lastSolid = di.solid;
-      }
-
-      sc.offsets.push_back( begin );
-      sc.sizes.  push_back( GLsizei((tokenStream.size()-begin)) );
-      if (shade == SHADE_SOLID){
-        sc.states. push_back( m_stateObjects[ STATE_TRIS ] );
       }
-      else{
-        sc.states. push_back( m_stateObjects[ lastSolid ? STATE_TRISOFFSET : STATE_LINES ] );
-      }
-      sc.fbos. push_back( 0 );
-
-      CullSequence cullseq;
-      cullseq.num     = cull.numTokens - beginToken;
-      cullseq.first   = beginToken;
-      cullseq.offset  = GLuint((begin-start)/sizeof(GLuint));
-      cullseq.endoffset = GLuint((tokenStream.size()-start)/sizeof(GLuint));
-      cull.sequnces.push_back(cullseq);
 
-      // create buffers for culling
-      cull.tokenOrig.create(tokenStream.size() - start,&tokenStream[start], 0);
+      GenerateItemRangeTokens(drawItems, 0, drawItems.size(), shade, scene, tokenStream, itemOffsets, itemTokens, tokenSizes, tokenOffsets, tokenObjects);
+      cull.numTokens = GLuint(tokenSizes.size());
 
-      cull.tokenOffsets.create(sizeof(GLuint)*cull.numTokens,&tokenOffsets[0], 0);
-      cull.tokenSizes.  create(sizeof(GLuint)*cull.numTokens,&tokenSizes[0], 0);
-      cull.tokenObjects.create(sizeof(GLint)*cull.numTokens,&tokenObjects[0], 0);
-
-      int round4 = ((cull.numTokens+3)/4)*4;
-
-      cull.tokenOutScan.      create(sizeof(GLuint)*round4,NULL, 0);
-      cull.tokenOutScanOffset.create(std::max(ScanSystem::getOffsetSize(round4), size_t(16)),NULL, 0);
-      cull.tokenOutSizes.     create(sizeof(GLuint)*round4,NULL, 0);
+      // the list is sorted, solid items come first
+      size_t firstWire = std::partition_point(drawItems.begin(), drawItems.end(), [](const DrawItem& di) { return di.solid(); }) - drawItems.begin();
+      setupSortedSegments(shade, itemOffsets[firstWire], tokenStream.size());
+      SetupSortedSequences(shade, firstWire);
     }
 
   };
@@ -392,17 +332,18 @@ namespace csfviewer
     m_scene = scene;
     glGetIntegeri_v(GL_MAX_COMPUTE_WORK_GROUP_COUNT,0,(GLint*)&m_maxGrps);
 
-    std::vector<DrawItem> drawItems;
-
-    fillDrawItems(drawItems,0,scene->m_objects.size(), true, true);
+    // the list stays sorted across updateObjects/appendObjects, which then
+    // only patch the token and culling buffers
+    m_drawList.init(this, true, true, USE_OBJECTSORT_CULLING != 0);
+    m_sort = true;
 
-    std::sort(drawItems.begin(),drawItems.end(),DrawItem_compare_groups);
-
-    GenerateTokens(drawItems, SHADE_SOLID, scene, resources);
+    GenerateTokens(m_drawList.getItems(), SHADE_SOLID, scene, resources);
+    UpdateCullBuffers(SHADE_SOLID);
 
     TokenRendererBase::printStats(SHADE_SOLID);
 
-    GenerateTokens(drawItems, SHADE_SOLIDWIRE, scene, resources);
+    GenerateTokens(m_drawList.getItems(), SHADE_SOLIDWIRE, scene, resources);
+    UpdateCullBuffers(SHADE_SOLIDWIRE);
 
     TokenRendererBase::printStats(SHADE_SOLIDWIRE);
 
@@ -436,6 +377,10 @@ namespace csfviewer
 
     m_culljob.m_bufferVisOutput.create(sizeof(int)*roundedInts,NULL,0);
     m_cullshades[SHADE_SOLIDWIRE_SPLIT] = m_cullshades[SHADE_SOLIDWIRE];
+
+    if (scene->getNumInstances() > 1){
+      LOGW("tokensortcull: culling is disabled for instanced clones\n");
+    }
   }
 
   void RendererCullSortToken::deinit()
@@ -458,7 +403,190 @@ namespace csfviewer
 
 
     TokenRendererBase::deinit();
-    m_drawItems.clear();
+    m_drawList.clear();
+  }
+
+  void RendererCullSortToken::SetupSortedSequences(ShadeType shade, size_t firstWire)
+  {
+    CullShade& cull = m_cullshades[shade];
+    const std::vector<size_t>& itemOffsets = m_itemOffsets[shade];
+    const std::vector<size_t>& itemTokens  = m_itemTokens[shade];
+    size_t numItems = itemTokens.size() - 1;
+    size_t split    = shade == SHADE_SOLIDWIRE ? firstWire : numItems;
+
+    cull.sequnces.clear();
+
+    CullSequence cullseq;
+    cullseq.num       = int(itemTokens[split]);
+    cullseq.first     = 0;
+    cullseq.offset    = 0;
+    cullseq.endoffset = GLuint(itemOffsets[split]/sizeof(GLuint));
+    cull.sequnces.push_back(cullseq);
+
+    if (split < numItems){
+      cullseq.num       = int(cull.numTokens - itemTokens[split]);
+      cullseq.first     = int(itemTokens[split]);
+      cullseq.offset    = GLuint(itemOffsets[split]/sizeof(GLuint));
+      cullseq.endoffset = GLuint(itemOffsets.back()/sizeof(GLuint));
+      cull.sequnces.push_back(cullseq);
+    }
+  }
+
+  void RendererCullSortToken::UpdateCullBuffers(ShadeType shade)
+  {
+    CullShade& cull = m_cullshades[shade];
+    const std::string& tokenStream = m_tokenStreams[shade];
+
+    // also compacts the patched tokens appended to tokenOrig
+    cull.tokenOrigCapacity = 0;
+    updateGrowingBuffer(cull.tokenOrig.buffer, cull.tokenOrigCapacity, tokenStream.data(), tokenStream.size(), 0, 0);
+    cull.tokenOrig.size = tokenStream.size();
+
+    updateGrowingBuffer(cull.tokenOffsets.buffer, cull.tokenOffsetsCapacity, m_tokenOffsets[shade].data(),
+                        sizeof(GLuint)*cull.numTokens, 0, sizeof(GLuint)*cull.numTokens);
+    updateGrowingBuffer(cull.tokenSizes.buffer, cull.tokenSizesCapacity, m_tokenSizes[shade].data(),
+                        sizeof(GLuint)*cull.numTokens, 0, sizeof(GLuint)*cull.numTokens);
+    updateGrowingBuffer(cull.tokenObjects.buffer, cull.tokenObjectsCapacity, m_tokenObjects[shade].data(),
+                        sizeof(GLint)*cull.numTokens, 0, sizeof(GLint)*cull.numTokens);
+
+    UpdateCullScratch(shade);
+  }
+
+  void RendererCullSortToken::UpdateCullScratch(ShadeType shade)
+  {
+    CullShade& cull = m_cullshades[shade];
+
+    cull.tokenOffsets.size = sizeof(GLuint)*cull.numTokens;
+    cull.tokenSizes.size   = sizeof(GLuint)*cull.numTokens;
+    cull.tokenObjects.size = sizeof(GLint)*cull.numTokens;
+
+    // scratch of the scan, contents don't survive
+    GLuint round4 = ((cull.numTokens+3)/4)*4;
+    if (round4 > cull.tokenOutCapacity){
+      glDeleteBuffers(1,&cull.tokenOutScan.buffer);
+      glDeleteBuffers(1,&cull.tokenOutScanOffset.buffer);
+      glDeleteBuffers(1,&cull.tokenOutSizes.buffer);
+
+      cull.tokenOutCapacity = ((round4 + round4/4 + 3)/4)*4;
+
+      cull.tokenOutScan.      create(sizeof(GLuint)*cull.tokenOutCapacity,NULL, 0);
+      cull.tokenOutScanOffset.create(std::max(ScanSystem::getOffsetSize(cull.tokenOutCapacity), size_t(16)),NULL, 0);
+      cull.tokenOutSizes.     create(sizeof(GLuint)*cull.tokenOutCapacity,NULL, 0);
+    }
+    cull.tokenOutScan.      size = sizeof(GLuint)*round4;
+    cull.tokenOutScanOffset.size = std::max(ScanSystem::getOffsetSize(round4), size_t(16));
+    cull.tokenOutSizes.     size = sizeof(GLuint)*round4;
+  }
+
+  bool RendererCullSortToken::appendObjects(size_t from, size_t to)
+  {
+    // the emulation reads the culled streams back every frame anyway
+    if (m_emulate) return false;
+
+    return PatchTokens(m_drawList.insertObjects(from, to));
+  }
+
+  bool RendererCullSortToken::updateObjects(const std::vector<uint32_t>& objects)
+  {
+    if (m_emulate) return false;
+
+    return PatchTokens(m_drawList.updateObjects(objects));
+  }
+
+  template <class T>
+  static void spliceArray(std::vector<T>& array, size_t begin, size_t oldEnd, const std::vector<T>& fragment)
+  {
+    array.erase(array.begin() + begin, array.begin() + oldEnd);
+    array.insert(array.begin() + begin, fragment.begin(), fragment.end());
+  }
+
+  bool RendererCullSortToken::PatchTokens(const DrawListChange& change)
+  {
+    if (change.isEmpty()) return true;
+
+    const std::vector<DrawItem>& items = m_drawList.getItems();
+
+    // only the changed items and the one behind are regenerated, the
+    // tokens after them stay where they are in tokenOrig
+    size_t next, oldNext;
+    getPatchRange(change, items.size(), next, oldNext);
+
+    size_t firstWire = std::partition_point(items.begin(), items.end(), [](const DrawItem& di) { return di.solid(); }) - items.begin();
+
+    size_t      begins[NUM_SHADES];
+    size_t      oldEnds[NUM_SHADES];
+    std::string fragments[NUM_SHADES];
+
+    std::vector<size_t> fragmentOffsets;
+    std::vector<size_t> fragmentTokens;
+    std::vector<GLuint> tokenSizes;
+    std::vector<GLuint> tokenOffsets;
+    std::vector<GLint>  tokenObjects;
+
+    for (int i = SHADE_SOLID; i <= SHADE_SOLIDWIRE; i++){
+      ShadeType shade = ShadeType(i);
+      CullShade& cull = m_cullshades[i];
+
+      begins[i]  = m_itemOffsets[i][change.begin];
+      oldEnds[i] = m_itemOffsets[i][oldNext];
+      size_t tokenBegin  = m_itemTokens[i][change.begin];
+      size_t tokenOldEnd = m_itemTokens[i][oldNext];
+
+      fragmentOffsets.clear();
+      fragmentTokens.clear();
+      tokenSizes.clear();
+      tokenOffsets.clear();
+      tokenObjects.clear();
+      GenerateItemRangeTokens(items, change.begin, next, shade, m_scene, fragments[i], fragmentOffsets, fragmentTokens, tokenSizes, tokenOffsets, tokenObjects);
+
+      if (cull.tokenOrig.size + fragments[i].size() > cull.tokenOrigCapacity){
+        // tokenOrig is full of replaced tokens, start over compacted
+        std::string oldStream;
+        oldStream.swap(m_tokenStreams[i]);
+        GenerateTokens(items, shade, m_scene, *m_resources);
+        UpdateCullBuffers(shade);
+
+        fragments[i].swap(m_tokenStreams[i]);
+        m_tokenStreams[i].swap(oldStream);
+        begins[i]  = 0;
+        oldEnds[i] = m_tokenStreams[i].size();
+        continue;
+      }
+
+      // the new tokens go behind all others in tokenOrig
+      GLuint origOffset = GLuint(cull.tokenOrig.size / sizeof(GLuint));
+      for (size_t t = 0; t < tokenOffsets.size(); t++){
+        tokenOffsets[t] += origOffset;
+      }
+      glNamedBufferSubData(cull.tokenOrig.buffer, cull.tokenOrig.size, fragments[i].size(), fragments[i].data());
+      cull.tokenOrig.size += fragments[i].size();
+
+      size_t oldTokens = cull.numTokens;
+      spliceGrowingBuffer(cull.tokenSizes.buffer, cull.tokenSizesCapacity, m_spliceScratch, m_spliceScratchCapacity,
+                          sizeof(GLuint)*oldTokens, sizeof(GLuint)*tokenBegin, sizeof(GLuint)*tokenOldEnd, tokenSizes.data(), sizeof(GLuint)*tokenSizes.size());
+      spliceGrowingBuffer(cull.tokenOffsets.buffer, cull.tokenOffsetsCapacity, m_spliceScratch, m_spliceScratchCapacity,
+                          sizeof(GLuint)*oldTokens, sizeof(GLuint)*tokenBegin, sizeof(GLuint)*tokenOldEnd, tokenOffsets.data(), sizeof(GLuint)*tokenOffsets.size());
+      spliceGrowingBuffer(cull.tokenObjects.buffer, cull.tokenObjectsCapacity, m_spliceScratch, m_spliceScratchCapacity,
+                          sizeof(GLint)*oldTokens, sizeof(GLint)*tokenBegin, sizeof(GLint)*tokenOldEnd, tokenObjects.data(), sizeof(GLint)*tokenObjects.size());
+
+      spliceArray(m_tokenSizes[i],   tokenBegin, tokenOldEnd, tokenSizes);
+      spliceArray(m_tokenOffsets[i], tokenBegin, tokenOldEnd, tokenOffsets);
+      spliceArray(m_tokenObjects[i], tokenBegin, tokenOldEnd, tokenObjects);
+      cull.numTokens = GLuint(m_tokenSizes[i].size());
+
+      spliceItemOffsets(m_itemOffsets[i], change.begin, oldNext, fragmentOffsets);
+      spliceItemOffsets(m_itemTokens[i],  change.begin, oldNext, fragmentTokens);
+
+      setupSortedSegments(shade, m_itemOffsets[i][firstWire], m_itemOffsets[i].back());
+      SetupSortedSequences(shade, firstWire);
+      UpdateCullScratch(shade);
+    }
+
+    m_cullshades[SHADE_SOLIDWIRE_SPLIT] = m_cullshades[SHADE_SOLIDWIRE];
+
+    // the token buffers are overwritten by culling, they only need to fit
+    spliceTokenStreams(begins, oldEnds, fragments, false);
+    return true;
   }
 
   void RendererCullSortToken::PrepareCullJob(ShadeType shade)
@@ -471,7 +599,7 @@ namespace csfviewer
     // setup buffer offsets
     job.tokenOut.buffer = m_tokenBuffers[shade];
     job.tokenOut.offset = sc.offsets[0];
-    job.tokenOut.size   = m_cullshades[shade].tokenOrig.size;
+    job.tokenOut.size   = m_tokenStreams[shade].size();
   }
 
   void RendererCullSortToken::CullJobToken::resultFromBits( const CullingSystem::Buffer& bufferVisBitsCurrent )
@@ -552,7 +680,8 @@ namespace csfviewer
     nvh::Profiler::Section  section(profiler,what);
 
     // do state setup (primarily for sake of state capturing)
-    m_scene->enableVertexFormat(VERTEX_POS,VERTEX_NORMAL);
+    m_scene->enableVertexFormat(VERTEX_POS,VERTEX_NORMAL,VERTEX_BBOXMIN,VERTEX_BBOXMAX);
+    nvgl::bindMultiTexture(GL_TEXTURE0 + TEX_INSTANCES, GL_TEXTURE_BUFFER, m_scene->m_instancesTexGL);
 
     if (m_bindlessVboUbo){
       glEnableClientState(GL_VERTEX_ATTRIB_ARRAY_UNIFIED_NV);
@@ -600,7 +729,8 @@ namespace csfviewer
       glDisableClientState(GL_UNIFORM_BUFFER_UNIFIED_NV);
     }
 
-    scene->disableVertexFormat(VERTEX_POS,VERTEX_NORMAL);
+    nvgl::bindMultiTexture(GL_TEXTURE0 + TEX_INSTANCES, GL_TEXTURE_BUFFER, 0);
+    scene->disableVertexFormat(VERTEX_POS,VERTEX_NORMAL,VERTEX_BBOXMIN,VERTEX_BBOXMAX);
   }
 
 
@@ -611,6 +741,13 @@ namespace csfviewer
     // broken in other types atm
     //shadetype = SHADE_SOLID;
 
+    if (m_scene->getNumInstances() > 1){
+      // culling only knows the original objects, which would take their
+      // instanced clones along, so the unculled stream is drawn instead
+      drawScene(shadetype,resources,profiler,progManager, "Draw");
+      return;
+    }
+
     m_culljob.program_cmds  = progManager.get( Shared::get().token_cmds );
     m_culljob.program_sizes = progManager.get( Shared::get().token_sizes );
 
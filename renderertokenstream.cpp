@@ -76,6 +76,8 @@ namespace csfviewer
     void init(const CadScene* NV_RESTRICT scene, const Resources& resources);
     void deinit();
     void draw(ShadeType shadetype, const Resources& resources, nvh::Profiler& profiler, nvgl::ProgramManager &progManager);
+    bool appendObjects(size_t from, size_t to);
+    bool updateObjects(const std::vector<uint32_t>& objects);
 
   private:
 
@@ -85,10 +87,7 @@ namespace csfviewer
 
     size_t GenerateTokens(NVPointerStream& tokenStream, std::vector<DrawItem>& drawItems, size_t from, ShadeType shade, const CadScene* NV_RESTRICT scene, const Resources& resources )
     {
-      int lastMaterial = -1;
-      int lastGeometry = -1;
-      int lastMatrix   = -1;
-      bool lastSolid   = true;
+      ItemState state;
 
       ShadeCommand& sc = m_shades[shade];
       sc.fbos.clear();
@@ -120,20 +119,20 @@ namespace csfviewer
       for (; i < drawItems.size(); i++){
         const DrawItem& di = drawItems[i];
 
-        if (tokenStream.size() + sizeof(NVTokenIbo) + sizeof(NVTokenVbo) + sizeof(NVTokenUbo)*2 + sizeof(NVTokenDrawElemsUsed) > tokenStream.capacity()){
+        if (tokenStream.size() + sizeof(NVTokenIbo) + sizeof(NVTokenVbo)*2 + sizeof(NVTokenUbo)*2 + std::max(sizeof(NVTokenDrawElemsUsed), sizeof(NVTokenDrawElemsInstanced)) > tokenStream.capacity()){
           break;
         }
 
-        if (shade == SHADE_SOLID && !di.solid){
+        if (shade == SHADE_SOLID && !di.solid()){
           continue;
         }
 
-        if ((shade == SHADE_SOLIDWIRE || shade == SHADE_SOLIDWIRE_SPLIT) && di.solid != lastSolid){
+        if ((shade == SHADE_SOLIDWIRE || shade == SHADE_SOLIDWIRE_SPLIT) && di.solid() != state.lastSolid){
           sc.offsets.push_back( begin );
           sc.sizes.  push_back( GLsizei((tokenStream.size()-begin)) );
-          sc.states. push_back( m_stateObjects[ lastSolid ? STATE_TRISOFFSET : STATE_LINES ] );
+          sc.states. push_back( m_stateObjects[ state.lastSolid ? STATE_TRISOFFSET : STATE_LINES ] );
           if ( shade == SHADE_SOLIDWIRE_SPLIT ){
-            sc.fbos.   push_back( USE_STATEFBO_SPLIT ? 0 : ( di.solid ? resources.fbo : resources.fbo2  ) );
+            sc.fbos.   push_back( USE_STATEFBO_SPLIT ? 0 : ( di.solid() ? resources.fbo : resources.fbo2  ) );
           }
           else{
             sc.fbos.push_back(0);
@@ -143,51 +142,7 @@ namespace csfviewer
           begin = tokenStream.size();
         }
 
-        if (lastGeometry != di.geometryIndex){
-          const CadScene::Geometry &geo = scene->m_geometry[di.geometryIndex];
-          NVTokenVbo vbo;
-          vbo.cmd.index = 0;
-          vbo.setBuffer(geo.vboGL, geo.vboADDR, 0);
-          nvtokenEnqueue(tokenStream, vbo);
-
-          NVTokenIbo ibo;
-          ibo.setBuffer(geo.iboGL, geo.iboADDR);
-          ibo.cmd.typeSizeInByte = 4;
-          nvtokenEnqueue(tokenStream, ibo);
-
-          lastGeometry = di.geometryIndex;
-        }
-
-        if (lastMatrix != di.matrixIndex){
-
-          NVTokenUbo ubo;
-          ubo.cmd.index   = UBO_MATRIX;
-          ubo.cmd.stage   = UBOSTAGE_VERTEX;
-          ubo.setBuffer(scene->m_matricesGL, scene->m_matricesADDR, sizeof(CadScene::MatrixNode) * di.matrixIndex, sizeof(CadScene::MatrixNode));
-          nvtokenEnqueue(tokenStream, ubo);
-
-          lastMatrix = di.matrixIndex;
-        }
-
-        if (lastMaterial != di.materialIndex){
-
-          NVTokenUbo ubo;
-          ubo.cmd.index   = UBO_MATERIAL;
-          ubo.cmd.stage   = UBOSTAGE_FRAGMENT;
-          ubo.setBuffer(scene->m_materialsGL, scene->m_materialsADDR, sizeof(CadScene::Material) * di.materialIndex, sizeof(CadScene::Material));
-          nvtokenEnqueue(tokenStream, ubo);
-
-          lastMaterial = di.materialIndex;
-        }
-
-
-        NVTokenDrawElemsUsed drawelems;
-        drawelems.setMode(di.solid ? GL_TRIANGLES : GL_LINES);
-        drawelems.cmd.count = di.range.count;
-        drawelems.cmd.firstIndex = GLuint((di.range.offset )/sizeof(GLuint));
-        nvtokenEnqueue(tokenStream, drawelems);
-
-        lastSolid = di.solid;
+        enqueueItemTokens(tokenStream, di, state, scene);
       }
 
       sc.offsets.push_back( begin );
@@ -196,10 +151,10 @@ namespace csfviewer
         sc.states. push_back( m_stateObjects[ STATE_TRIS ] );
       }
       else{
-        sc.states. push_back( m_stateObjects[ lastSolid ? STATE_TRISOFFSET : STATE_LINES ] );
+        sc.states. push_back( m_stateObjects[ state.lastSolid ? STATE_TRISOFFSET : STATE_LINES ] );
       }
       if ( shade == SHADE_SOLIDWIRE_SPLIT ){
-        sc.fbos.   push_back( USE_STATEFBO_SPLIT ? 0 : ( lastSolid ? resources.fbo : resources.fbo2  ) );
+        sc.fbos.   push_back( USE_STATEFBO_SPLIT ? 0 : ( state.lastSolid ? resources.fbo : resources.fbo2  ) );
       }
       else{
         sc.fbos.push_back(0);
@@ -230,6 +185,19 @@ namespace csfviewer
     }
   }
 
+  bool RendererTokenStream::appendObjects(size_t from, size_t to)
+  {
+    // tokens are generated from m_drawItems every frame
+    fillDrawItems(m_drawItems,from,to, true, true);
+    return true;
+  }
+
+  bool RendererTokenStream::updateObjects(const std::vector<uint32_t>& objects)
+  {
+    patchDrawItems(m_drawItems,objects, true, true);
+    return true;
+  }
+
   void RendererTokenStream::deinit()
   {
     TokenRendererBase::deinit();
@@ -241,7 +209,8 @@ namespace csfviewer
     const CadScene* NV_RESTRICT scene = m_scene;
 
     // do state setup (primarily for sake of state capturing)
-    scene->enableVertexFormat(VERTEX_POS,VERTEX_NORMAL);
+    scene->enableVertexFormat(VERTEX_POS,VERTEX_NORMAL,VERTEX_BBOXMIN,VERTEX_BBOXMAX);
+    nvgl::bindMultiTexture(GL_TEXTURE0 + TEX_INSTANCES, GL_TEXTURE_BUFFER, scene->m_instancesTexGL);
 
     if (m_bindlessVboUbo){
       glEnableClientState(GL_VERTEX_ATTRIB_ARRAY_UNIFIED_NV);
@@ -340,7 +309,8 @@ namespace csfviewer
       glDisableClientState(GL_UNIFORM_BUFFER_UNIFIED_NV);
     }
 
-    scene->disableVertexFormat(VERTEX_POS,VERTEX_NORMAL);
+    nvgl::bindMultiTexture(GL_TEXTURE0 + TEX_INSTANCES, GL_TEXTURE_BUFFER, 0);
+    scene->disableVertexFormat(VERTEX_POS,VERTEX_NORMAL,VERTEX_BBOXMIN,VERTEX_BBOXMAX);
   }
 
 }
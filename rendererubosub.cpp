@@ -121,6 +121,8 @@ namespace csfviewer
     void init(const CadScene* NV_RESTRICT scene, const Resources& resources);
     void deinit();
     void draw(ShadeType shadetype, const Resources& resources, nvh::Profiler& profiler, nvgl::ProgramManager &progManager);
+    bool appendObjects(size_t from, size_t to);
+    bool updateObjects(const std::vector<uint32_t>& objects);
 
     bool                        m_sort;
     bool                        m_vbum;
@@ -154,7 +156,7 @@ namespace csfviewer
     fillDrawItems(m_drawItems,0,scene->m_objects.size(), true, true);
 
     if (m_sort){
-      std::sort(m_drawItems.begin(),m_drawItems.end(),DrawItem_compare_groups);
+      sortDrawItems(m_drawItems);
     }
 
     m_scene = scene;
@@ -164,6 +166,29 @@ namespace csfviewer
     glNamedBufferData( m_streamMaterial, sizeof(CadScene::Material), NULL, GL_STREAM_DRAW);
   }
 
+  bool RendererUboSub::appendObjects(size_t from, size_t to)
+  {
+    size_t begin = m_drawItems.size();
+    fillDrawItems(m_drawItems,from,to, true, true);
+
+    if (m_sort){
+      sortDrawItems(m_drawItems, begin);
+      std::inplace_merge(m_drawItems.begin(),m_drawItems.begin() + begin,m_drawItems.end(),DrawItem_compare_groups);
+    }
+    return true;
+  }
+
+  bool RendererUboSub::updateObjects(const std::vector<uint32_t>& objects)
+  {
+    size_t begin = patchDrawItems(m_drawItems,objects, true, true);
+
+    if (m_sort){
+      sortDrawItems(m_drawItems, begin);
+      std::inplace_merge(m_drawItems.begin(),m_drawItems.begin() + begin,m_drawItems.end(),DrawItem_compare_groups);
+    }
+    return true;
+  }
+
   void RendererUboSub::deinit()
   {
     glDeleteBuffers(1,&m_streamMatrix);
@@ -176,7 +201,8 @@ namespace csfviewer
 
     bool vbum = m_vbum;
 
-    scene->enableVertexFormat(VERTEX_POS,VERTEX_NORMAL);
+    scene->enableVertexFormat(VERTEX_POS,VERTEX_NORMAL,VERTEX_BBOXMIN,VERTEX_BBOXMAX);
+    nvgl::bindMultiTexture(GL_TEXTURE0 + TEX_INSTANCES, GL_TEXTURE_BUFFER, scene->m_instancesTexGL);
 
     glUseProgram(resources.programUbo);
 
@@ -199,6 +225,12 @@ namespace csfviewer
     {
       int lastMaterial = -1;
       int lastGeometry = -1;
+      GLuint lastVbo   = 0;
+      GLint baseVertex = 0;
+      GLenum indexType = GL_UNSIGNED_INT;
+      size_t iboOffset = 0;
+      size_t indexSize = sizeof(GLuint);
+      GLsizei numInstances = GLsizei(scene->getNumInstances());
       int lastMatrix   = -1;
       bool lastSolid   = true;
 
@@ -207,46 +239,68 @@ namespace csfviewer
       for (int i = 0; i < m_drawItems.size(); i++){
         const DrawItem& di = m_drawItems[i];
 
-        if (shadetype == SHADE_SOLID && !di.solid){
+        if (shadetype == SHADE_SOLID && !di.solid()){
           if (m_sort) break;
           continue;
         }
 
-        if (lastSolid != di.solid){
-          SetWireMode( di.solid ? GL_FALSE : GL_TRUE );
+        if (lastSolid != di.solid()){
+          SetWireMode( di.solid() ? GL_FALSE : GL_TRUE );
           if (shadetype == SHADE_SOLIDWIRE_SPLIT){
-            glBindFramebuffer(GL_FRAMEBUFFER, di.solid ? resources.fbo : resources.fbo2);
+            glBindFramebuffer(GL_FRAMEBUFFER, di.solid() ? resources.fbo : resources.fbo2);
           }
         }
 
-        if (lastGeometry != di.geometryIndex){
-          const CadScene::Geometry &geo = scene->m_geometry[di.geometryIndex];
-
-          if (vbum){
-            glBufferAddressRangeNV(GL_VERTEX_ATTRIB_ARRAY_ADDRESS_NV, 0,  geo.vboADDR, geo.numVertices * sizeof(CadScene::Vertex));
-            glBufferAddressRangeNV(GL_ELEMENT_ARRAY_ADDRESS_NV,0,         geo.iboADDR, (geo.numIndexSolid+geo.numIndexWire) * sizeof(GLuint));
+        if (lastGeometry != di.geometryIndex()){
+          const CadScene::Geometry &geo = scene->m_geometry[di.geometryIndex()];
+
+          // clones and geometries within the arena share their buffers
+          if (lastVbo != geo.vboGL){
+            if (vbum){
+              glBufferAddressRangeNV(GL_VERTEX_ATTRIB_ARRAY_ADDRESS_NV, 0,  geo.vboADDR, scene->getVboBindSize(geo));
+              glBufferAddressRangeNV(GL_ELEMENT_ARRAY_ADDRESS_NV,0,         geo.iboADDR, scene->getIboBindSize(geo));
+            }
+            else{
+              glBindVertexBuffer(0, geo.vboGL, 0, GLsizei(scene->getVertexSize()));
+              glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, geo.iboGL);
+            }
+            lastVbo = geo.vboGL;
           }
-          else{
-            glBindVertexBuffer(0, geo.vboGL, 0, sizeof(CadScene::Vertex));
-            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, geo.iboGL);
+
+          if (scene->m_compactVertices){
+            if (vbum){
+              glBufferAddressRangeNV(GL_VERTEX_ATTRIB_ARRAY_ADDRESS_NV, CadScene::VERTEX_BBOX_BINDING, scene->m_geometryBboxesADDR + sizeof(CadScene::BBox) * di.geometryIndex(), sizeof(CadScene::BBox));
+            }
+            else{
+              glBindVertexBuffer(CadScene::VERTEX_BBOX_BINDING, scene->m_geometryBboxesGL, sizeof(CadScene::BBox) * di.geometryIndex(), 0);
+            }
           }
 
-          lastGeometry = di.geometryIndex;
+          baseVertex   = geo.baseVertex;
+          indexType    = geo.indexType;
+          iboOffset    = geo.iboOffset;
+          indexSize    = geo.getIndexSize();
+          lastGeometry = di.geometryIndex();
         }
 
-        if (lastMatrix != di.matrixIndex){
-          glNamedBufferSubData(m_streamMatrix, 0, sizeof(CadScene::MatrixNode), &scene->m_matrices[di.matrixIndex]);
-          lastMatrix = di.matrixIndex;
+        if (lastMatrix != di.matrixIndex()){
+          glNamedBufferSubData(m_streamMatrix, 0, sizeof(CadScene::MatrixNode), &scene->m_matrices[di.matrixIndex()]);
+          lastMatrix = di.matrixIndex();
         }
 
-        if (lastMaterial != di.materialIndex){
-          glNamedBufferSubData(m_streamMaterial, 0, sizeof(CadScene::Material), &scene->m_materials[di.materialIndex]);
-          lastMaterial = di.materialIndex;
+        if (lastMaterial != di.materialIndex()){
+          glNamedBufferSubData(m_streamMaterial, 0, sizeof(CadScene::Material), &scene->m_materials[di.materialIndex()]);
+          lastMaterial = di.materialIndex();
         }
 
-        glDrawElements( di.solid ? GL_TRIANGLES : GL_LINES, di.range.count, GL_UNSIGNED_INT, (void*) di.range.offset);
+        if (numInstances > 1){
+          glDrawElementsInstancedBaseVertex( di.solid() ? GL_TRIANGLES : GL_LINES, di.count(), indexType, (void*) (iboOffset + indexSize * di.firstIndex()), numInstances, baseVertex);
+        }
+        else{
+          glDrawElementsBaseVertex( di.solid() ? GL_TRIANGLES : GL_LINES, di.count(), indexType, (void*) (iboOffset + indexSize * di.firstIndex()), baseVertex);
+        }
 
-        lastSolid = di.solid;
+        lastSolid = di.solid();
       }
     }
 
@@ -267,7 +321,8 @@ namespace csfviewer
       glPolygonOffset(0,0);
     }
 
-    scene->disableVertexFormat(VERTEX_POS,VERTEX_NORMAL);
+    nvgl::bindMultiTexture(GL_TEXTURE0 + TEX_INSTANCES, GL_TEXTURE_BUFFER, 0);
+    scene->disableVertexFormat(VERTEX_POS,VERTEX_NORMAL,VERTEX_BBOXMIN,VERTEX_BBOXMAX);
   }
 
 }
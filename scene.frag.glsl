@@ -38,6 +38,25 @@ struct Material {
   Side  _pad[2];
 };
 
+#if USE_INDEXING && USE_COMPACTMATERIAL
+// must match CadScene::MaterialCompact, half float pairs
+layout(std430,binding=SSBO_MATERIAL) readonly buffer materialCompactBuffer {
+  uvec4     materialsCompact[];
+};
+
+Side getMaterialSide(int mi, int side)
+{
+  uvec4 a = materialsCompact[mi * 4 + side * 2 + 0];
+  uvec4 b = materialsCompact[mi * 4 + side * 2 + 1];
+  
+  Side s;
+  s.ambient  = vec4(unpackHalf2x16(a.x), unpackHalf2x16(a.y));
+  s.diffuse  = vec4(unpackHalf2x16(a.z), unpackHalf2x16(a.w));
+  s.specular = vec4(unpackHalf2x16(b.x), unpackHalf2x16(b.y));
+  s.emissive = vec4(unpackHalf2x16(b.z), unpackHalf2x16(b.w));
+  return s;
+}
+#else
 layout(std140,binding=UBO_MATERIAL) uniform materialBuffer {
 #if USE_INDEXING
   Material  materials[256];
@@ -46,6 +65,12 @@ layout(std140,binding=UBO_MATERIAL) uniform materialBuffer {
 #endif
 };
 
+Side getMaterialSide(int mi, int side)
+{
+  return materials[mi].sides[side];
+}
+#endif
+
 
 in Interpolants {
   vec3 wPos;
@@ -91,9 +116,9 @@ void main()
   mi = IN.assigns.y;
 #endif
 
-  out_Color = shade(materials[mi].sides[gl_FrontFacing ? 1 : 0]);
+  out_Color = shade(getMaterialSide(mi, gl_FrontFacing ? 1 : 0));
 
   if (wireMode != 0){
-    out_Color = materials[mi].sides[0].diffuse*1.5 + 0.3;
+    out_Color = getMaterialSide(mi, 0).diffuse*1.5 + 0.3;
   }
 }
@@ -28,8 +28,25 @@
 #if USE_INDEXING && USE_BASEINSTANCE
 #extension GL_ARB_shader_draw_parameters : require
 #endif
+#if USE_COMPACTVERTEX
+// unorm16 position within the geometry bbox, octahedron encoded normal
+in layout(location=VERTEX_POS)      vec3 posQuantized;
+in layout(location=VERTEX_NORMAL)   vec2 normalOct;
+in layout(location=VERTEX_BBOXMIN)  vec3 bboxMin;
+in layout(location=VERTEX_BBOXMAX)  vec3 bboxMax;
+
+vec3 octDecode(vec2 oct)
+{
+  vec3 n = vec3(oct.xy, 1.0 - abs(oct.x) - abs(oct.y));
+  float t = max(-n.z, 0.0);
+  n.x += n.x >= 0.0 ? -t : t;
+  n.y += n.y >= 0.0 ? -t : t;
+  return normalize(n);
+}
+#else
 in layout(location=VERTEX_POS)      vec3 pos;
 in layout(location=VERTEX_NORMAL)   vec3 normal;
+#endif
 
 #if USE_INDEXING
 #if USE_BASEINSTANCE
@@ -59,12 +76,26 @@ out Interpolants {
 
 void main()
 {
-#if USE_INDEXING || USE_MIX
+#if USE_COMPACTVERTEX
+  vec3 pos      = mix(bboxMin, bboxMax, posQuantized);
+  vec3 normal   = octDecode(normalOct);
+#endif
+#if (USE_INDEXING || USE_MIX) && USE_COMPACTMATRIX
+  mat3x4 worldRows = getIndexedMatrixCompact(matrixIndex);
+  vec3 wPos     = vec4(pos,1) * worldRows;
+  vec3 wNormal  = getNormalMatrixCompact(worldRows) * normal;
+#elif USE_INDEXING || USE_MIX
   vec3 wPos     = (getIndexedMatrix(matrixIndex, NODE_MATRIX_WORLD)   * vec4(pos,1)).xyz;
   vec3 wNormal  = mat3(getIndexedMatrix(matrixIndex, NODE_MATRIX_WORLDIT)) * normal;
 #else
   vec3 wPos     = (object.worldMatrix   * vec4(pos,1)).xyz;
   vec3 wNormal  = mat3(object.worldMatrixIT) * normal;
+#endif
+#if USE_INSTANCEDCLONES
+  // clones are instances, gl_InstanceID is 0 for the original
+  mat4 instanceMatrix = getInstanceMatrix(gl_InstanceID);
+  wPos          = (instanceMatrix * vec4(wPos,1)).xyz;
+  wNormal       = mat3(instanceMatrix) * wNormal;
 #endif
   gl_Position   = scene.viewProjMatrix * vec4(wPos,1);
   OUT.wPos = wPos;
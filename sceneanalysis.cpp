@@ -0,0 +1,285 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+
+/* Contact ckubisch@nvidia.com (Christoph Kubisch) for feedback */
+
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+#include "sceneanalysis.hpp"
+#include "tokenbase.hpp"
+
+namespace csfviewer
+{
+  static const char* s_strategyNames[SceneAnalysis::NUM_STRATEGIES] = { "groups", "join", "individual", "adaptive" };
+
+  void SceneAnalysis::Histogram::add(uint64_t value)
+  {
+    size_t bin = 0;
+    while (value >> bin){
+      bin++;
+    }
+    if (bins.size() <= bin){
+      bins.resize(bin + 1, 0);
+    }
+    bins[bin]++;
+    count++;
+    sum += value;
+    max = std::max(max, value);
+  }
+
+  // same redundancy filters as the renderers, token sizes as in RendererToken
+  static void ReplayStates( SceneAnalysis::StateStats& stats, const std::vector<Renderer::DrawItem>& drawItems, const CadScene& scene )
+  {
+    memset(&stats, 0, sizeof(stats));
+
+    size_t drawSize = scene.getNumInstances() > 1 ? sizeof(NVTokenDrawElemsInstanced) : sizeof(NVTokenDrawElemsUsed);
+
+    bool   lastSolid     = true;
+    int    lastGeometry  = -1;
+    int    lastMatrix    = -1;
+    int    lastMaterial  = -1;
+    int    lastBuffers   = -1;
+    GLenum lastIndexType = 0;
+
+    for (size_t i = 0; i < drawItems.size(); i++){
+      const Renderer::DrawItem& di = drawItems[i];
+
+      if (di.solid() != lastSolid){
+        stats.modeChanges++;
+      }
+
+      if (lastGeometry != di.geometryIndex()){
+        // derived from the layout instead of vboGL, which stays 0 with
+        // LoadConfig::cpuOnly. Arena geometries share one buffer pair,
+        // otherwise clones share the buffers of their original.
+        const CadScene::Geometry& geo = scene.m_geometry[di.geometryIndex()];
+        int buffers = scene.m_arenaBuffers ? 0 : (geo.cloneIdx >= 0 ? geo.cloneIdx : di.geometryIndex());
+        if (lastBuffers != buffers || lastIndexType != geo.indexType){
+          stats.bufferChanges++;
+          stats.tokenBytes += sizeof(NVTokenVbo) + sizeof(NVTokenIbo);
+          lastBuffers   = buffers;
+          lastIndexType = geo.indexType;
+        }
+        if (scene.m_compactVertices){
+          stats.tokenBytes += sizeof(NVTokenVbo);
+        }
+        stats.geometryChanges++;
+        lastGeometry = di.geometryIndex();
+      }
+
+      if (lastMatrix != di.matrixIndex()){
+        stats.matrixChanges++;
+        stats.tokenBytes += sizeof(NVTokenUbo);
+        lastMatrix = di.matrixIndex();
+      }
+
+      if (lastMaterial != di.materialIndex()){
+        stats.materialChanges++;
+        stats.tokenBytes += sizeof(NVTokenUbo);
+        lastMaterial = di.materialIndex();
+      }
+
+      stats.tokenBytes += drawSize;
+      lastSolid = di.solid();
+    }
+  }
+
+  static double EvaluateCost( const CostModel& model, const SceneAnalysis::StrategyStats& strategy, const SceneAnalysis::StateStats& state )
+  {
+    return double(strategy.drawsSolid + strategy.drawsWire) * model.draw
+         + double(state.modeChanges)     * model.mode
+         + double(state.bufferChanges)   * model.buffer
+         + double(state.matrixChanges)   * model.matrix
+         + double(state.materialChanges) * model.material
+         + double(state.tokenBytes)      * model.tokenByte;
+  }
+
+  static bool IsRendererAvailable( const char* name )
+  {
+    const Renderer::Registry& registry = Renderer::getRegistry();
+    for (size_t i = 0; i < registry.size(); i++){
+      if (strcmp(registry[i]->name(), name) == 0){
+        return registry[i]->isAvailable();
+      }
+    }
+    return false;
+  }
+
+  void analyzeScene( SceneAnalysis& analysis, const CadScene& scene, bool queryAvailability )
+  {
+    analysis = SceneAnalysis();
+    analysis.availabilityQueried = queryAvailability;
+    analysis.objects     = scene.m_objects.size();
+    analysis.geometries  = scene.m_geometry.size();
+    analysis.materials   = scene.m_materials.size();
+    analysis.nodes       = scene.m_matrices.size();
+    analysis.parts       = 0;
+    analysis.activeParts = 0;
+    analysis.instances   = int(scene.getNumInstances());
+    analysis.recommendedStrategy = STRATEGY_GROUPS;
+
+    for (size_t i = 0; i < scene.m_objects.size(); i++){
+      size_t numParts = scene.getNumParts(i);
+      analysis.partsPerObject.add(numParts);
+      analysis.parts += numParts;
+      for (size_t p = 0; p < numParts; p++){
+        analysis.activeParts += scene.isPartActive(i, p) ? 1 : 0;
+      }
+      const CadScene::FlatObjects& flat = scene.m_flatObjects;
+      analysis.statesPerObject.add(flat.empty() ? scene.m_objects[i].cacheSolid.state.size() : flat.objects[i].solid.numStates);
+    }
+
+    for (size_t g = 0; g < scene.m_geometry.size(); g++){
+      const CadScene::Geometry& geo = scene.m_geometry[g];
+      for (size_t p = 0; p < geo.parts.size(); p++){
+        analysis.trianglesPerPart.add(uint64_t(geo.parts[p].indexSolid.count / 3));
+      }
+    }
+
+    Renderer renderer;
+    renderer.m_scene = &scene;
+
+    std::vector<Renderer::DrawItem> drawItems;
+    for (int s = 0; s < SceneAnalysis::NUM_STRATEGIES; s++){
+      SceneAnalysis::StrategyStats& stats = analysis.strategies[s];
+      stats.drawsSolid = 0;
+      stats.drawsWire  = 0;
+
+      renderer.m_strategy = Strategy(s);
+      drawItems.clear();
+      renderer.fillDrawItems(drawItems, 0, scene.m_objects.size(), true, true);
+
+      for (size_t i = 0; i < drawItems.size(); i++){
+        const Renderer::DrawItem& di = drawItems[i];
+        if (di.solid()){
+          stats.drawsSolid++;
+          stats.trianglesPerDraw.add(uint64_t(di.count() / 3));
+        }
+        else{
+          stats.drawsWire++;
+        }
+      }
+
+      ReplayStates(stats.state[0], drawItems, scene);
+      // the same ordering the *_sorted renderers generate from
+      renderer.sortDrawItems(drawItems);
+      ReplayStates(stats.state[1], drawItems, scene);
+    }
+
+    size_t           numModels;
+    const CostModel* models   = Renderer::getCostModels(numModels);
+    double           bestCost = 0;
+    for (size_t m = 0; m < numModels; m++){
+      const CostModel& model = models[m];
+      for (int s = 0; s < SceneAnalysis::NUM_STRATEGIES; s++){
+        for (int sorted = 0; sorted < 2; sorted++){
+          SceneAnalysis::RendererCost cost;
+          cost.name      = sorted ? model.nameSorted : model.name;
+          cost.strategy  = Strategy(s);
+          cost.available = !queryAvailability || IsRendererAvailable(cost.name.c_str());
+          cost.cost      = EvaluateCost(model, analysis.strategies[s], analysis.strategies[s].state[sorted]);
+          analysis.costs.push_back(cost);
+
+          if (cost.available && (analysis.recommendedRenderer.empty() || cost.cost < bestCost)){
+            bestCost = cost.cost;
+            analysis.recommendedRenderer = cost.name;
+            analysis.recommendedStrategy = cost.strategy;
+          }
+        }
+      }
+    }
+  }
+
+  static void WriteHistogram( FILE* file, const char* indent, const char* name, const SceneAnalysis::Histogram& histogram, bool last = false )
+  {
+    fprintf(file, "%s\"%s\": { \"count\": %llu, \"mean\": %.3f, \"max\": %llu, \"bins\": [", indent, name,
+            (unsigned long long)histogram.count, histogram.count ? double(histogram.sum) / double(histogram.count) : 0.0,
+            (unsigned long long)histogram.max);
+    for (size_t i = 0; i < histogram.bins.size(); i++){
+      fprintf(file, "%s%llu", i ? ", " : "", (unsigned long long)histogram.bins[i]);
+    }
+    fprintf(file, "] }%s\n", last ? "" : ",");
+  }
+
+  static void WriteStateStats( FILE* file, const char* name, const SceneAnalysis::StateStats& state, bool last = false )
+  {
+    fprintf(file, "      \"%s\": { \"modeChanges\": %llu, \"geometryChanges\": %llu, \"bufferChanges\": %llu, "
+                  "\"matrixChanges\": %llu, \"materialChanges\": %llu, \"tokenBytes\": %llu }%s\n",
+            name, (unsigned long long)state.modeChanges, (unsigned long long)state.geometryChanges,
+            (unsigned long long)state.bufferChanges, (unsigned long long)state.matrixChanges,
+            (unsigned long long)state.materialChanges, (unsigned long long)state.tokenBytes, last ? "" : ",");
+  }
+
+  bool writeSceneAnalysisJSON( const SceneAnalysis& analysis, const char* filename )
+  {
+    FILE* file = fopen(filename, "wt");
+    if (!file){
+      return false;
+    }
+
+    fprintf(file, "{\n");
+    fprintf(file, "  \"scene\": {\n");
+    fprintf(file, "    \"objects\": %llu,\n",     (unsigned long long)analysis.objects);
+    fprintf(file, "    \"geometries\": %llu,\n",  (unsigned long long)analysis.geometries);
+    fprintf(file, "    \"materials\": %llu,\n",   (unsigned long long)analysis.materials);
+    fprintf(file, "    \"nodes\": %llu,\n",       (unsigned long long)analysis.nodes);
+    fprintf(file, "    \"parts\": %llu,\n",       (unsigned long long)analysis.parts);
+    fprintf(file, "    \"activeParts\": %llu,\n", (unsigned long long)analysis.activeParts);
+    fprintf(file, "    \"instances\": %d\n",      analysis.instances);
+    fprintf(file, "  },\n");
+
+    fprintf(file, "  \"histograms\": {\n");
+    WriteHistogram(file, "    ", "partsPerObject",   analysis.partsPerObject);
+    WriteHistogram(file, "    ", "statesPerObject",  analysis.statesPerObject);
+    WriteHistogram(file, "    ", "trianglesPerPart", analysis.trianglesPerPart, true);
+    fprintf(file, "  },\n");
+
+    fprintf(file, "  \"strategies\": {\n");
+    for (int s = 0; s < SceneAnalysis::NUM_STRATEGIES; s++){
+      const SceneAnalysis::StrategyStats& stats = analysis.strategies[s];
+      fprintf(file, "    \"%s\": {\n", s_strategyNames[s]);
+      fprintf(file, "      \"drawsSolid\": %llu,\n", (unsigned long long)stats.drawsSolid);
+      fprintf(file, "      \"drawsWire\": %llu,\n",  (unsigned long long)stats.drawsWire);
+      WriteHistogram(file, "      ", "trianglesPerDraw", stats.trianglesPerDraw);
+      WriteStateStats(file, "objectOrder", stats.state[0]);
+      WriteStateStats(file, "sorted",      stats.state[1], true);
+      fprintf(file, "    }%s\n", s + 1 < SceneAnalysis::NUM_STRATEGIES ? "," : "");
+    }
+    fprintf(file, "  },\n");
+
+    fprintf(file, "  \"costs\": [\n");
+    for (size_t i = 0; i < analysis.costs.size(); i++){
+      const SceneAnalysis::RendererCost& cost = analysis.costs[i];
+      fprintf(file, "    { \"renderer\": \"%s\", \"strategy\": \"%s\", \"available\": %s, \"cost\": %.1f }%s\n",
+              cost.name.c_str(), s_strategyNames[cost.strategy],
+              analysis.availabilityQueried ? (cost.available ? "true" : "false") : "null", cost.cost,
+              i + 1 < analysis.costs.size() ? "," : "");
+    }
+    fprintf(file, "  ],\n");
+
+    fprintf(file, "  \"recommendation\": { \"renderer\": \"%s\", \"strategy\": \"%s\", \"strategyIndex\": %d }\n",
+            analysis.recommendedRenderer.c_str(), s_strategyNames[analysis.recommendedStrategy], int(analysis.recommendedStrategy));
+    fprintf(file, "}\n");
+
+    return fclose(file) == 0;
+  }
+
+}
@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+
+
+
+#ifndef SCENEANALYSIS_H__
+#define SCENEANALYSIS_H__
+
+#include "renderer.hpp"
+#include <string>
+#include <vector>
+
+namespace csfviewer {
+
+  /*
+    Scene complexity analysis to pick a strategy and renderer.
+
+    Every strategy's draw items come from Renderer::fillDrawItems (solid and
+    wire), in object order and sorted by Renderer::sortDrawItems without
+    objectOrder like the *_sorted renderers. The cullsorted renderer also
+    orders by object and has no cost model here. Each sequence is replayed
+    through the same redundancy filters the renderers use, which gives the
+    state changes and the size of the NV_command_list token stream. A simple
+    per-renderer cost model weighs these, the cheapest available renderer and
+    strategy is recommended.
+  */
+
+  struct SceneAnalysis {
+    static const int NUM_STRATEGIES = STRATEGY_ADAPTIVE + 1;
+
+    // power of two buckets, bins[0] counts zeros, bins[i] [2^(i-1), 2^i)
+    struct Histogram {
+      std::vector<uint64_t> bins;
+      uint64_t              count;
+      uint64_t              sum;
+      uint64_t              max;
+
+      Histogram() : count(0), sum(0), max(0) {}
+      void add(uint64_t value);
+    };
+
+    struct StateStats {
+      uint64_t  modeChanges;      // solid <-> wire
+      uint64_t  geometryChanges;
+      uint64_t  bufferChanges;    // vbo/ibo binds, clones and arenas share them
+      uint64_t  matrixChanges;
+      uint64_t  materialChanges;
+      size_t    tokenBytes;
+    };
+
+    struct StrategyStats {
+      uint64_t    drawsSolid;
+      uint64_t    drawsWire;
+      Histogram   trianglesPerDraw;
+      StateStats  state[2];       // object order, sorted
+    };
+
+    struct RendererCost {
+      std::string name;
+      Strategy    strategy;
+      bool        available;
+      double      cost;
+    };
+
+    size_t          objects;
+    size_t          geometries;
+    size_t          materials;
+    size_t          nodes;
+    size_t          parts;
+    size_t          activeParts;
+    int             instances;
+
+    Histogram       partsPerObject;
+    Histogram       statesPerObject;    // solid DrawRangeCache states
+    Histogram       trianglesPerPart;   // over all geometry parts
+
+    StrategyStats   strategies[NUM_STRATEGIES];
+    std::vector<RendererCost> costs;
+
+    // false if the recommendation considered all renderers
+    bool            availabilityQueried;
+    std::string     recommendedRenderer;
+    Strategy        recommendedStrategy;
+  };
+
+  // the scene must be fully loaded, LoadConfig::cpuOnly is enough.
+  // queryAvailability asks the registry which renderers the GL context
+  // supports, without a context all renderers are considered.
+  void analyzeScene(SceneAnalysis& analysis, const CadScene& scene, bool queryAvailability);
+
+  bool writeSceneAnalysisJSON(const SceneAnalysis& analysis, const char* filename);
+}
+
+#endif
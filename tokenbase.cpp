@@ -93,52 +93,229 @@ namespace csfviewer
     LOGI("\n");
   }
 
-  void TokenRendererBase::finalize(const Resources &resources, bool fillBuffers)
+  void TokenRendererBase::setupSplitShade(const Resources &resources)
   {
-    {
-      m_tokenStreams[SHADE_SOLIDWIRE_SPLIT] = m_tokenStreams[SHADE_SOLIDWIRE];
-      m_shades[SHADE_SOLIDWIRE_SPLIT] = m_shades[SHADE_SOLIDWIRE];
-      if (USE_STATEFBO_SPLIT){
-        ShadeCommand& sc = m_shades[SHADE_SOLIDWIRE_SPLIT];
-        for (size_t i = 0; i < sc.sizes.size(); i++){
-          if (sc.states[i] == m_stateObjects[STATE_LINES]){
-            sc.states[i] = m_stateObjects[STATE_LINES_SPLIT];
-          }
+    m_shades[SHADE_SOLIDWIRE_SPLIT] = m_shades[SHADE_SOLIDWIRE];
+    if (USE_STATEFBO_SPLIT){
+      ShadeCommand& sc = m_shades[SHADE_SOLIDWIRE_SPLIT];
+      for (size_t i = 0; i < sc.sizes.size(); i++){
+        if (sc.states[i] == m_stateObjects[STATE_LINES]){
+          sc.states[i] = m_stateObjects[STATE_LINES_SPLIT];
         }
       }
-      else{
-        ShadeCommand& sc = m_shades[SHADE_SOLIDWIRE_SPLIT];
-        for (size_t i = 0; i < sc.sizes.size(); i++)
-        {
-          if (sc.states[i] == m_stateObjects[STATE_LINES]){
-            sc.fbos[i] = resources.fbo2;
-          }
-          else{
-            sc.fbos[i] = resources.fbo;
-          }
+    }
+    else{
+      ShadeCommand& sc = m_shades[SHADE_SOLIDWIRE_SPLIT];
+      for (size_t i = 0; i < sc.sizes.size(); i++)
+      {
+        if (sc.states[i] == m_stateObjects[STATE_LINES]){
+          sc.fbos[i] = resources.fbo2;
+        }
+        else{
+          sc.fbos[i] = resources.fbo;
         }
       }
     }
+  }
+
+  void TokenRendererBase::setupAddresses(int shade)
+  {
+    ShadeCommand& sc = m_shades[shade];
+    sc.addresses.clear();
+    sc.addresses.reserve( sc.offsets.size() );
+    for (size_t n = 0; n < sc.offsets.size(); n++){
+      sc.addresses.push_back( m_tokenAddresses[shade] + sc.offsets[n] );
+    }
+  }
+
+  void TokenRendererBase::finalize(const Resources &resources, bool fillBuffers)
+  {
+    m_resources = &resources;
+
+    m_tokenStreams[SHADE_SOLIDWIRE_SPLIT] = m_tokenStreams[SHADE_SOLIDWIRE];
+    setupSplitShade(resources);
 
     glCreateBuffers(NUM_SHADES,m_tokenBuffers);
     if (m_hwsupport && fillBuffers){
       for (int i = 0; i < NUM_SHADES; i++){
-        glNamedBufferStorage(m_tokenBuffers[i],m_tokenStreams[i].size(), &m_tokenStreams[i][0], 0);
+        if (m_sort){
+          m_tokenCapacities[i] = 0;
+          Renderer::updateGrowingBuffer(m_tokenBuffers[i], m_tokenCapacities[i], m_tokenStreams[i].data(), m_tokenStreams[i].size(), 0, 0);
+        }
+        else{
+          glNamedBufferStorage(m_tokenBuffers[i],m_tokenStreams[i].size(), &m_tokenStreams[i][0], 0);
+        }
         if (m_useaddress){
           glGetNamedBufferParameterui64vNV(m_tokenBuffers[i], GL_BUFFER_GPU_ADDRESS_NV, &m_tokenAddresses[i]);
           glMakeNamedBufferResidentNV(m_tokenBuffers[i], GL_READ_ONLY);
-
-          ShadeCommand& sc = m_shades[i];
-          sc.addresses.clear();
-          sc.addresses.reserve( sc.offsets.size() );
-          for (size_t n = 0; n < sc.offsets.size(); n++){
-            sc.addresses.push_back( m_tokenAddresses[i] + sc.offsets[n] );
-          }
+          setupAddresses(i);
         }
       }
     }
   }
 
+  void TokenRendererBase::setupSortedSegments(ShadeType shade, size_t wireOffset, size_t size)
+  {
+    ShadeCommand& sc = m_shades[shade];
+    sc.offsets.clear();
+    sc.sizes.clear();
+    sc.states.clear();
+    sc.fbos.clear();
+
+    if (shade == SHADE_SOLID){
+      sc.offsets.push_back( 0 );
+      sc.sizes.  push_back( GLsizei(size) );
+      sc.states. push_back( m_stateObjects[ STATE_TRIS ] );
+      sc.fbos.   push_back( 0 );
+      return;
+    }
+
+    sc.offsets.push_back( 0 );
+    sc.sizes.  push_back( GLsizei(wireOffset) );
+    sc.states. push_back( m_stateObjects[ STATE_TRISOFFSET ] );
+    sc.fbos.   push_back( 0 );
+    if (wireOffset < size){
+      sc.offsets.push_back( wireOffset );
+      sc.sizes.  push_back( GLsizei(size - wireOffset) );
+      sc.states. push_back( m_stateObjects[ STATE_LINES ] );
+      sc.fbos.   push_back( 0 );
+    }
+  }
+
+  void TokenRendererBase::spliceTokenStreams(const size_t begins[NUM_SHADES], const size_t oldEnds[NUM_SHADES], const std::string fragments[NUM_SHADES], bool fillBuffers)
+  {
+    setupSplitShade(*m_resources);
+
+    for (int i = 0; i < NUM_SHADES; i++){
+      int from = i == SHADE_SOLIDWIRE_SPLIT ? SHADE_SOLIDWIRE : i;
+      std::string& stream = m_tokenStreams[i];
+      size_t oldSize = stream.size();
+      stream.replace(begins[from], oldEnds[from] - begins[from], fragments[from]);
+
+      if (!m_hwsupport) continue;
+
+      bool created;
+      if (fillBuffers){
+        created = Renderer::spliceGrowingBuffer(m_tokenBuffers[i], m_tokenCapacities[i], m_spliceScratch, m_spliceScratchCapacity,
+                                                oldSize, begins[from], oldEnds[from], fragments[from].data(), fragments[from].size());
+      }
+      else{
+        created = Renderer::updateGrowingBuffer(m_tokenBuffers[i], m_tokenCapacities[i], NULL, stream.size(), 0, 0);
+      }
+      if (created && m_useaddress){
+        glGetNamedBufferParameterui64vNV(m_tokenBuffers[i], GL_BUFFER_GPU_ADDRESS_NV, &m_tokenAddresses[i]);
+        glMakeNamedBufferResidentNV(m_tokenBuffers[i], GL_READ_ONLY);
+      }
+      if (m_useaddress){
+        setupAddresses(i);
+      }
+    }
+
+    // compiled lists reference the client streams
+    m_listsChanged = true;
+  }
+
+  static inline void RecordToken(TokenRendererBase::TokenArrays* arrays, size_t streamSize, size_t tokenBytes, int object)
+  {
+    if (!arrays) return;
+    arrays->sizes.push_back(GLuint(tokenBytes / sizeof(GLuint)));
+    arrays->offsets.push_back(GLuint((streamSize - tokenBytes) / sizeof(GLuint)));
+    arrays->objects.push_back(object);
+  }
+
+  template <class TStream>
+  static void EnqueueItemTokens(TStream& tokenStream, const Renderer::DrawItem& di, TokenRendererBase::ItemState& state, const CadScene* NV_RESTRICT scene,
+                                TokenRendererBase::TokenArrays* arrays, int bufferObject)
+  {
+    if (state.lastGeometry != di.geometryIndex()){
+      const CadScene::Geometry &geo = scene->m_geometry[di.geometryIndex()];
+      // clones and geometries within the arena share their buffers,
+      // the index type may still change between geometries
+      if (state.lastVbo != geo.vboGL || state.lastIndexType != geo.indexType){
+        NVTokenVbo vbo;
+        vbo.cmd.index = 0;
+        vbo.setBuffer(geo.vboGL, geo.vboADDR, 0);
+        nvtokenEnqueue(tokenStream, vbo);
+        RecordToken(arrays, tokenStream.size(), sizeof(vbo), bufferObject);
+
+        NVTokenIbo ibo;
+        ibo.setBuffer(geo.iboGL, geo.iboADDR);
+        ibo.setType(geo.indexType);
+        nvtokenEnqueue(tokenStream, ibo);
+        RecordToken(arrays, tokenStream.size(), sizeof(ibo), bufferObject);
+
+        state.lastVbo = geo.vboGL;
+        state.lastIndexType = geo.indexType;
+      }
+
+      if (scene->m_compactVertices){
+        NVTokenVbo bbox;
+        bbox.setBinding(CadScene::VERTEX_BBOX_BINDING);
+        bbox.setBuffer(scene->m_geometryBboxesGL, scene->m_geometryBboxesADDR, GLuint(sizeof(CadScene::BBox) * di.geometryIndex()));
+        nvtokenEnqueue(tokenStream, bbox);
+        RecordToken(arrays, tokenStream.size(), sizeof(bbox), bufferObject);
+      }
+
+      state.baseVertex = geo.baseVertex;
+      state.baseIndex  = GLuint(geo.getBaseIndex());
+      state.lastGeometry = di.geometryIndex();
+    }
+
+    if (state.lastMatrix != di.matrixIndex()){
+      NVTokenUbo ubo;
+      ubo.cmd.index   = UBO_MATRIX;
+      ubo.cmd.stage   = UBOSTAGE_VERTEX;
+      ubo.setBuffer(scene->m_matricesGL, scene->m_matricesADDR, sizeof(CadScene::MatrixNode) * di.matrixIndex(), sizeof(CadScene::MatrixNode));
+      nvtokenEnqueue(tokenStream, ubo);
+      RecordToken(arrays, tokenStream.size(), sizeof(ubo), bufferObject);
+
+      state.lastMatrix = di.matrixIndex();
+    }
+
+    if (state.lastMaterial != di.materialIndex()){
+      NVTokenUbo ubo;
+      ubo.cmd.index   = UBO_MATERIAL;
+      ubo.cmd.stage   = UBOSTAGE_FRAGMENT;
+      ubo.setBuffer(scene->m_materialsGL, scene->m_materialsADDR, sizeof(CadScene::Material) * di.materialIndex(), sizeof(CadScene::Material));
+      nvtokenEnqueue(tokenStream, ubo);
+      RecordToken(arrays, tokenStream.size(), sizeof(ubo), bufferObject);
+
+      state.lastMaterial = di.materialIndex();
+    }
+
+    GLuint numInstances = scene->getNumInstances();
+    if (numInstances > 1){
+      NVTokenDrawElemsInstanced drawelems;
+      drawelems.setMode(di.solid() ? GL_TRIANGLES : GL_LINES);
+      drawelems.setParams(di.count(), state.baseIndex + di.firstIndex(), state.baseVertex);
+      drawelems.setInstances(numInstances);
+      nvtokenEnqueue(tokenStream, drawelems);
+      RecordToken(arrays, tokenStream.size(), sizeof(drawelems), di.objectIndex());
+    }
+    else{
+      NVTokenDrawElemsUsed drawelems;
+      drawelems.setMode(di.solid() ? GL_TRIANGLES : GL_LINES);
+      drawelems.cmd.count = di.count();
+      drawelems.cmd.firstIndex = state.baseIndex + di.firstIndex();
+      drawelems.cmd.baseVertex = state.baseVertex;
+      nvtokenEnqueue(tokenStream, drawelems);
+      RecordToken(arrays, tokenStream.size(), sizeof(drawelems), di.objectIndex());
+    }
+
+    state.lastSolid = di.solid();
+  }
+
+  void TokenRendererBase::enqueueItemTokens(std::string& tokenStream, const Renderer::DrawItem& di, ItemState& state, const CadScene* NV_RESTRICT scene,
+                                            TokenArrays* arrays, int bufferObject)
+  {
+    EnqueueItemTokens(tokenStream, di, state, scene, arrays, bufferObject);
+  }
+
+  void TokenRendererBase::enqueueItemTokens(NVPointerStream& tokenStream, const Renderer::DrawItem& di, ItemState& state, const CadScene* NV_RESTRICT scene)
+  {
+    EnqueueItemTokens(tokenStream, di, state, scene, NULL, -1);
+  }
+
   void TokenRendererBase::deinit()
   {
     if (m_useaddress){
@@ -150,6 +327,9 @@ namespace csfviewer
     }
 
     glDeleteBuffers(NUM_SHADES,m_tokenBuffers);
+    glDeleteBuffers(1,&m_spliceScratch);
+    m_spliceScratch = 0;
+    m_spliceScratchCapacity = 0;
 
     if (m_hwsupport){
       glDeleteStatesNV(NUM_STATES,m_stateObjects);
@@ -259,7 +439,8 @@ namespace csfviewer
 #endif
     }
 
-    if (m_hwsupport && m_uselist && (stateChanged || fboTexChanged)){
+    if (m_hwsupport && m_uselist && (stateChanged || fboTexChanged || m_listsChanged)){
+      m_listsChanged = false;
       for (int i = 0; i < NUM_SHADES; i++){
         ShadeCommand& shade = m_shades[i];
 
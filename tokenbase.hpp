@@ -75,6 +75,56 @@ namespace csfviewer
       std::vector<GLuint>     fbos;
     };
 
+    // running state of token generation, the buffers, matrix and material
+    // the tokens of the last item left bound
+    struct ItemState {
+      int     lastMaterial;
+      int     lastGeometry;
+      int     lastMatrix;
+      int     lastObject;
+      GLuint  lastVbo;
+      GLenum  lastIndexType;
+      GLint   baseVertex;
+      GLuint  baseIndex;
+      bool    lastSolid;
+
+      ItemState()
+        : lastMaterial(-1)
+        , lastGeometry(-1)
+        , lastMatrix(-1)
+        , lastObject(-1)
+        , lastVbo(0)
+        , lastIndexType(GL_UNSIGNED_INT)
+        , baseVertex(0)
+        , baseIndex(0)
+        , lastSolid(true)
+      {
+
+      }
+
+      // state after the tokens of di, to continue generation behind it
+      void setFromItem(const Renderer::DrawItem& di, const CadScene* NV_RESTRICT scene)
+      {
+        const CadScene::Geometry &geo = scene->m_geometry[di.geometryIndex()];
+        lastMaterial  = di.materialIndex();
+        lastGeometry  = di.geometryIndex();
+        lastMatrix    = di.matrixIndex();
+        lastObject    = di.objectIndex();
+        lastVbo       = geo.vboGL;
+        lastIndexType = geo.indexType;
+        baseVertex    = geo.baseVertex;
+        baseIndex     = GLuint(geo.getBaseIndex());
+        lastSolid     = di.solid();
+      }
+    };
+
+    // per token arrays of the cull renderers, sizes and offsets in GLuints
+    struct TokenArrays {
+      std::vector<GLuint>&  sizes;
+      std::vector<GLuint>&  offsets;
+      std::vector<GLint>&   objects;
+    };
+
     bool  m_emulate;
     bool  m_sort;
     bool  m_uselist;
@@ -89,6 +139,10 @@ namespace csfviewer
       , m_sort(false)
       , m_stateChangeID(~0)
       , m_fboStateChangeID(~0)
+      , m_listsChanged(false)
+      , m_resources(NULL)
+      , m_spliceScratch(0)
+      , m_spliceScratchCapacity(0)
     {
 
     }
@@ -108,6 +162,13 @@ namespace csfviewer
 
     size_t                      m_stateChangeID;
     size_t                      m_fboStateChangeID;
+    bool                        m_listsChanged;
+
+    // with m_sort the token buffers have room to grow for patches
+    size_t                      m_tokenCapacities[NUM_SHADES];
+    const Resources*            m_resources;
+    GLuint                      m_spliceScratch;
+    size_t                      m_spliceScratchCapacity;
 
     StateSystem                 m_stateSystem;
     StateSystem::StateID        m_stateIDs[NUM_STATES];
@@ -118,8 +179,28 @@ namespace csfviewer
     void finalize(const Resources &resources, bool fillBuffers=true);
     void deinit();
 
+    // replaces bytes [begins[i],oldEnds[i]) of the SOLID and SOLIDWIRE
+    // streams by fragments[i], the bytes behind move within the token
+    // buffers on the GPU. SOLIDWIRE_SPLIT follows SOLIDWIRE. The segments
+    // of both shades must be set up for the new streams already. Without
+    // fillBuffers the token buffers are only kept large enough.
+    void spliceTokenStreams(const size_t begins[NUM_SHADES], const size_t oldEnds[NUM_SHADES], const std::string fragments[NUM_SHADES], bool fillBuffers=true);
+    // segments of a stream generated from sorted items, SHADE_SOLIDWIRE
+    // switches from the solid to the wire items at wireOffset
+    void setupSortedSegments(ShadeType shade, size_t wireOffset, size_t size);
+    void setupSplitShade(const Resources &resources);
+    void setupAddresses(int shade);
+
     void captureState(const Resources &resources);
 
+    // enqueues the tokens of di after the redundancy filter against state,
+    // shared by all token renderers so their filtering stays the same.
+    // With arrays every token is recorded as well, buffer and ubo tokens
+    // with bufferObject, draw tokens with di.objectIndex().
+    static void enqueueItemTokens(std::string& tokenStream, const Renderer::DrawItem& di, ItemState& state, const CadScene* NV_RESTRICT scene,
+                                  TokenArrays* arrays = NULL, int bufferObject = -1);
+    static void enqueueItemTokens(NVPointerStream& tokenStream, const Renderer::DrawItem& di, ItemState& state, const CadScene* NV_RESTRICT scene);
+
     void renderShadeCommandSW( const void* NV_RESTRICT stream, size_t streamSize, ShadeCommand &shade );
   };
 }
@@ -25,6 +25,9 @@
 #ifndef USE_COMPUTE
 #define USE_COMPUTE 1
 #endif
+#ifndef USE_COMPACTMATRIX
+#define USE_COMPACTMATRIX 0
+#endif
 
 #define MAX_LEVELS 10
 
@@ -67,6 +70,20 @@ layout(std430,binding=0) restrict buffer worldMatricesBuffer {
   mat4 worldMatrices[];
 };
 
+#if USE_COMPACTMATRIX
+// must match CadScene::MatrixCompact
+layout(std430,binding=3) restrict writeonly buffer compactMatricesBuffer {
+  vec4 compactMatrices[];
+};
+
+void storeCompact(int idx, mat4 world)
+{
+  compactMatrices[idx*3 + 0] = vec4(world[0][0], world[1][0], world[2][0], world[3][0]);
+  compactMatrices[idx*3 + 1] = vec4(world[0][1], world[1][1], world[2][1], world[3][1]);
+  compactMatrices[idx*3 + 2] = vec4(world[0][2], world[1][2], world[2][2], world[3][2]);
+}
+#endif
+
 layout(binding=1) uniform samplerBuffer texWorldMatrices;
 layout(binding=2) uniform samplerBuffer texObjectMatrices;
 
@@ -119,5 +136,8 @@ void main()
 
     worldMatrices[self*MATRICES + MATRIX_BEGIN_WORLD + MATRIX_BASE]     = parentBase;
     worldMatrices[self*MATRICES + MATRIX_BEGIN_WORLD + MATRIX_INVTRANS] = transpose(inverse(parentBase));
+#if USE_COMPACTMATRIX
+    storeCompact(self, parentBase);
+#endif
   }
 }
@@ -25,6 +25,9 @@
 #ifndef USE_COMPUTE
 #define USE_COMPUTE 1
 #endif
+#ifndef USE_COMPACTMATRIX
+#define USE_COMPACTMATRIX 0
+#endif
 
 #define LEVELBITS 8
 
@@ -61,6 +64,20 @@ layout(std430,binding=0) restrict buffer worldMatricesBuffer {
   mat4 worldMatrices[];
 };
 
+#if USE_COMPACTMATRIX
+// must match CadScene::MatrixCompact
+layout(std430,binding=3) restrict writeonly buffer compactMatricesBuffer {
+  vec4 compactMatrices[];
+};
+
+void storeCompact(int idx, mat4 world)
+{
+  compactMatrices[idx*3 + 0] = vec4(world[0][0], world[1][0], world[2][0], world[3][0]);
+  compactMatrices[idx*3 + 1] = vec4(world[0][1], world[1][1], world[2][1], world[3][1]);
+  compactMatrices[idx*3 + 2] = vec4(world[0][2], world[1][2], world[2][2], world[3][2]);
+}
+#endif
+
 layout(binding=1) uniform samplerBuffer texWorldMatrices;
 layout(binding=2) uniform samplerBuffer texObjectMatrices;
 
@@ -107,4 +124,7 @@ void main()
 
   worldMatrices[self*MATRICES + MATRIX_BEGIN_WORLD + MATRIX_BASE]     = world;
   worldMatrices[self*MATRICES + MATRIX_BEGIN_WORLD + MATRIX_INVTRANS] = transpose(worldInv);
+#if USE_COMPACTMATRIX
+  storeCompact(self, world);
+#endif
 }
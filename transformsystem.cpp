@@ -25,7 +25,7 @@
 #include "transformsystem.hpp"
 #include <nvgl/base_gl.hpp>
 
-void TransformSystem::process(const NodeTree& nodeTree, Buffer& ids, Buffer& matricesObject, Buffer& matricesWorld )
+void TransformSystem::process(const NodeTree& nodeTree, Buffer& ids, Buffer& matricesObject, Buffer& matricesWorld, const Buffer* matricesCompact )
 {
   glUseProgram(m_programs.transform_leaves);
 
@@ -50,6 +50,9 @@ void TransformSystem::process(const NodeTree& nodeTree, Buffer& ids, Buffer& mat
   matricesWorld.BindBufferRange(GL_SHADER_STORAGE_BUFFER,0);
   matricesObject.BindBufferRange(GL_SHADER_STORAGE_BUFFER,1);
   glBindBufferBase(GL_SHADER_STORAGE_BUFFER,2,m_scratchGL);
+  if (matricesCompact){
+    matricesCompact->BindBufferRange(GL_SHADER_STORAGE_BUFFER,3);
+  }
 
   const int maxshaderlevels = 10;
   int maxlevels = maxshaderlevels;
@@ -108,6 +111,7 @@ void TransformSystem::process(const NodeTree& nodeTree, Buffer& ids, Buffer& mat
   glBindBufferBase(GL_SHADER_STORAGE_BUFFER,0,0);
   glBindBufferBase(GL_SHADER_STORAGE_BUFFER,1,0);
   glBindBufferBase(GL_SHADER_STORAGE_BUFFER,2,0);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER,3,0);
 
   for (int i = 0; i < TEXTURES; i++){
     nvgl::bindMultiTexture(GL_TEXTURE0 + i, GL_TEXTURE_BUFFER, 0);
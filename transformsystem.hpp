@@ -80,7 +80,9 @@ public:
   void deinit();
   void update( const Programs &programs );
   
-  void process(const NodeTree&, Buffer& ids, Buffer& matricesObject, Buffer& matricesWorld );
+  // matricesCompact optionally receives the world matrices as 3x4 rows,
+  // programs must be built with USE_COMPACTMATRIX then
+  void process(const NodeTree&, Buffer& ids, Buffer& matricesObject, Buffer& matricesWorld, const Buffer* matricesCompact = nullptr );
   
 private:
 